@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+namespace mcc::bench {
+    // Checks that a variant gave the same result as the reference it is compared against. If it didn't, prints
+    // "<name> failed:" followed by the message parts and exits with an error, so that a wrong variant is never timed.
+    // The message is only formatted on failure, so checks may run per element.
+    template <typename... Args>
+    void expect_same(const char* name, bool same, const Args&... message) {
+        if (!same) {
+            std::cerr << name << " failed:" << std::endl;
+            (std::cerr << ... << message) << std::endl;
+            std::exit(1);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <mcc/gl/voxel.hpp>
+#include <mcc/entity/bounding_box.hpp>
+#include <mcc/data/qb_parser.hpp>
+#include <mcc/thread_pool.hpp>
+
+#include <bench/bench.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*
+    Collision benchmark.
+    Usage: `mcc-bench-collision [DATA_FOLDER] [ITERATIONS]`.
+    Sweeps a fixed set of moving boxes through the occupancy grids of the models in DATA_FOLDER/model/ and a few synthetic
+    matrices. The variants exit with an error if their contacts differ from the serial sweep.
+    Each result is printed to stdout as a single JSON object per line, so that runs can be compared across commits.
+*/
+
+using namespace mcc;
+
+struct Case {
+    std::string name;
+    glm::ivec3 size;
+    gl::Occupancy occupancy;
+    std::vector<entity::BoundingBox> boxes;
+    std::vector<glm::f32vec3> motions;
+};
+
+struct Variant {
+    std::string name;
+    std::function<void(const Case&, std::vector<entity::Contact>&)> run;
+};
+
+// Entity sized boxes spread over the grid, each moving a few voxels per step, as in a frame of a simulation
+static Case make_case(std::string name, const gl::Matrix& matrix, int count) {
+    Case c;
+    c.name = std::move(name);
+    c.size = glm::ivec3(matrix.size);
+    c.occupancy = gl::matrix_to_occupancy(matrix);
+
+    // A fixed seed and raw engine output keep the boxes identical on every platform
+    std::mt19937 random(1234);
+    auto uniform = [&]() { return float(random() % 65536) / 65536.0f; };
+
+    for (int i = 0; i < count; ++i) {
+        auto low = glm::vec3(uniform(), uniform(), uniform()) * glm::vec3(c.size);
+        auto size = glm::vec3(0.6f, 1.8f, 0.6f) + glm::vec3(uniform(), uniform(), uniform()) * 0.5f;
+        c.boxes.push_back(entity::BoundingBox(low, low + size));
+        c.motions.push_back((glm::vec3(uniform(), uniform(), uniform()) * 2.0f - 1.0f) * 4.0f);
+    }
+    return c;
+}
+
+static std::vector<Case> make_cases(const std::string& data_folder) {
+    const int box_count = 1 << 14;
+
+    std::vector<std::filesystem::path> paths;
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator(data_folder + "model/", ec)) {
+        if (entry.path().extension() == ".qb") {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Case> cases;
+    for (auto& path : paths) {
+        std::ifstream ifs(path, std::ios::binary);
+        auto result = data::parse_qb(ifs);
+        if (result.is_error()) {
+            std::cerr << "Skipping \"" << path.string() << "\":" << std::endl << result.get_error() << std::endl;
+            continue;
+        }
+        cases.push_back(make_case(path.stem().string(), result.unwrap(), box_count));
+    }
+
+    // Terrain like matrices, half solid, where most boxes hit something
+    for (int size : { 64, 255 }) {
+        gl::Matrix matrix;
+        matrix.size = glm::u8vec3(size, size, size);
+        matrix.voxels.resize(size_t(size) * size * size, 0);
+        for (int x = 0; x < size; ++x) {
+            for (int y = 0; y < size; ++y) {
+                for (int z = 0; z < size; ++z) {
+                    bool solid = std::cos(x / 8.0f) + std::cos(y / 8.0f) + std::cos(z / 8.0f) < 0.0f;
+                    matrix.voxels[matrix.get_index(x, y, z)] = solid ? 1 : 0;
+                }
+            }
+        }
+        cases.push_back(make_case("caves_" + std::to_string(size), matrix, box_count));
+    }
+
+    return cases;
+}
+
+int main(int argc, char** argv) {
+    std::string data_folder = argc > 1 ? argv[1] : "data/";
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+    if (iterations < 1) {
+        std::cerr << "mcc-bench-collision failed:" << std::endl << "The iteration count must be at least 1" << std::endl;
+        return 1;
+    }
+
+    ThreadPool pool;
+    std::vector<Variant> variants = {
+        { "sweep", [](const Case& c, std::vector<entity::Contact>& contacts) {
+            entity::sweep(c.occupancy, c.boxes, c.motions, contacts);
+        } },
+        { "sweep_parallel", [&pool](const Case& c, std::vector<entity::Contact>& contacts) {
+            entity::sweep(c.occupancy, c.boxes, c.motions, contacts, &pool);
+        } },
+    };
+
+    for (auto& c : make_cases(data_folder)) {
+        std::vector<entity::Contact> expected;
+        entity::sweep(c.occupancy, c.boxes, c.motions, expected);
+
+        for (auto& variant : variants) {
+            std::vector<entity::Contact> contacts;
+            variant.run(c, contacts); // Warm up
+
+            for (size_t i = 0; i < contacts.size(); ++i) {
+                bool same = contacts[i].time == expected[i].time && contacts[i].normal == expected[i].normal;
+                bench::expect_same("mcc-bench-collision", same, "Variant \"", variant.name, "\" differs from the serial sweep on box ", i, " of \"", c.name, "\"");
+            }
+
+            double total_ns = 0.0, min_ns = INFINITY;
+            for (int i = 0; i < iterations; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                variant.run(c, contacts);
+                auto end = std::chrono::steady_clock::now();
+
+                double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+                total_ns += ns;
+                min_ns = std::min(min_ns, ns);
+            }
+
+            size_t hit_count = 0;
+            for (auto& contact : contacts) {
+                hit_count += contact.normal != glm::ivec3(0) ? 1 : 0;
+            }
+
+            double box_count = double(c.boxes.size());
+            std::cout << "{\"case\":\"" << c.name << "\""
+                      << ",\"size\":[" << c.size.x << "," << c.size.y << "," << c.size.z << "]"
+                      << ",\"variant\":\"" << variant.name << "\""
+                      << ",\"iterations\":" << iterations
+                      << ",\"boxes\":" << c.boxes.size()
+                      << ",\"hit_fraction\":" << double(hit_count) / box_count
+                      << ",\"ns_per_box\":" << total_ns / iterations / box_count
+                      << ",\"min_ns_per_box\":" << min_ns / box_count
+                      << "}" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,624 @@
+#include <mcc/entity/entity.hpp>
+#include <mcc/entity/serialization.hpp>
+#include <mcc/entity/simulation.hpp>
+#include <mcc/entity/spatial_hash.hpp>
+#include <mcc/memory/mapped_file.hpp>
+#include <mcc/thread_pool.hpp>
+
+#include <bench/bench.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/*
+    Entity update benchmark.
+    Usage: `mcc-bench-entity [ENTITY_COUNT] [ITERATIONS]`.
+    Moves a fixed set of entities by their velocities for a frame, stored either as a linked list of objects with a virtual
+    update (the layout the entity registry replaced) or on an entity::Registry. The variants exit with an error if the
+    entities end up in different positions.
+    Then runs the entities on an entity::Simulation, in both modes, which must agree on the positions of the entities.
+    Then saves and loads the entities of every chunk, either one entity at a time through virtual stream calls (as the
+    old entities did) or as the component blocks of entity/serialization.hpp, loaded from a memory mapped file.
+    Finally indexes the entities on an entity::SpatialHash and times its updates and queries, after checking the queries
+    against brute force searches on a smaller, denser world.
+    Each result is printed to stdout as a single JSON object per line, so that runs can be compared across commits.
+*/
+
+using namespace mcc;
+
+const float frame_dt = 1.0f / 60.0f;
+const float chunk_extent = 32.0f;
+
+// An entity of the old layout, allocated on its own and linked to the next one
+class ListEntity {
+public:
+    virtual ~ListEntity() = default;
+    virtual void update(float dt) = 0;
+    virtual void load(std::istream& is) = 0;
+    virtual void unload(std::ostream& os) = 0;
+
+    glm::i64vec3 chunk_pos;
+    glm::f32vec3 pos;
+    ListEntity* next = nullptr;
+};
+
+class MovingEntity : public ListEntity {
+public:
+    virtual void update(float dt) override {
+        auto pos = this->pos + this->velocity * dt;
+        auto shift = glm::floor(pos / chunk_extent);
+        if (shift != glm::f32vec3(0.0f)) {
+            this->chunk_pos += glm::i64vec3(shift);
+            pos -= shift * chunk_extent;
+        }
+        this->pos = pos;
+    }
+
+    virtual void load(std::istream& is) override {
+        is.read((char*)&this->chunk_pos, sizeof(this->chunk_pos));
+        is.read((char*)&this->pos, sizeof(this->pos));
+        is.read((char*)&this->velocity, sizeof(this->velocity));
+    }
+
+    virtual void unload(std::ostream& os) override {
+        os.put(1);
+        os.write((const char*)&this->chunk_pos, sizeof(this->chunk_pos));
+        os.write((const char*)&this->pos, sizeof(this->pos));
+        os.write((const char*)&this->velocity, sizeof(this->velocity));
+    }
+
+    glm::f32vec3 velocity;
+};
+
+class StaticEntity : public ListEntity {
+public:
+    virtual void update(float) override {
+        // Empty
+    }
+
+    virtual void load(std::istream& is) override {
+        is.read((char*)&this->chunk_pos, sizeof(this->chunk_pos));
+        is.read((char*)&this->pos, sizeof(this->pos));
+    }
+
+    virtual void unload(std::ostream& os) override {
+        os.put(0);
+        os.write((const char*)&this->chunk_pos, sizeof(this->chunk_pos));
+        os.write((const char*)&this->pos, sizeof(this->pos));
+    }
+};
+
+struct Spawn {
+    entity::Signature signature;
+    glm::i64vec3 chunk_pos;
+    glm::f32vec3 pos, velocity;
+};
+
+struct World {
+    std::vector<std::unique_ptr<ListEntity>> objects; // Owns the list entities, in allocation order
+    ListEntity* list = nullptr;
+    entity::Registry registry;
+    std::vector<entity::Handle> handles; // Handle of each spawned entity, in spawn order
+};
+
+// Mixes moving entities, moving entities with bounds and static entities with bounds
+static std::vector<Spawn> make_spawns(int count) {
+    // A fixed seed and raw engine output keep the entities identical on every platform
+    std::mt19937 random(1234);
+    auto uniform = [&]() { return float(random() % 65536) / 65536.0f; };
+
+    std::vector<Spawn> spawns(count);
+    for (auto& spawn : spawns) {
+        int kind = random() % 10;
+        spawn.signature = kind < 6 ? entity::Velocity : (kind < 9 ? entity::Velocity | entity::Bounds : entity::Bounds);
+        spawn.chunk_pos = glm::i64vec3(random() % 16, random() % 4, random() % 16);
+        spawn.pos = glm::vec3(uniform(), uniform(), uniform()) * chunk_extent;
+        spawn.velocity = (spawn.signature & entity::Velocity) ? (glm::vec3(uniform(), uniform(), uniform()) * 2.0f - 1.0f) * 10.0f : glm::vec3(0.0f);
+    }
+    return spawns;
+}
+
+static entity::Handle spawn_entity(entity::Registry& registry, const Spawn& spawn) {
+    auto handle = registry.create(spawn.signature, spawn.chunk_pos, spawn.pos);
+    if (spawn.signature & entity::Velocity) {
+        registry.get_velocity(handle) = spawn.velocity;
+    }
+    if (spawn.signature & entity::Bounds) {
+        registry.get_bounds(handle) = entity::BoundingBox({ -0.3f, 0.0f, -0.3f }, { 0.3f, 1.8f, 0.3f });
+    }
+    return handle;
+}
+
+static void make_world(const std::vector<Spawn>& spawns, World& world) {
+    // Link the list in a shuffled order, as entities spawned and despawned over time would be
+    std::vector<size_t> order(spawns.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(5678));
+
+    world.objects.resize(spawns.size());
+    for (size_t i = 0; i < spawns.size(); ++i) {
+        auto& spawn = spawns[i];
+        if (spawn.signature & entity::Velocity) {
+            auto moving = new MovingEntity();
+            moving->velocity = spawn.velocity;
+            world.objects[i].reset(moving);
+        } else {
+            world.objects[i].reset(new StaticEntity());
+        }
+        world.objects[i]->chunk_pos = spawn.chunk_pos;
+        world.objects[i]->pos = spawn.pos;
+
+        world.handles.push_back(spawn_entity(world.registry, spawn));
+    }
+
+    for (auto i : order) {
+        world.objects[i]->next = world.list;
+        world.list = world.objects[i].get();
+    }
+}
+
+// Calls func iterations times, returning the total and the minimum time taken, in nanoseconds.
+// If reset is passed, it is called before each call, outside of the time taken.
+template <typename F>
+static std::pair<double, double> measure(int iterations, F&& func, const std::function<void()>& reset = nullptr) {
+    double total_ns = 0.0, min_ns = INFINITY;
+    for (int i = 0; i < iterations; ++i) {
+        if (reset) {
+            reset();
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+
+        double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        total_ns += ns;
+        min_ns = std::min(min_ns, ns);
+    }
+    return { total_ns, min_ns };
+}
+
+struct Query {
+    glm::i64vec3 chunk_pos;
+    glm::f32vec3 pos;
+};
+
+static std::vector<Query> make_queries(int count, int chunks) {
+    std::mt19937 random(9012);
+    auto uniform = [&]() { return float(random() % 65536) / 65536.0f; };
+
+    std::vector<Query> queries(count);
+    for (auto& query : queries) {
+        query.chunk_pos = glm::i64vec3(random() % chunks, 0, random() % chunks);
+        query.pos = glm::vec3(uniform(), uniform(), uniform()) * chunk_extent;
+    }
+    return queries;
+}
+
+// Compares the spatial hash queries against brute force searches, after moving and destroying a few entities.
+// Returns an empty string on success, or the query which failed.
+static std::string check_spatial_hash(ThreadPool& pool) {
+    entity::Registry registry;
+    entity::SpatialHash hash(chunk_extent, 8.0f);
+
+    // Dense enough for most boxes to touch a few others, and spread over a few chunks to cross their borders
+    std::mt19937 random(3456);
+    auto uniform = [&]() { return float(random() % 65536) / 65536.0f; };
+    std::vector<entity::Handle> handles;
+    for (int i = 0; i < 4000; ++i) {
+        auto pos = glm::vec3(uniform(), uniform() * 0.25f, uniform()) * chunk_extent;
+        auto handle = registry.create(entity::Velocity | entity::Bounds, glm::i64vec3(random() % 2, 0, random() % 2), pos);
+        auto half = glm::vec3(0.2f) + glm::vec3(uniform(), uniform(), uniform()) * 0.6f;
+        registry.get_bounds(handle) = entity::BoundingBox(-half, half);
+        registry.get_velocity(handle) = (glm::vec3(uniform(), uniform(), uniform()) * 2.0f - 1.0f) * 60.0f;
+        handles.push_back(handle);
+    }
+
+    hash.update(registry);
+    for (int frame = 0; frame < 4; ++frame) {
+        entity::integrate(registry, frame_dt, chunk_extent);
+        for (int i = frame; i < int(handles.size()); i += 97) {
+            hash.remove(handles[i]);
+            registry.destroy(handles[i]);
+        }
+        hash.update(registry);
+    }
+
+    if (hash.size() != registry.size()) {
+        return "size";
+    }
+
+    // Everything is compared on positions relative to the query, computed as the hash does
+    std::vector<entity::Handle> alive;
+    for (auto handle : handles) {
+        if (registry.is_alive(handle)) {
+            alive.push_back(handle);
+        }
+    }
+    auto offset = [&](entity::Handle handle, const Query& query) {
+        return glm::f32vec3(registry.get_chunk_position(handle) - query.chunk_pos) * chunk_extent + (registry.get_position(handle) - query.pos);
+    };
+    auto sorted = [](std::vector<entity::Handle> handles) {
+        std::sort(handles.begin(), handles.end(), [](entity::Handle a, entity::Handle b) { return a.index < b.index; });
+        return handles;
+    };
+
+    auto box = entity::BoundingBox({ -3.0f, -1.0f, -2.0f }, { 2.0f, 4.0f, 3.0f });
+    for (auto& query : make_queries(200, 2)) {
+        std::vector<entity::Handle> radius, radius_expected, boxed, boxed_expected, nearest, nearest_expected;
+        hash.query_radius(query.chunk_pos, query.pos, 6.0f, radius);
+        hash.query_box(query.chunk_pos, query.pos, box, boxed);
+        hash.query_nearest(query.chunk_pos, query.pos, 8, 12.0f, nearest);
+
+        std::vector<std::pair<float, entity::Handle>> distances;
+        for (auto handle : alive) {
+            auto o = offset(handle, query);
+            auto distance = glm::dot(o, o);
+            if (distance <= 36.0f) {
+                radius_expected.push_back(handle);
+            }
+            if (registry.get_bounds(handle).translate(o).intersects(box)) {
+                boxed_expected.push_back(handle);
+            }
+            if (distance <= 144.0f) {
+                distances.push_back({ distance, handle });
+            }
+        }
+        std::sort(distances.begin(), distances.end(), [](auto& a, auto& b) {
+            return a.first < b.first || (a.first == b.first && a.second.index < b.second.index);
+        });
+        for (size_t i = 0; i < distances.size() && i < 8; ++i) {
+            nearest_expected.push_back(distances[i].second);
+        }
+
+        if (sorted(radius) != sorted(radius_expected)) {
+            return "query_radius";
+        }
+        if (sorted(boxed) != sorted(boxed_expected)) {
+            return "query_box";
+        }
+        if (nearest != nearest_expected) {
+            return "query_nearest";
+        }
+    }
+
+    auto normalize = [](const std::vector<std::pair<entity::Handle, entity::Handle>>& pairs) {
+        std::set<std::pair<uint32_t, uint32_t>> set;
+        for (auto& pair : pairs) {
+            set.insert({ std::min(pair.first.index, pair.second.index), std::max(pair.first.index, pair.second.index) });
+        }
+        return set.size() == pairs.size() ? set : std::set<std::pair<uint32_t, uint32_t>>();
+    };
+
+    std::vector<std::pair<entity::Handle, entity::Handle>> pairs, pairs_parallel, pairs_expected;
+    hash.find_pairs(pairs);
+    hash.find_pairs(pairs_parallel, &pool);
+    for (size_t i = 0; i < alive.size(); ++i) {
+        auto query = Query { registry.get_chunk_position(alive[i]), registry.get_position(alive[i]) };
+        for (size_t j = i + 1; j < alive.size(); ++j) {
+            if (registry.get_bounds(alive[i]).intersects(registry.get_bounds(alive[j]).translate(offset(alive[j], query)))) {
+                pairs_expected.push_back({ alive[i], alive[j] });
+            }
+        }
+    }
+    if (pairs_expected.empty() || normalize(pairs) != normalize(pairs_expected) || pairs_parallel != pairs) {
+        return "find_pairs";
+    }
+
+    return "";
+}
+
+// Every entity of a registry as a string of its components, sorted, so that registries can be compared regardless of
+// the order of their entities
+static std::vector<std::string> snapshot(entity::Registry& registry) {
+    std::vector<std::string> entities;
+    registry.each(0, [&](entity::Archetype& a) {
+        for (size_t i = 0; i < a.size(); ++i) {
+            std::string entity((const char*)&a.signature, sizeof(a.signature));
+            entity.append((const char*)&a.chunk_pos[i], sizeof(a.chunk_pos[i]));
+            entity.append((const char*)&a.pos[i], sizeof(a.pos[i]));
+            if (a.signature & entity::Velocity) {
+                entity.append((const char*)&a.velocity[i], sizeof(a.velocity[i]));
+            }
+            if (a.signature & entity::Bounds) {
+                auto low = a.bounds[i].get_low(), high = a.bounds[i].get_high();
+                entity.append((const char*)&low, sizeof(low));
+                entity.append((const char*)&high, sizeof(high));
+            }
+            entities.push_back(std::move(entity));
+        }
+    });
+    std::sort(entities.begin(), entities.end());
+    return entities;
+}
+
+// Saves and loads the entities of every chunk of the world, returning false if they don't survive the round trip
+static bool bench_serialization(const std::vector<Spawn>& spawns, int iterations) {
+    World world;
+    make_world(spawns, world);
+
+    std::vector<glm::i64vec3> chunks;
+    for (int x = 0; x < 16; ++x) {
+        for (int y = 0; y < 4; ++y) {
+            for (int z = 0; z < 16; ++z) {
+                chunks.push_back({ x, y, z });
+            }
+        }
+    }
+
+    auto print = [&](const char* variant, double total_ns, size_t bytes) {
+        std::cout << "{\"variant\":\"" << variant << "\""
+                  << ",\"entities\":" << spawns.size()
+                  << ",\"iterations\":" << iterations
+                  << ",\"bytes\":" << bytes
+                  << ",\"ns_per_entity\":" << total_ns / iterations / spawns.size()
+                  << ",\"mb_per_s\":" << double(bytes) * iterations / total_ns * 1e3
+                  << "}" << std::endl;
+    };
+
+    // One entity at a time, through virtual calls on a stream
+    std::string stream_data;
+    auto [unload_ns, unload_min_ns] = measure(iterations, [&]() {
+        std::ostringstream os;
+        for (auto entity = world.list; entity != nullptr; entity = entity->next) {
+            entity->unload(os);
+        }
+        stream_data = os.str();
+    });
+    print("stream_unload", unload_ns, stream_data.size());
+
+    std::vector<std::unique_ptr<ListEntity>> loaded_objects;
+    auto [load_ns, load_min_ns] = measure(iterations, [&]() {
+        std::istringstream is(stream_data);
+        for (int type = is.get(); type != std::char_traits<char>::eof(); type = is.get()) {
+            loaded_objects.emplace_back(type == 1 ? (ListEntity*)new MovingEntity() : (ListEntity*)new StaticEntity());
+            loaded_objects.back()->load(is);
+        }
+    }, [&]() { loaded_objects.clear(); });
+    print("stream_load", load_ns, stream_data.size());
+    if (loaded_objects.size() != spawns.size()) {
+        return false;
+    }
+
+    // All the chunks at once, as component blocks, written to a file and loaded back from a memory mapping
+    std::vector<std::vector<unsigned char>> saved;
+    auto [save_ns, save_min_ns] = measure(iterations, [&]() {
+        saved.clear();
+        entity::save_chunks(world.registry, chunks, saved);
+    });
+    size_t saved_size = 0;
+    for (auto& chunk : saved) {
+        saved_size += chunk.size();
+    }
+    print("batched_save", save_ns, saved_size);
+
+    auto path = (std::filesystem::temp_directory_path() / "mcc-bench-entity.bin").string();
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        for (auto& chunk : saved) {
+            ofs.write((const char*)chunk.data(), std::streamsize(chunk.size()));
+        }
+    }
+
+    bool ok = true;
+    {
+        auto file = memory::MappedFile::open(path);
+        if (file.is_error()) {
+            std::cerr << file.get_error() << std::endl;
+            return false;
+        }
+        auto mapped = std::move(file).unwrap();
+
+        // Load into the same registry every time, destroying the entities loaded before, as a game streaming chunks in
+        // and out would, so that the arrays already have room for them
+        entity::Registry loaded;
+        std::vector<entity::Handle> handles;
+        auto [map_load_ns, map_load_min_ns] = measure(iterations, [&]() {
+            for (size_t offset = 0; offset < mapped.get_size();) {
+                auto view = entity::ChunkView::parse(mapped.get_data() + offset, mapped.get_size() - offset);
+                if (view.is_error()) {
+                    std::cerr << view.get_error() << std::endl;
+                    ok = false;
+                    break;
+                }
+                auto chunk = std::move(view).unwrap();
+                entity::load_chunk(loaded, chunk, &handles);
+                offset += chunk.get_size();
+            }
+        }, [&]() {
+            for (auto handle : handles) {
+                loaded.destroy(handle);
+            }
+            handles.clear();
+        });
+        print("batched_load", map_load_ns, mapped.get_size());
+
+        ok = ok && snapshot(loaded) == snapshot(world.registry);
+    }
+    std::filesystem::remove(path);
+
+    // Unloading must save the same data, and leave nothing behind
+    std::vector<std::vector<unsigned char>> unloaded;
+    entity::unload_chunks(world.registry, chunks, unloaded);
+    return ok && unloaded == saved && world.registry.size() == 0;
+}
+
+int main(int argc, char** argv) {
+    int entity_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 100;
+    if (entity_count < 1 || iterations < 1) {
+        std::cerr << "mcc-bench-entity failed:" << std::endl << "The entity and iteration counts must be at least 1" << std::endl;
+        return 1;
+    }
+
+    ThreadPool pool;
+    std::vector<std::pair<std::string, std::function<void(World&)>>> variants = {
+        { "virtual_list", [](World& world) {
+            for (auto entity = world.list; entity != nullptr; entity = entity->next) {
+                entity->update(frame_dt);
+            }
+        } },
+        { "registry", [](World& world) {
+            entity::integrate(world.registry, frame_dt, chunk_extent);
+        } },
+        { "registry_parallel", [&pool](World& world) {
+            entity::integrate(world.registry, frame_dt, chunk_extent, &pool);
+        } },
+    };
+
+    auto spawns = make_spawns(entity_count);
+    for (auto& variant : variants) {
+        World world;
+        make_world(spawns, world);
+        variant.second(world); // Warm up
+
+        // Both layouts must move the entities the same way. The variants only touch their own layout.
+        World expected;
+        make_world(spawns, expected);
+        variants[0].second(expected);
+        for (size_t i = 0; i < spawns.size(); ++i) {
+            bool list_moved = variant.first == "virtual_list";
+            auto pos = list_moved ? world.objects[i]->pos : world.registry.get_position(world.handles[i]);
+            auto chunk_pos = list_moved ? world.objects[i]->chunk_pos : world.registry.get_chunk_position(world.handles[i]);
+            bool same = pos == expected.objects[i]->pos && chunk_pos == expected.objects[i]->chunk_pos;
+            bench::expect_same("mcc-bench-entity", same, "Variant \"", variant.first, "\" moved entity ", i, " differently from the list");
+        }
+
+        auto [total_ns, min_ns] = measure(iterations, [&]() { variant.second(world); });
+
+        std::cout << "{\"variant\":\"" << variant.first << "\""
+                  << ",\"entities\":" << entity_count
+                  << ",\"iterations\":" << iterations
+                  << ",\"ns_per_entity\":" << total_ns / iterations / entity_count
+                  << ",\"ms_per_frame\":" << total_ns / iterations * 1e-6
+                  << ",\"min_ms_per_frame\":" << min_ns * 1e-6
+                  << "}" << std::endl;
+    }
+
+    // Simulate the entities with bounds as falling bodies with drag. Destroying some of the entities shuffles the rows of
+    // the archetypes, which the deterministic mode sorts back.
+    std::vector<std::vector<std::pair<glm::i64vec3, glm::f32vec3>>> results;
+    for (auto mode : { entity::Simulation::Mode::Deterministic, entity::Simulation::Mode::Parallel }) {
+        auto deterministic = mode == entity::Simulation::Mode::Deterministic;
+        entity::Simulation simulation(60.0f, chunk_extent, &pool, mode);
+        simulation.add_system(entity::Velocity | entity::Bounds, [](entity::Archetype& a, size_t begin, size_t end, float dt) {
+            for (size_t i = begin; i < end; ++i) {
+                a.velocity[i] = a.velocity[i] * (1.0f - 0.5f * dt) - glm::f32vec3(0.0f, 9.8f * dt, 0.0f);
+            }
+        });
+
+        auto& registry = simulation.get_registry();
+        std::vector<entity::Handle> handles;
+        for (auto& spawn : spawns) {
+            handles.push_back(spawn_entity(registry, spawn));
+        }
+        for (size_t i = 0; i < handles.size(); i += 7) {
+            registry.destroy(handles[i]);
+        }
+
+        // Two frames of a 30 Hz renderer run two ticks each, and a stall only runs a bounded number of ticks
+        if (simulation.advance(1.0f / 30.0f + 1e-4f) != 2 || simulation.advance(10.0f) < 1 ||
+            simulation.get_alpha() < 0.0f || simulation.get_alpha() >= 1.0f) {
+            std::cerr << "mcc-bench-entity failed:" << std::endl << "Simulation::advance() ran the wrong number of ticks" << std::endl;
+            return 1;
+        }
+
+        auto [total_ns, min_ns] = measure(iterations, [&]() { simulation.tick(); });
+        std::cout << "{\"variant\":\"" << (deterministic ? "simulation_deterministic" : "simulation_parallel") << "\""
+                  << ",\"entities\":" << registry.size()
+                  << ",\"iterations\":" << iterations
+                  << ",\"ns_per_entity\":" << total_ns / iterations / registry.size()
+                  << ",\"ms_per_tick\":" << total_ns / iterations * 1e-6
+                  << ",\"min_ms_per_tick\":" << min_ns * 1e-6
+                  << "}" << std::endl;
+
+        results.emplace_back();
+        for (auto handle : handles) {
+            if (registry.is_alive(handle)) {
+                results.back().push_back({ registry.get_chunk_position(handle), registry.get_position(handle) });
+            }
+        }
+    }
+
+    bench::expect_same("mcc-bench-entity", results[0] == results[1], "The simulation modes moved the entities differently");
+    bench::expect_same("mcc-bench-entity", bench_serialization(spawns, iterations), "The entities changed when saved and loaded back");
+
+    auto failed = check_spatial_hash(pool);
+    bench::expect_same("mcc-bench-entity", failed.empty(), "SpatialHash::", failed, "() differs from the brute force search");
+
+    // Index the moving world, updating the hash after each frame
+    World world;
+    make_world(spawns, world);
+    entity::SpatialHash hash(chunk_extent, 8.0f);
+    hash.update(world.registry);
+    {
+        auto [total_ns, min_ns] = measure(iterations, [&]() {
+            entity::integrate(world.registry, frame_dt, chunk_extent, &pool);
+            hash.update(world.registry);
+        });
+        std::cout << "{\"variant\":\"spatial_hash_update\""
+                  << ",\"entities\":" << entity_count
+                  << ",\"iterations\":" << iterations
+                  << ",\"ns_per_entity\":" << total_ns / iterations / entity_count
+                  << ",\"ms_per_frame\":" << total_ns / iterations * 1e-6
+                  << ",\"min_ms_per_frame\":" << min_ns * 1e-6
+                  << "}" << std::endl;
+    }
+
+    auto queries = make_queries(1000, 16);
+    auto box = entity::BoundingBox({ -4.0f, -4.0f, -4.0f }, { 4.0f, 4.0f, 4.0f });
+    std::vector<std::pair<std::string, std::function<void(const Query&, std::vector<entity::Handle>&)>>> query_variants = {
+        { "query_radius", [&](const Query& q, std::vector<entity::Handle>& out) { hash.query_radius(q.chunk_pos, q.pos, 8.0f, out); } },
+        { "query_box", [&](const Query& q, std::vector<entity::Handle>& out) { hash.query_box(q.chunk_pos, q.pos, box, out); } },
+        { "query_nearest", [&](const Query& q, std::vector<entity::Handle>& out) { hash.query_nearest(q.chunk_pos, q.pos, 8, 64.0f, out); } },
+    };
+    for (auto& variant : query_variants) {
+        std::vector<entity::Handle> out;
+        auto [total_ns, min_ns] = measure(iterations, [&]() {
+            out.clear();
+            for (auto& query : queries) {
+                variant.second(query, out);
+            }
+        });
+        std::cout << "{\"variant\":\"" << variant.first << "\""
+                  << ",\"entities\":" << entity_count
+                  << ",\"iterations\":" << iterations
+                  << ",\"results_per_query\":" << double(out.size()) / queries.size()
+                  << ",\"ns_per_query\":" << total_ns / iterations / queries.size()
+                  << ",\"min_ns_per_query\":" << min_ns / queries.size()
+                  << "}" << std::endl;
+    }
+
+    for (auto parallel : { false, true }) {
+        std::vector<std::pair<entity::Handle, entity::Handle>> pairs;
+        auto [total_ns, min_ns] = measure(iterations, [&]() {
+            pairs.clear();
+            hash.find_pairs(pairs, parallel ? &pool : nullptr);
+        });
+        std::cout << "{\"variant\":\"" << (parallel ? "find_pairs_parallel" : "find_pairs") << "\""
+                  << ",\"entities\":" << entity_count
+                  << ",\"iterations\":" << iterations
+                  << ",\"pairs\":" << pairs.size()
+                  << ",\"ms_per_frame\":" << total_ns / iterations * 1e-6
+                  << ",\"min_ms_per_frame\":" << min_ns * 1e-6
+                  << "}" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,455 @@
+#include <mcc/gl/voxel.hpp>
+#include <mcc/gl/mesher.hpp>
+#include <mcc/data/qb_parser.hpp>
+#include <mcc/thread_pool.hpp>
+
+#include <bench/bench.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+    Meshing benchmark.
+    Usage: `mcc-bench-mesh [DATA_FOLDER] [ITERATIONS]`.
+    Runs every mesher variant over the models in DATA_FOLDER/model/ and over a set of synthetic worst cases.
+    The matrix_parallel variant uses one thread per hardware thread and exits with an error if its output differs from the serial mesher.
+    Likewise, matrix_scalar disables the SIMD mask kernels and exits with an error if they generate different meshes.
+    matrix_quads generates packed quads, and exits with an error if their count differs from the indexed mesh.
+    The *_morton variants run on a copy of the matrix in Morton order, and exit with an error if their output differs.
+    On Linux, the hardware cache misses of each run are counted too (-1 if the counters aren't available).
+    Each result is printed to stdout as a single JSON object per line, so that runs can be compared across commits.
+*/
+
+// Allocation counters, updated by the global allocation functions below
+static std::atomic<unsigned long long> allocation_count = 0;
+static std::atomic<unsigned long long> allocation_bytes = 0;
+
+void* operator new(size_t size) {
+    allocation_count += 1;
+    allocation_bytes += size;
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+// Counts the hardware cache misses of the calling thread, where supported
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        this->fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~CacheMissCounter() {
+#ifdef __linux__
+        if (this->fd >= 0) {
+            close(this->fd);
+        }
+#endif
+    }
+
+    inline bool is_available() const { return this->fd >= 0; }
+
+    void start() {
+#ifdef __linux__
+        if (this->fd >= 0) {
+            ioctl(this->fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(this->fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Returns the misses since start()
+    long long stop() {
+        long long count = 0;
+#ifdef __linux__
+        if (this->fd >= 0) {
+            ioctl(this->fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(this->fd, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+using namespace mcc;
+
+struct Case {
+    std::string name;
+    gl::Matrix matrix;
+};
+
+// Statistics of a single variant run
+struct Output {
+    size_t quads = 0;
+    size_t vertices = 0;
+    size_t bytes = 0;
+};
+
+struct Variant {
+    std::string name;
+    std::function<void(const Case&)> prepare; // Runs before the timed region, may be empty
+    std::function<Output(const Case&)> run;
+};
+
+static gl::Matrix make_matrix(int size) {
+    gl::Matrix matrix;
+    matrix.size = glm::u8vec3(size, size, size);
+    matrix.voxels.resize(size * size * size, 0);
+    for (int i = 1; i < 256; ++i) {
+        matrix.palette[i].color = { i, 255 - i, (i * 7) % 256, 255 };
+    }
+    return matrix;
+}
+
+static std::vector<Case> make_synthetic_cases() {
+    std::vector<Case> cases;
+
+    for (int size : { 32, 128 }) {
+        auto suffix = "_" + std::to_string(size);
+        // A fixed seed and raw engine output keep the data identical on every platform
+        std::mt19937 random(1234);
+
+        Case checkerboard = { "checkerboard" + suffix, make_matrix(size) };
+        Case noise = { "noise" + suffix, make_matrix(size) };
+        Case solid = { "solid" + suffix, make_matrix(size) };
+        Case sparse = { "sparse" + suffix, make_matrix(size) };
+
+        for (int x = 0, i = 0; x < size; ++x) {
+            for (int y = 0; y < size; ++y) {
+                for (int z = 0; z < size; ++z, ++i) {
+                    checkerboard.matrix.voxels[i] = (x + y + z) % 2 == 0 ? 1 : 0;
+                    noise.matrix.voxels[i] = random() % 2 == 0 ? (unsigned char)(1 + random() % 4) : 0;
+                    solid.matrix.voxels[i] = 1;
+                    sparse.matrix.voxels[i] = random() % 64 == 0 ? (unsigned char)(1 + random() % 4) : 0;
+                }
+            }
+        }
+
+        cases.emplace_back(std::move(checkerboard));
+        cases.emplace_back(std::move(noise));
+        cases.emplace_back(std::move(solid));
+        cases.emplace_back(std::move(sparse));
+    }
+
+    return cases;
+}
+
+static std::vector<Case> load_model_cases(const std::string& data_folder) {
+    std::vector<std::filesystem::path> paths;
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator(data_folder + "model/", ec)) {
+        if (entry.path().extension() == ".qb") {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Case> cases;
+    for (auto& path : paths) {
+        std::ifstream ifs(path, std::ios::binary);
+        auto result = data::parse_qb(ifs);
+        if (result.is_error()) {
+            std::cerr << "Skipping \"" << path.string() << "\":" << std::endl << result.get_error() << std::endl;
+            continue;
+        }
+        cases.push_back({ path.stem().string(), std::move(result.unwrap()) });
+    }
+
+    return cases;
+}
+
+static Output mesh_output(const gl::MeshData& data) {
+    Output out;
+    out.quads = (data.opaque_indices.size() + data.transparent_indices.size()) / 6;
+    out.vertices = data.vertices.size();
+    out.bytes = data.vertices.size() * sizeof(gl::Vertex) +
+                (data.opaque_indices.size() + data.transparent_indices.size()) * sizeof(unsigned int);
+    return out;
+}
+
+static int octree_radius(const gl::Matrix& matrix) {
+    int radius = 1;
+    while (radius < glm::max(matrix.size.x, glm::max(matrix.size.y, matrix.size.z))) {
+        radius *= 2;
+    }
+    return radius;
+}
+
+// Checks if two meshes are exactly the same, vertex by vertex and index by index
+static bool same_mesh(const gl::MeshData& lhs, const gl::MeshData& rhs) {
+    if (lhs.vertices.size() != rhs.vertices.size() ||
+        lhs.opaque_indices != rhs.opaque_indices ||
+        lhs.transparent_indices != rhs.transparent_indices ||
+        lhs.min != rhs.min || lhs.max != rhs.max) {
+        return false;
+    }
+
+    for (int i = 0; i <= gl::face_direction_count; ++i) {
+        if (lhs.opaque_ranges[i] != rhs.opaque_ranges[i]) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < lhs.vertices.size(); ++i) {
+        auto& l = lhs.vertices[i];
+        auto& r = rhs.vertices[i];
+        if (l.pos != r.pos || l.normal != r.normal || l.color != r.color || l.ao != r.ao || l.light != r.light) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Checks if two octrees have exactly the same nodes
+static bool same_octree(const gl::Octree& lhs, const gl::Octree& rhs) {
+    if (lhs.voxels.size() != rhs.voxels.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < lhs.voxels.size(); ++i) {
+        if (lhs.voxels[i].material != rhs.voxels[i].material || lhs.voxels[i].child != rhs.voxels[i].child) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static std::vector<Variant> make_variants(ThreadPool& pool) {
+    auto octree = std::make_shared<gl::Octree>();
+    auto bricks = std::make_shared<gl::BrickMap>();
+    auto morton = std::make_shared<gl::Matrix>();
+
+    // Copies the case's matrix to Morton order
+    auto prepare_morton = [morton](const Case& c) {
+        *morton = gl::Matrix(c.matrix);
+        morton->set_layout(gl::Matrix::Layout::Morton);
+    };
+
+    return {
+        { "matrix", nullptr, [](const Case& c) {
+            gl::MeshData data;
+            gl::mesh_matrix(c.matrix, 1.0f, true, false, data);
+            return mesh_output(data);
+        } },
+        { "matrix_ao", nullptr, [](const Case& c) {
+            gl::MeshData data;
+            gl::mesh_matrix(c.matrix, 1.0f, true, true, data);
+            return mesh_output(data);
+        } },
+        { "matrix_scalar", [](const Case& c) {
+            // The SIMD mask kernels must generate exactly the same mesh as the scalar fallback
+            for (bool bake_ao : { false, true }) {
+                gl::MeshData simd, scalar;
+                gl::mesh_matrix(c.matrix, 1.0f, true, bake_ao, simd);
+                gl::set_mesher_simd(false);
+                gl::mesh_matrix(c.matrix, 1.0f, true, bake_ao, scalar);
+                gl::set_mesher_simd(true);
+                bench::expect_same("mcc-bench-mesh", same_mesh(simd, scalar), "SIMD mesh of \"", c.name, "\" differs from the scalar mesh");
+            }
+        }, [](const Case& c) {
+            gl::MeshData data;
+            gl::set_mesher_simd(false);
+            gl::mesh_matrix(c.matrix, 1.0f, true, false, data);
+            gl::set_mesher_simd(true);
+            return mesh_output(data);
+        } },
+        { "matrix_parallel", [&pool](const Case& c) {
+            // The parallel mesher must generate exactly the same mesh as the serial one
+            gl::MeshData serial, parallel;
+            gl::mesh_matrix(c.matrix, 1.0f, true, true, serial);
+            gl::mesh_matrix(c.matrix, 1.0f, true, true, parallel, &pool);
+            bench::expect_same("mcc-bench-mesh", same_mesh(serial, parallel), "Parallel mesh of \"", c.name, "\" differs from the serial mesh");
+        }, [&pool](const Case& c) {
+            gl::MeshData data;
+            gl::mesh_matrix(c.matrix, 1.0f, true, true, data, &pool);
+            return mesh_output(data);
+        } },
+        { "matrix_quads", [&pool](const Case& c) {
+            // Both mesh representations must have the same quads, on the same direction groups
+            gl::MeshData mesh;
+            gl::QuadData quads;
+            gl::mesh_matrix(c.matrix, 1.0f, true, true, mesh);
+            gl::mesh_matrix_quads(c.matrix, true, true, quads, &pool);
+            bool same = (mesh.opaque_indices.size() + mesh.transparent_indices.size()) / 6 == quads.quads.size() &&
+                        mesh.min == quads.min && mesh.max == quads.max;
+            for (int i = 0; i <= gl::face_direction_count; ++i) {
+                same = same && mesh.opaque_ranges[i] / 6 == quads.opaque_ranges[i];
+            }
+            bench::expect_same("mcc-bench-mesh", same, "Quads of \"", c.name, "\" differ from the indexed mesh");
+        }, [](const Case& c) {
+            gl::QuadData data;
+            gl::mesh_matrix_quads(c.matrix, true, false, data);
+            Output out;
+            out.quads = data.quads.size();
+            out.bytes = data.quads.size() * sizeof(gl::Quad);
+            return out;
+        } },
+        { "matrix_morton", [prepare_morton, morton](const Case& c) {
+            prepare_morton(c);
+            gl::MeshData row_major, z_order;
+            gl::mesh_matrix(c.matrix, 1.0f, true, true, row_major);
+            gl::mesh_matrix(*morton, 1.0f, true, true, z_order);
+            bench::expect_same("mcc-bench-mesh", same_mesh(row_major, z_order), "Morton order mesh of \"", c.name, "\" differs from the row-major mesh");
+        }, [morton](const Case&) {
+            gl::MeshData data;
+            gl::mesh_matrix(*morton, 1.0f, true, false, data);
+            return mesh_output(data);
+        } },
+        { "octree_build", nullptr, [](const Case& c) {
+            auto octree = gl::matrix_to_octree(c.matrix);
+            Output out;
+            out.bytes = octree.voxels.size() * sizeof(gl::Octree::Voxel);
+            return out;
+        } },
+        { "octree_build_morton", [prepare_morton, morton](const Case& c) {
+            prepare_morton(c);
+            bench::expect_same("mcc-bench-mesh", same_octree(gl::matrix_to_octree(c.matrix), gl::matrix_to_octree(*morton)), "Morton order octree of \"", c.name, "\" differs from the row-major octree");
+        }, [morton](const Case&) {
+            auto octree = gl::matrix_to_octree(*morton);
+            Output out;
+            out.bytes = octree.voxels.size() * sizeof(gl::Octree::Voxel);
+            return out;
+        } },
+        { "brick_octree_build", [bricks](const Case& c) {
+            // The brick map must build exactly the same octree as the matrix
+            auto& sz = c.matrix.size;
+            std::memcpy(bricks->palette, c.matrix.palette, sizeof(bricks->palette));
+            bricks->resize(glm::uvec3(sz));
+            for (int x = 0, i = 0; x < sz.x; ++x) {
+                for (int y = 0; y < sz.y; ++y) {
+                    for (int z = 0; z < sz.z; ++z, ++i) {
+                        bricks->set(x, y, z, c.matrix.voxels[i]);
+                    }
+                }
+            }
+
+            bench::expect_same("mcc-bench-mesh", same_octree(gl::matrix_to_octree(c.matrix), gl::brick_map_to_octree(*bricks)), "Brick map octree of \"", c.name, "\" differs from the matrix octree");
+        }, [bricks](const Case&) {
+            auto octree = gl::brick_map_to_octree(*bricks);
+            Output out;
+            out.bytes = octree.voxels.size() * sizeof(gl::Octree::Voxel);
+            return out;
+        } },
+        { "octree", [octree](const Case& c) {
+            *octree = gl::matrix_to_octree(c.matrix);
+        }, [octree](const Case& c) {
+            gl::MeshData data;
+            gl::mesh_octree(*octree, float(octree_radius(c.matrix)), -1, true, data);
+            return mesh_output(data);
+        } },
+    };
+}
+
+int main(int argc, char** argv) {
+    std::string data_folder = argc > 1 ? argv[1] : "data/";
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+    if (iterations < 1) {
+        std::cerr << "mcc-bench-mesh failed:" << std::endl << "The iteration count must be at least 1" << std::endl;
+        return 1;
+    }
+
+    auto cases = load_model_cases(data_folder);
+    auto synthetic = make_synthetic_cases();
+    for (auto& c : synthetic) {
+        cases.emplace_back(std::move(c));
+    }
+
+    ThreadPool pool;
+    auto variants = make_variants(pool);
+    CacheMissCounter cache_misses;
+
+    for (auto& c : cases) {
+        auto& sz = c.matrix.size;
+        double voxel_count = double(sz.x) * double(sz.y) * double(sz.z);
+
+        for (auto& variant : variants) {
+            if (variant.prepare) {
+                variant.prepare(c);
+            }
+            variant.run(c); // Warm up
+
+            double total_ns = 0.0, min_ns = INFINITY;
+            unsigned long long allocations = 0, allocated_bytes = 0;
+            long long misses = 0;
+            Output out;
+
+            for (int i = 0; i < iterations; ++i) {
+                auto count = allocation_count.load();
+                auto bytes = allocation_bytes.load();
+                cache_misses.start();
+                auto begin = std::chrono::steady_clock::now();
+                out = variant.run(c);
+                auto end = std::chrono::steady_clock::now();
+                misses += cache_misses.stop();
+                allocations += allocation_count.load() - count;
+                allocated_bytes += allocation_bytes.load() - bytes;
+
+                double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+                total_ns += ns;
+                min_ns = std::min(min_ns, ns);
+            }
+
+            std::cout << "{\"case\":\"" << c.name << "\""
+                      << ",\"size\":[" << int(sz.x) << "," << int(sz.y) << "," << int(sz.z) << "]"
+                      << ",\"variant\":\"" << variant.name << "\""
+                      << ",\"iterations\":" << iterations
+                      << ",\"ns_per_voxel\":" << total_ns / iterations / voxel_count
+                      << ",\"min_ns_per_voxel\":" << min_ns / voxel_count
+                      << ",\"quads\":" << out.quads
+                      << ",\"vertices\":" << out.vertices
+                      << ",\"bytes\":" << out.bytes
+                      << ",\"allocations\":" << allocations / iterations
+                      << ",\"allocated_bytes\":" << allocated_bytes / iterations
+                      << ",\"cache_misses\":" << (cache_misses.is_available() ? misses / iterations : -1)
+                      << "}" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include <mcc/gl/voxel.hpp>
+#include <mcc/gl/raycast.hpp>
+#include <mcc/data/qb_parser.hpp>
+#include <mcc/thread_pool.hpp>
+
+#include <bench/bench.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*
+    Raycasting benchmark.
+    Usage: `mcc-bench-raycast [DATA_FOLDER] [ITERATIONS]`.
+    Casts a fixed set of rays through the models in DATA_FOLDER/model/ and a few synthetic matrices, using every voxel
+    structure. The variants exit with an error if their hits differ from the row-major matrix.
+    Each result is printed to stdout as a single JSON object per line, so that runs can be compared across commits.
+*/
+
+using namespace mcc;
+
+struct Case {
+    std::string name;
+    gl::Matrix matrix;
+    gl::Matrix morton;
+    gl::Octree octree;
+    int radius;
+    std::vector<gl::Ray> rays;
+};
+
+struct Variant {
+    std::string name;
+    std::function<void(const Case&, std::vector<gl::RayHit>&)> run;
+};
+
+// Rays from random points around the matrix towards random points inside of it, so that most of them cross it
+static std::vector<gl::Ray> make_rays(const gl::Matrix& matrix, int count) {
+    // A fixed seed and raw engine output keep the rays identical on every platform
+    std::mt19937 random(1234);
+    auto uniform = [&]() { return float(random() % 65536) / 65536.0f; };
+
+    auto size = glm::vec3(matrix.size);
+    auto center = size * 0.5f;
+    float distance = glm::length(size);
+
+    std::vector<gl::Ray> rays(count);
+    for (auto& ray : rays) {
+        auto dir = glm::vec3(uniform(), uniform(), uniform()) * 2.0f - 1.0f;
+        if (dir == glm::vec3(0.0f)) {
+            dir = glm::vec3(1.0f, 0.0f, 0.0f);
+        }
+        ray.origin = center + glm::normalize(dir) * distance;
+        auto target = glm::vec3(uniform(), uniform(), uniform()) * size;
+        ray.direction = glm::normalize(target - ray.origin);
+        ray.max_distance = distance * 2.0f;
+    }
+    return rays;
+}
+
+static Case make_case(std::string name, gl::Matrix&& matrix) {
+    Case c;
+    c.name = std::move(name);
+    c.matrix = std::move(matrix);
+    c.morton = gl::Matrix(c.matrix);
+    c.morton.set_layout(gl::Matrix::Layout::Morton);
+    c.octree = gl::matrix_to_octree(c.matrix);
+    c.radius = 1;
+    while (c.radius < glm::max(c.matrix.size.x, glm::max(c.matrix.size.y, c.matrix.size.z))) {
+        c.radius *= 2;
+    }
+    c.rays = make_rays(c.matrix, 1 << 16);
+    return c;
+}
+
+static std::vector<Case> make_cases(const std::string& data_folder) {
+    std::vector<std::filesystem::path> paths;
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator(data_folder + "model/", ec)) {
+        if (entry.path().extension() == ".qb") {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Case> cases;
+    for (auto& path : paths) {
+        std::ifstream ifs(path, std::ios::binary);
+        auto result = data::parse_qb(ifs);
+        if (result.is_error()) {
+            std::cerr << "Skipping \"" << path.string() << "\":" << std::endl << result.get_error() << std::endl;
+            continue;
+        }
+        cases.push_back(make_case(path.stem().string(), std::move(result).unwrap()));
+    }
+
+    // Sparse matrices, where most rays cross many empty voxels
+    for (int size : { 64, 255 }) {
+        std::mt19937 random(1234);
+        gl::Matrix matrix;
+        matrix.size = glm::u8vec3(size, size, size);
+        matrix.voxels.resize(size_t(size) * size * size, 0);
+        matrix.palette[1].color = { 255, 255, 255, 255 };
+        for (auto& voxel : matrix.voxels) {
+            voxel = random() % 4096 == 0 ? 1 : 0;
+        }
+        cases.push_back(make_case("sparse_" + std::to_string(size), std::move(matrix)));
+    }
+
+    return cases;
+}
+
+int main(int argc, char** argv) {
+    std::string data_folder = argc > 1 ? argv[1] : "data/";
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+    if (iterations < 1) {
+        std::cerr << "mcc-bench-raycast failed:" << std::endl << "The iteration count must be at least 1" << std::endl;
+        return 1;
+    }
+
+    ThreadPool pool;
+    std::vector<Variant> variants = {
+        { "matrix", [](const Case& c, std::vector<gl::RayHit>& hits) {
+            gl::raycast(c.matrix, c.rays, hits);
+        } },
+        { "matrix_morton", [](const Case& c, std::vector<gl::RayHit>& hits) {
+            gl::raycast(c.morton, c.rays, hits);
+        } },
+        { "octree", [](const Case& c, std::vector<gl::RayHit>& hits) {
+            gl::raycast(c.octree, c.radius, c.rays, hits);
+        } },
+        { "octree_parallel", [&pool](const Case& c, std::vector<gl::RayHit>& hits) {
+            gl::raycast(c.octree, c.radius, c.rays, hits, &pool);
+        } },
+    };
+
+    for (auto& c : make_cases(data_folder)) {
+        std::vector<gl::RayHit> expected;
+        gl::raycast(c.matrix, c.rays, expected);
+
+        for (auto& variant : variants) {
+            std::vector<gl::RayHit> hits;
+            variant.run(c, hits); // Warm up
+
+            // Every structure must hit the same voxels at the same distances
+            for (size_t i = 0; i < hits.size(); ++i) {
+                bool same = hits[i].material == expected[i].material && std::abs(hits[i].distance - expected[i].distance) <= 1e-3f;
+                bench::expect_same("mcc-bench-raycast", same, "Variant \"", variant.name, "\" differs from the matrix on ray ", i, " of \"", c.name, "\"");
+            }
+
+            double total_ns = 0.0, min_ns = INFINITY;
+            for (int i = 0; i < iterations; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                variant.run(c, hits);
+                auto end = std::chrono::steady_clock::now();
+
+                double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+                total_ns += ns;
+                min_ns = std::min(min_ns, ns);
+            }
+
+            size_t steps = 0, hit_count = 0;
+            for (auto& hit : hits) {
+                steps += hit.steps;
+                hit_count += hit.material != 0 ? 1 : 0;
+            }
+
+            auto& sz = c.matrix.size;
+            double ray_count = double(c.rays.size());
+            std::cout << "{\"case\":\"" << c.name << "\""
+                      << ",\"size\":[" << int(sz.x) << "," << int(sz.y) << "," << int(sz.z) << "]"
+                      << ",\"variant\":\"" << variant.name << "\""
+                      << ",\"iterations\":" << iterations
+                      << ",\"rays\":" << c.rays.size()
+                      << ",\"hit_fraction\":" << double(hit_count) / ray_count
+                      << ",\"steps_per_ray\":" << double(steps) / ray_count
+                      << ",\"ns_per_ray\":" << total_ns / iterations / ray_count
+                      << ",\"min_ns_per_ray\":" << min_ns / ray_count
+                      << ",\"steps_per_second\":" << double(steps) / (min_ns * 1e-9)
+                      << "}" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -8,28 +8,55 @@
 using namespace mcc;
 using namespace mcc::data;
 
-Model::Model(Model&& rhs) : mesh(std::move(rhs.mesh)) {
+Model::Model(Model&& rhs) :
+    bricks(std::move(rhs.bricks)),
+    lods(std::move(rhs.lods)),
+    lod_thresholds(std::move(rhs.lod_thresholds)),
+    quad_mesh(std::move(rhs.quad_mesh)),
+    size(rhs.size),
+    bounds_center(rhs.bounds_center),
+    bounds_radius(rhs.bounds_radius) {
 
 }
 
-const gl::Matrix& mcc::data::Model::get_matrix() const {
-    return this->matrix;
+const gl::Mesh& Model::get_mesh() const {
+    return this->lods[0];
 }
 
-const gl::Mesh& Model::get_mesh() const {
-    return this->mesh;
+const gl::Mesh& Model::get_mesh(const ui::Camera& camera, const glm::mat4& transform) const {
+    return this->lods[this->select_lod(camera, transform)];
 }
 
-Model::Loader::Loader(const Config& config) : config(config) {
+int mcc::data::Model::select_lod(const ui::Camera& camera, const glm::mat4& transform) const {
+    auto center = glm::vec3(transform * glm::vec4(this->bounds_center, 1.0f));
+    float distance = glm::max(glm::length(center - camera.get_position()), camera.get_z_near());
+    float coverage = this->bounds_radius / (distance * glm::tan(camera.get_fov() * 0.5f));
 
+    int lod = 0;
+    while (lod + 1 < int(this->lods.size()) && coverage < this->lod_thresholds[lod]) {
+        lod += 1;
+    }
+    return lod;
+}
+
+Model::Loader::Loader(const Config& config, ThreadPool* pool) : config(config), pool(pool) {
+    this->bake_ao = config["renderer.baked_ao"].unwrap().as_integer().unwrap() != 0;
+    this->vertex_pulling = config["renderer.vertex_pulling"].unwrap().as_integer().unwrap() != 0;
 }
 
 Result<void, std::string> mcc::data::Model::Loader::load(int id) {
     auto& entry = this->get_entry(id);
 
-    std::string path = this->config["data.folder"].unwrap().as_string() +
-                       entry.arguments.substr(0, entry.arguments.find(' '));
-    float scale = std::stof(entry.arguments.substr(entry.arguments.find(' ') + 1));
+    std::stringstream args(entry.arguments);
+    std::string path;
+    float scale = 1.0f;
+    args >> path >> scale;
+    path = this->config["data.folder"].unwrap().as_string() + path;
+
+    std::vector<float> lod_thresholds;
+    for (float threshold; args >> threshold;) {
+        lod_thresholds.push_back(threshold);
+    }
     
     if (this->models.size() <= id) {
         this->models.resize(id + 1, nullptr);
@@ -44,7 +71,7 @@ Result<void, std::string> mcc::data::Model::Loader::load(int id) {
     }
 
     this->models[id] = new Model();
-    auto result = parse_qb(ifs);
+    auto result = parse_qb_bricks(ifs);
     if (result.is_error()) {
         std::stringstream ss;
         ss << "mcc::data::Model::Loader::load() failed:" << std::endl;
@@ -52,9 +79,45 @@ Result<void, std::string> mcc::data::Model::Loader::load(int id) {
         ss << result.get_error();
         return Result<void, std::string>::error(ss.str());
     }
-    this->models[id]->matrix = std::move(result.unwrap());
+    auto& model = *this->models[id];
+    model.bricks = std::move(result).unwrap();
+    model.lod_thresholds = std::move(lod_thresholds);
 
-    this->models[id]->mesh.update(this->models[id]->matrix, scale);
+    model.size = glm::vec3(model.bricks.size) * scale;
+    model.bounds_center = model.size * 0.5f;
+    model.bounds_radius = glm::length(model.size) * 0.5f;
+
+    auto& sz = model.bricks.size;
+    model.lods.resize(1);
+    if (glm::max(sz.x, glm::max(sz.y, sz.z)) <= 255) {
+        // Small enough to be meshed as a single matrix
+        gl::Matrix matrix;
+        model.bricks.extract({ 0, 0, 0 }, glm::u8vec3(sz), matrix);
+        model.lods[0].update(matrix, scale, true, this->bake_ao, this->pool);
+        if (this->vertex_pulling) {
+            model.quad_mesh.update(matrix, scale, true, this->bake_ao, this->pool);
+        }
+    } else {
+        gl::MeshData data;
+        gl::mesh_brick_map(model.bricks, scale, this->bake_ao, data, this->pool);
+        model.lods[0].update(data);
+    }
+
+    // Coarser levels are meshed from the octree, stopping one level higher each time
+    if (!model.lod_thresholds.empty()) {
+        auto octree = gl::brick_map_to_octree(model.bricks);
+
+        int radius = 1, depth = 0;
+        while (radius < int(glm::max(sz.x, glm::max(sz.y, sz.z)))) {
+            radius *= 2;
+            depth += 1;
+        }
+
+        for (int lod = 1; lod <= int(model.lod_thresholds.size()) && lod <= depth; ++lod) {
+            model.lods.emplace_back();
+            model.lods.back().update(octree, float(radius) * scale, depth - lod);
+        }
+    }
 
     entry.ready = true;
     return Result<void, std::string>::success();
@@ -5,15 +5,23 @@
 #include <mcc/result.hpp>
 #include <mcc/data/loader.hpp>
 #include <mcc/gl/mesh.hpp>
+#include <mcc/gl/quad_mesh.hpp>
 #include <mcc/config.hpp>
+#include <mcc/thread_pool.hpp>
+#include <mcc/ui/camera.hpp>
 
 namespace mcc::data {
     // Stores multiple meshes and their voxel data contained in a single .vox file.
+    // Besides the full resolution mesh, coarser levels of detail are meshed from an octree of the voxels.
+    // The voxels are stored on a brick map, so models may be larger than 255 voxels per axis.
     class Model final {
     public:
+        // Arguments: path scale [lod_1 lod_2 ...]
+        // Each lod_i is the fraction of the screen height below which LOD i is drawn instead of LOD i - 1.
         class Loader final : public data::Loader {
         public:
-            Loader(const Config& config);
+            // The thread pool, if not null, is used to mesh the models in parallel.
+            Loader(const Config& config, ThreadPool* pool = nullptr);
 
             inline const Model* get(int id) { return this->models[id]; }
             virtual Result<void, std::string> load(int id) final;
@@ -21,6 +29,9 @@ namespace mcc::data {
 
         private:
             const Config& config;
+            ThreadPool* pool;
+            bool bake_ao;
+            bool vertex_pulling;
 
             std::vector<Model*> models;
         };
@@ -28,14 +39,34 @@ namespace mcc::data {
         Model(Model&& rhs);
         ~Model() = default;
                
-        const gl::Matrix& get_matrix() const;
+        inline const gl::BrickMap& get_brick_map() const { return this->bricks; }
+        // Size of the model in world units, spanning from its origin along the positive axes
+        inline glm::vec3 get_size() const { return this->size; }
+        // Returns the full resolution mesh.
         const gl::Mesh& get_mesh() const;
+        // Returns the mesh of the level of detail which fits the model's size on screen, when drawn with a transform.
+        const gl::Mesh& get_mesh(const ui::Camera& camera, const glm::mat4& transform) const;
+
+        // Picks the level of detail from the fraction of the screen height covered by the model's bounding sphere.
+        // The transform is expected not to scale the model.
+        int select_lod(const ui::Camera& camera, const glm::mat4& transform) const;
+        inline int get_lod_count() const { return int(this->lods.size()); }
+        inline const gl::Mesh& get_lod(int lod) const { return this->lods[lod]; }
+
+        // Full resolution mesh as packed quads, only generated if renderer.vertex_pulling is enabled and the model
+        // fits in a gl::Matrix (255 voxels per axis).
+        inline const gl::QuadMesh& get_quad_mesh() const { return this->quad_mesh; }
         
     private:
 
         Model() = default;
 
-        gl::Matrix matrix;
-        gl::Mesh mesh;
+        gl::BrickMap bricks;
+        std::vector<gl::Mesh> lods; // The first level has full resolution, each following level has half of it
+        std::vector<float> lod_thresholds;
+        gl::QuadMesh quad_mesh;
+        glm::vec3 size;
+        glm::vec3 bounds_center;
+        float bounds_radius = 0.0f;
     };
 }
\ No newline at end of file
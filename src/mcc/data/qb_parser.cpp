@@ -6,106 +6,187 @@
 using namespace mcc;
 using namespace mcc::data;
 
-Result<gl::Matrix, std::string> mcc::data::parse_qb(std::ifstream& ifs) {
-    uint8_t version[4];
-    uint32_t color_format, z_axis_orientation, compressed, visibility_mask_encoded, num_matrices;
+namespace {
+    struct Header {
+        uint32_t color_format, compressed;
+        uint32_t size_x, size_y, size_z;
+    };
 
-    // Parse file header
-    ifs.read((char*)version, 4);
-    if (version[0] != 1 || version[1] != 1 || version[2] != 0 || version[3] != 0) {
-        return Result<gl::Matrix, std::string>::error(
-            "Unsupported QB file format version"
-        );
-    }
-    ifs.read((char*)&color_format, 4);
-    color_format = memory::from_big_endian(color_format);
-    ifs.read((char*)&z_axis_orientation, 4);
-    z_axis_orientation = memory::from_big_endian(z_axis_orientation);
-    ifs.read((char*)&compressed, 4);
-    compressed = memory::from_big_endian(compressed);
-    ifs.read((char*)&visibility_mask_encoded, 4);
-    visibility_mask_encoded = memory::from_big_endian(visibility_mask_encoded);
-    ifs.read((char*)&num_matrices, 4);
-    num_matrices = memory::from_big_endian(num_matrices);
-
-    if (num_matrices != 1) {
-        return Result<gl::Matrix, std::string>::error(
-            "Unsupported QB file, each file must have exactly one matrix"
-        );
-    }
+    // Parses the file header and the header of its only matrix
+    Result<Header, std::string> read_header(std::ifstream& ifs) {
+        uint8_t version[4];
+        uint32_t color_format, z_axis_orientation, compressed, visibility_mask_encoded, num_matrices;
 
-    // Read matrix name
-    uint8_t name_length;
-    ifs.read((char*)&name_length, 1);
-    auto name = std::string(name_length, ' ');
-    ifs.read(&name[0], name_length);
-
-    // Read matrix size and position
-    uint32_t size_x, size_y, size_z, pos_x, pos_y, pos_z;
-    ifs.read((char*)&size_x, 4);
-    size_x = memory::from_big_endian(size_x);
-    ifs.read((char*)&size_y, 4);
-    size_y = memory::from_big_endian(size_y);
-    ifs.read((char*)&size_z, 4);
-    size_z = memory::from_big_endian(size_z);
-    ifs.read((char*)&pos_x, 4);
-    pos_x = memory::from_big_endian(pos_x);
-    ifs.read((char*)&pos_y, 4);
-    pos_y = memory::from_big_endian(pos_y);
-    ifs.read((char*)&pos_z, 4);
-    pos_z = memory::from_big_endian(pos_z);
+        // Parse file header
+        ifs.read((char*)version, 4);
+        if (version[0] != 1 || version[1] != 1 || version[2] != 0 || version[3] != 0) {
+            return Result<Header, std::string>::error(
+                "Unsupported QB file format version"
+            );
+        }
+        ifs.read((char*)&color_format, 4);
+        color_format = memory::from_big_endian(color_format);
+        ifs.read((char*)&z_axis_orientation, 4);
+        z_axis_orientation = memory::from_big_endian(z_axis_orientation);
+        ifs.read((char*)&compressed, 4);
+        compressed = memory::from_big_endian(compressed);
+        ifs.read((char*)&visibility_mask_encoded, 4);
+        visibility_mask_encoded = memory::from_big_endian(visibility_mask_encoded);
+        ifs.read((char*)&num_matrices, 4);
+        num_matrices = memory::from_big_endian(num_matrices);
 
-    // Read matrix data
-    gl::Matrix matrix;
-    matrix.size = { size_x, size_y, size_z };
-    int mat_count = 1;
-    matrix.voxels.resize(size_x * size_y * size_z, 0);
-    if (compressed == 0) { // If uncompressed
-        uint8_t color[4];
-        for (auto z = 0u; z < size_z; ++z) {
-            for (auto y = 0u; y < size_y; ++y) {
-                for (auto x = 0u; x < size_x; ++x) {
-                    ifs.read((char*)color, 4);
-                    if (color[3] == 0) {
-                        continue;
-                    }
+        if (num_matrices != 1) {
+            return Result<Header, std::string>::error(
+                "Unsupported QB file, each file must have exactly one matrix"
+            );
+        }
 
-                    if (color_format) {
-                        std::swap(color[0], color[2]);
-                    }
+        // Read matrix name
+        uint8_t name_length;
+        ifs.read((char*)&name_length, 1);
+        auto name = std::string(name_length, ' ');
+        ifs.read(&name[0], name_length);
 
-                    int mat_id = 1;
+        // Read matrix size and position
+        uint32_t size_x, size_y, size_z, pos_x, pos_y, pos_z;
+        ifs.read((char*)&size_x, 4);
+        size_x = memory::from_big_endian(size_x);
+        ifs.read((char*)&size_y, 4);
+        size_y = memory::from_big_endian(size_y);
+        ifs.read((char*)&size_z, 4);
+        size_z = memory::from_big_endian(size_z);
+        ifs.read((char*)&pos_x, 4);
+        pos_x = memory::from_big_endian(pos_x);
+        ifs.read((char*)&pos_y, 4);
+        pos_y = memory::from_big_endian(pos_y);
+        ifs.read((char*)&pos_z, 4);
+        pos_z = memory::from_big_endian(pos_z);
 
-                    for (; mat_id < mat_count; ++mat_id) {
-                        if (matrix.palette[mat_id].color.r == color[0] &&
-                            matrix.palette[mat_id].color.g == color[1] &&
-                            matrix.palette[mat_id].color.b == color[2]) {
-                            break;
+        if (!ifs) {
+            return Result<Header, std::string>::error(
+                "Unexpected end of QB file"
+            );
+        }
+
+        return Result<Header, std::string>::success({ color_format, compressed, size_x, size_y, size_z });
+    }
+
+    // Reads the matrix data, filling the palette and calling set(x, y, z, material) for every non-empty voxel
+    template <typename F>
+    Result<void, std::string> read_voxels(std::ifstream& ifs, const Header& header, gl::Material* palette, F&& set) {
+        int mat_count = 1;
+        if (header.compressed == 0) { // If uncompressed
+            uint8_t color[4];
+            for (auto z = 0u; z < header.size_z; ++z) {
+                for (auto y = 0u; y < header.size_y; ++y) {
+                    for (auto x = 0u; x < header.size_x; ++x) {
+                        ifs.read((char*)color, 4);
+                        if (color[3] == 0) {
+                            continue;
                         }
-                    }
 
-                    if (mat_id == mat_count) {
-                        ++mat_count;
-                        if (mat_count > 256) {
-                            return Result<gl::Matrix, std::string>::error(
-                                "Unsupported QB file, too many voxel colors (palette is full)"
-                            );
+                        if (header.color_format) {
+                            std::swap(color[0], color[2]);
                         }
 
-                        matrix.palette[mat_id].color.r = color[0];
-                        matrix.palette[mat_id].color.g = color[1];
-                        matrix.palette[mat_id].color.b = color[2];
-                        matrix.palette[mat_id].color.a = 255;
-                    }
+                        int mat_id = 1;
 
-                    matrix.voxels[x * size_y * size_z + y * size_z + z] = mat_id;
+                        for (; mat_id < mat_count; ++mat_id) {
+                            if (palette[mat_id].color.r == color[0] &&
+                                palette[mat_id].color.g == color[1] &&
+                                palette[mat_id].color.b == color[2]) {
+                                break;
+                            }
+                        }
+
+                        if (mat_id == mat_count) {
+                            ++mat_count;
+                            if (mat_count > 256) {
+                                return Result<void, std::string>::error(
+                                    "Unsupported QB file, too many voxel colors (palette is full)"
+                                );
+                            }
+
+                            palette[mat_id].color.r = color[0];
+                            palette[mat_id].color.g = color[1];
+                            palette[mat_id].color.b = color[2];
+                            palette[mat_id].color.a = 255;
+                        }
+
+                        set(x, y, z, (unsigned char)mat_id);
+                    }
                 }
             }
         }
+        else { // If compressed
+            // TO DO
+        }
+
+        return Result<void, std::string>::success();
     }
-    else { // If compressed
-        // TO DO
+}
+
+Result<gl::Matrix, std::string> mcc::data::parse_qb(std::ifstream& ifs) {
+    auto header_result = read_header(ifs);
+    if (header_result.is_error()) {
+        return Result<gl::Matrix, std::string>::error(header_result.get_error());
+    }
+    auto header = std::move(header_result).unwrap();
+
+    if (header.size_x > 255 || header.size_y > 255 || header.size_z > 255) {
+        return Result<gl::Matrix, std::string>::error(
+            "Unsupported QB file, matrices are limited to 255 voxels per axis (use parse_qb_bricks())"
+        );
+    }
+
+    // Read matrix data
+    gl::Matrix matrix;
+    matrix.size = { header.size_x, header.size_y, header.size_z };
+    matrix.voxels.resize(matrix.get_voxel_count(), 0);
+    auto result = read_voxels(ifs, header, matrix.palette, [&](uint32_t x, uint32_t y, uint32_t z, unsigned char mat_id) {
+        matrix.voxels[matrix.get_index(x, y, z)] = mat_id;
+    });
+    if (result.is_error()) {
+        return Result<gl::Matrix, std::string>::error(result.get_error());
     }
 
     return Result<gl::Matrix, std::string>::success(std::move(matrix));
 }
+
+Result<gl::BrickMap, std::string> mcc::data::parse_qb_bricks(std::ifstream& ifs) {
+    auto header_result = read_header(ifs);
+    if (header_result.is_error()) {
+        return Result<gl::BrickMap, std::string>::error(header_result.get_error());
+    }
+    auto header = std::move(header_result).unwrap();
+
+    if (header.size_x > gl::BrickMap::max_size || header.size_y > gl::BrickMap::max_size || header.size_z > gl::BrickMap::max_size) {
+        return Result<gl::BrickMap, std::string>::error(
+            "Unsupported QB file, brick maps are limited to " + std::to_string(gl::BrickMap::max_size) + " voxels per axis"
+        );
+    }
+
+    // Catch corrupt sizes before allocating the brick table, as uncompressed files store 4 bytes per voxel
+    if (header.compressed == 0) {
+        auto start = ifs.tellg();
+        ifs.seekg(0, std::ios::end);
+        auto remaining = uint64_t(ifs.tellg() - start);
+        ifs.seekg(start);
+        if (uint64_t(header.size_x) * header.size_y * header.size_z * 4 > remaining) {
+            return Result<gl::BrickMap, std::string>::error(
+                "Unexpected end of QB file, the matrix is smaller than its size"
+            );
+        }
+    }
+
+    gl::BrickMap map;
+    map.resize({ header.size_x, header.size_y, header.size_z });
+    auto result = read_voxels(ifs, header, map.palette, [&](uint32_t x, uint32_t y, uint32_t z, unsigned char mat_id) {
+        map.set(int(x), int(y), int(z), mat_id);
+    });
+    if (result.is_error()) {
+        return Result<gl::BrickMap, std::string>::error(result.get_error());
+    }
+
+    return Result<gl::BrickMap, std::string>::success(std::move(map));
+}
@@ -4,5 +4,8 @@
 #include <mcc/gl/voxel.hpp>
 
 namespace mcc::data {
+    // Fails on matrices larger than 255 voxels on any axis.
     Result<gl::Matrix, std::string> parse_qb(std::ifstream& ifs);
+    // Supports matrices up to gl::BrickMap::max_size voxels per axis, storing only their non-empty bricks.
+    Result<gl::BrickMap, std::string> parse_qb_bricks(std::ifstream& ifs);
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <mcc/entity/bounding_box.hpp>
+
+#include <cmath>
+
+using namespace mcc;
+using namespace mcc::entity;
+
+namespace {
+    // Faces closer than this to a voxel boundary (in voxels) are considered to be on it, so that a box moved to the time of
+    // impact of a sweep doesn't overlap the voxel it hit because of rounding errors
+    const float boundary_epsilon = 1e-4f;
+
+    // First and last layers overlapped by an interval
+    inline int first_layer(float low) {
+        return int(std::floor(low + boundary_epsilon));
+    }
+
+    inline int last_layer(float high) {
+        return int(std::ceil(high - boundary_epsilon)) - 1;
+    }
+}
+
+BoundingBox::BoundingBox(glm::f32vec3 low, glm::f32vec3 high) :
+    low(low), high(high) {
+
+}
+
+bool BoundingBox::intersects(const BoundingBox& rhs) const {
+    for (int i = 0; i < 3; ++i) {
+        if (this->high[i] <= rhs.low[i] || rhs.high[i] <= this->low[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BoundingBox::sweep(const gl::Occupancy& occupancy, glm::f32vec3 motion, Contact& contact) const {
+    contact = Contact();
+
+    // Walk the layers entered by the leading faces of the box, in the order they are entered.
+    // lead[i] is the last layer entered on axis i, and t_next[i] the time at which the next one is entered.
+    glm::ivec3 lead;
+    glm::f32vec3 t_next;
+    for (int i = 0; i < 3; ++i) {
+        if (motion[i] > 0.0f) {
+            lead[i] = last_layer(this->high[i]);
+            t_next[i] = (float(lead[i] + 1) - this->high[i]) / motion[i];
+        } else if (motion[i] < 0.0f) {
+            lead[i] = first_layer(this->low[i]);
+            t_next[i] = (float(lead[i]) - this->low[i]) / motion[i];
+        } else {
+            lead[i] = 0;
+            t_next[i] = INFINITY;
+        }
+    }
+
+    for (;;) {
+        // Ties are broken towards the first axis. The layers entered at the same time are still tested one after another,
+        // and each test covers the layers entered before it, so the voxels on the diagonals aren't skipped.
+        int a = t_next.x <= t_next.y ? (t_next.x <= t_next.z ? 0 : 2) : (t_next.y <= t_next.z ? 1 : 2);
+        float t = t_next[a];
+        if (t > 1.0f) {
+            return false;
+        }
+
+        int step = motion[a] > 0.0f ? 1 : -1;
+        lead[a] += step;
+
+        // Layers covered by the box at time t. On the moving axes, these end at the last layer entered.
+        glm::ivec3 min, max;
+        for (int i = 0; i < 3; ++i) {
+            if (i == a) {
+                min[i] = lead[i];
+                max[i] = lead[i] + 1;
+            } else if (motion[i] > 0.0f) {
+                min[i] = first_layer(this->low[i] + motion[i] * t);
+                max[i] = lead[i] + 1;
+            } else if (motion[i] < 0.0f) {
+                min[i] = lead[i];
+                max[i] = last_layer(this->high[i] + motion[i] * t) + 1;
+            } else {
+                min[i] = first_layer(this->low[i]);
+                max[i] = last_layer(this->high[i]) + 1;
+            }
+        }
+
+        if (occupancy.find(min, max, contact.voxel)) {
+            contact.time = glm::max(t, 0.0f);
+            contact.normal[a] = -step;
+            return true;
+        }
+
+        // Stop once the box has left the grid on this axis, since no other layer can be hit
+        if ((step > 0 && lead[a] >= occupancy.size[a] - 1) || (step < 0 && lead[a] <= 0)) {
+            t_next[a] = INFINITY;
+        } else {
+            t_next[a] = (step > 0 ? float(lead[a] + 1) - this->high[a] : float(lead[a]) - this->low[a]) / motion[a];
+        }
+    }
+}
+
+void mcc::entity::sweep(
+    const gl::Occupancy& occupancy,
+    const std::vector<BoundingBox>& boxes,
+    const std::vector<glm::f32vec3>& motions,
+    std::vector<Contact>& contacts,
+    ThreadPool* pool
+) {
+    const size_t boxes_per_task = 256;
+
+    contacts.resize(boxes.size());
+    ThreadPool::parallel_for_range(pool, boxes.size(), boxes_per_task, [&](size_t begin, size_t end) {
+        for (size_t j = begin; j < end; ++j) {
+            boxes[j].sweep(occupancy, motions[j], contacts[j]);
+        }
+    });
+}
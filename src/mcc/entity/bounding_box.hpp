@@ -1,20 +1,78 @@
 #pragma once
 
+#include <vector>
 #include <glm/glm.hpp>
 
+#include <mcc/gl/voxel.hpp>
+#include <mcc/thread_pool.hpp>
+
 namespace mcc::entity {
+    // Result of sweeping a box along a motion
+    struct Contact {
+        float time = 1.0f;                 // Fraction of the motion done before the hit (1 = nothing was hit)
+        glm::ivec3 normal = { 0, 0, 0 };  // Normal of the voxel face which was hit, zero if nothing was hit
+        glm::ivec3 voxel = { 0, 0, 0 };   // Voxel which was hit
+    };
+
     // Holds an axis aligned bounding box
     class BoundingBox final {
     public:
         BoundingBox(glm::f32vec3 low, glm::f32vec3 high);
         ~BoundingBox() = default;
 
-        // TO DO
+        inline BoundingBox translate(glm::f32vec3 offset) const { return BoundingBox(this->low + offset, this->high + offset); }
+        // Touching boxes don't intersect
+        bool intersects(const BoundingBox& rhs) const;
+
+        // Sweeps the box along a motion through the non-empty voxels of an occupancy grid, where voxel (x, y, z) spans
+        // [x, x + 1) on each axis. Returns true if a voxel is hit, with the time of impact and the normal of the face hit.
+        // The voxels which the box already overlaps are ignored, so that boxes resting on a surface can leave it.
+        // Only the layers of voxels entered by the box are tested, so the cost is proportional to the voxels swept.
+        bool sweep(const gl::Occupancy& occupancy, glm::f32vec3 motion, Contact& contact) const;
 
         inline glm::f32vec3 get_low() const { return this->low; }
         inline glm::f32vec3 get_high() const { return this->high; }
+        inline glm::f32vec3 get_size() const { return this->high - this->low; }
 
     private:
         glm::f32vec3 low, high;
     };
-}
\ No newline at end of file
+
+    // Batched version of BoundingBox::sweep(), with a motion and a contact per box. If a thread pool is passed, the boxes are
+    // split between its threads.
+    void sweep(
+        const gl::Occupancy& occupancy,
+        const std::vector<BoundingBox>& boxes,
+        const std::vector<glm::f32vec3>& motions,
+        std::vector<Contact>& contacts,
+        ThreadPool* pool = nullptr
+    );
+
+    // Moves a box by a motion, stopping at the surfaces found by sweep(box, motion, contact) and sliding along them.
+    // Each contact cancels the motion along its normal, so at most three sweeps are done. Returns the motion done, and
+    // adds the normals of the surfaces hit to normals (e.g. normals.y > 0 when the box lands on the ground).
+    template <typename F>
+    glm::f32vec3 slide(BoundingBox& box, glm::f32vec3 motion, glm::ivec3& normals, F&& sweep) {
+        glm::f32vec3 done = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 3 && motion != glm::f32vec3(0.0f); ++i) {
+            Contact contact;
+            if (!sweep(box, motion, contact)) {
+                box = box.translate(motion);
+                return done + motion;
+            }
+
+            auto step = motion * contact.time;
+            box = box.translate(step);
+            done += step;
+            normals += contact.normal;
+
+            motion -= step;
+            for (int a = 0; a < 3; ++a) {
+                if (contact.normal[a] != 0) {
+                    motion[a] = 0.0f;
+                }
+            }
+        }
+        return done;
+    }
+}
@@ -1,9 +1,252 @@
 #include <mcc/entity/entity.hpp>
 
+#include <algorithm>
+
 using namespace mcc;
 using namespace mcc::entity;
 
-Entity::Entity(glm::i64vec3 chunk_pos, glm::f32vec3 pos) :
-    chunk_pos(chunk_pos), pos(pos) {
-    
+Handle Registry::create(Signature signature, glm::i64vec3 chunk_pos, glm::f32vec3 pos) {
+    Handle handle;
+    if (this->free_slots.empty()) {
+        handle.index = uint32_t(this->slots.size());
+        handle.generation = 1;
+        this->slots.push_back({ handle.generation, free_archetype, 0 });
+    } else {
+        handle.index = this->free_slots.back();
+        handle.generation = this->slots[handle.index].generation;
+        this->free_slots.pop_back();
+    }
+
+    auto archetype = this->get_archetype(signature);
+    auto row = this->push(archetype, handle);
+    this->archetypes[archetype].chunk_pos[row] = chunk_pos;
+    this->archetypes[archetype].pos[row] = pos;
+    this->archetypes[archetype].prev_pos[row] = pos;
+    this->slots[handle.index].archetype = archetype;
+    this->slots[handle.index].row = row;
+    return handle;
+}
+
+std::pair<Archetype*, size_t> Registry::create_many(Signature signature, glm::i64vec3 chunk_pos, size_t count, std::vector<Handle>* handles) {
+    auto archetype = this->get_archetype(signature);
+    auto& a = this->archetypes[archetype];
+    auto first = a.size();
+    a.chunk_pos.resize(first + count, chunk_pos);
+    a.pos.resize(first + count, { 0.0f, 0.0f, 0.0f });
+    a.prev_pos.resize(first + count, { 0.0f, 0.0f, 0.0f });
+    if (signature & Velocity) {
+        a.velocity.resize(first + count, { 0.0f, 0.0f, 0.0f });
+    }
+    if (signature & Bounds) {
+        a.bounds.resize(first + count, BoundingBox({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }));
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        Handle handle;
+        if (this->free_slots.empty()) {
+            handle.index = uint32_t(this->slots.size());
+            handle.generation = 1;
+            this->slots.push_back({ handle.generation, free_archetype, 0 });
+        } else {
+            handle.index = this->free_slots.back();
+            handle.generation = this->slots[handle.index].generation;
+            this->free_slots.pop_back();
+        }
+
+        this->slots[handle.index].archetype = archetype;
+        this->slots[handle.index].row = uint32_t(first + i);
+        a.handles.push_back(handle);
+        if (handles != nullptr) {
+            handles->push_back(handle);
+        }
+    }
+
+    return { &a, first };
+}
+
+void Registry::destroy(Handle handle) {
+    if (!this->is_alive(handle)) {
+        return;
+    }
+
+    auto& slot = this->slots[handle.index];
+    this->erase(slot.archetype, slot.row);
+
+    // Skip generation 0 when wrapping around, so that the slot never matches the null handle
+    slot.generation = slot.generation + 1 == 0 ? 1 : slot.generation + 1;
+    slot.archetype = free_archetype;
+    this->free_slots.push_back(handle.index);
+}
+
+bool Registry::is_alive(Handle handle) const {
+    return handle.generation != 0 && handle.index < this->slots.size() &&
+           this->slots[handle.index].generation == handle.generation &&
+           this->slots[handle.index].archetype != free_archetype;
+}
+
+void Registry::set_signature(Handle handle, Signature signature) {
+    auto& slot = this->slots[handle.index];
+    auto from = slot.archetype;
+    auto to = this->get_archetype(signature);
+    if (from == to) {
+        return;
+    }
+
+    // Copy the shared components to the new archetype before removing the entity from the old one
+    auto old_row = slot.row;
+    auto row = this->push(to, handle);
+    auto& a = this->archetypes[from];
+    auto& b = this->archetypes[to];
+    b.chunk_pos[row] = a.chunk_pos[old_row];
+    b.pos[row] = a.pos[old_row];
+    b.prev_pos[row] = a.prev_pos[old_row];
+    if (a.signature & b.signature & Velocity) {
+        b.velocity[row] = a.velocity[old_row];
+    }
+    if (a.signature & b.signature & Bounds) {
+        b.bounds[row] = a.bounds[old_row];
+    }
+
+    this->erase(from, old_row);
+    slot.archetype = to;
+    slot.row = row;
+}
+
+Signature Registry::get_signature(Handle handle) const {
+    return this->archetypes[this->slots[handle.index].archetype].signature;
+}
+
+uint32_t Registry::get_archetype(Signature signature) {
+    // There are only a few archetypes, so a linear search is faster than a map
+    for (size_t i = 0; i < this->archetypes.size(); ++i) {
+        if (this->archetypes[i].signature == signature) {
+            return uint32_t(i);
+        }
+    }
+
+    this->archetypes.emplace_back();
+    this->archetypes.back().signature = signature;
+    return uint32_t(this->archetypes.size() - 1);
+}
+
+uint32_t Registry::push(uint32_t archetype, Handle handle) {
+    auto& a = this->archetypes[archetype];
+    a.chunk_pos.push_back({ 0, 0, 0 });
+    a.pos.push_back({ 0.0f, 0.0f, 0.0f });
+    a.prev_pos.push_back({ 0.0f, 0.0f, 0.0f });
+    if (a.signature & Velocity) {
+        a.velocity.push_back({ 0.0f, 0.0f, 0.0f });
+    }
+    if (a.signature & Bounds) {
+        a.bounds.push_back(BoundingBox({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }));
+    }
+    a.handles.push_back(handle);
+    return uint32_t(a.handles.size() - 1);
+}
+
+void Registry::erase(uint32_t archetype, uint32_t row) {
+    auto& a = this->archetypes[archetype];
+    auto last = uint32_t(a.handles.size() - 1);
+    if (row != last) {
+        a.chunk_pos[row] = a.chunk_pos[last];
+        a.pos[row] = a.pos[last];
+        a.prev_pos[row] = a.prev_pos[last];
+        if (a.signature & Velocity) {
+            a.velocity[row] = a.velocity[last];
+        }
+        if (a.signature & Bounds) {
+            a.bounds[row] = a.bounds[last];
+        }
+        a.handles[row] = a.handles[last];
+        this->slots[a.handles[row].index].row = row;
+    }
+
+    a.chunk_pos.pop_back();
+    a.pos.pop_back();
+    a.prev_pos.pop_back();
+    if (a.signature & Velocity) {
+        a.velocity.pop_back();
+    }
+    if (a.signature & Bounds) {
+        a.bounds.pop_back();
+    }
+    a.handles.pop_back();
+}
+
+void Registry::sort() {
+    std::vector<uint32_t> order;
+    for (auto& a : this->archetypes) {
+        auto by_index = [&](uint32_t lhs, uint32_t rhs) { return a.handles[lhs].index < a.handles[rhs].index; };
+        order.resize(a.size());
+        for (uint32_t i = 0; i < a.size(); ++i) {
+            order[i] = i;
+        }
+        if (std::is_sorted(order.begin(), order.end(), by_index)) {
+            continue;
+        }
+        std::sort(order.begin(), order.end(), by_index);
+
+        auto permute = [&](auto& array) {
+            if (!array.empty()) {
+                auto copy = array;
+                for (size_t i = 0; i < order.size(); ++i) {
+                    array[i] = copy[order[i]];
+                }
+            }
+        };
+        permute(a.chunk_pos);
+        permute(a.pos);
+        permute(a.prev_pos);
+        permute(a.velocity);
+        permute(a.bounds);
+        permute(a.handles);
+
+        for (uint32_t i = 0; i < a.size(); ++i) {
+            this->slots[a.handles[i].index].row = i;
+        }
+    }
+}
+
+void mcc::entity::for_each_batch(
+    Registry& registry,
+    Signature required,
+    size_t batch_size,
+    const std::function<void(Archetype& archetype, size_t begin, size_t end)>& func,
+    ThreadPool* pool
+) {
+    struct Batch {
+        Archetype* archetype;
+        size_t begin, end;
+    };
+
+    std::vector<Batch> batches;
+    registry.each(required, [&](Archetype& archetype) {
+        for (size_t begin = 0; begin < archetype.size(); begin += batch_size) {
+            batches.push_back({ &archetype, begin, glm::min(begin + batch_size, archetype.size()) });
+        }
+    });
+
+    ThreadPool::parallel_for_range(pool, batches.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            func(*batches[i].archetype, batches[i].begin, batches[i].end);
+        }
+    });
+}
+
+void mcc::entity::integrate(Registry& registry, float dt, float chunk_extent, ThreadPool* pool) {
+    // Number of entities moved by each task
+    const size_t entities_per_task = 4096;
+
+    for_each_batch(registry, Velocity, entities_per_task, [&](Archetype& a, size_t begin, size_t end) {
+        for (size_t j = begin; j < end; ++j) {
+            auto pos = a.pos[j] + a.velocity[j] * dt;
+            auto shift = glm::floor(pos / chunk_extent);
+            if (shift != glm::f32vec3(0.0f)) {
+                a.chunk_pos[j] += glm::i64vec3(shift);
+                pos -= shift * chunk_extent;
+                a.prev_pos[j] -= shift * chunk_extent;
+            }
+            a.pos[j] = pos;
+        }
+    }, pool);
 }
@@ -1,41 +1,132 @@
 #pragma once
 
 #include <cstdint>
-#include <fstream>
+#include <functional>
+#include <utility>
+#include <vector>
 #include <glm/glm.hpp>
 
-namespace mcc::map {
-    class Chunk;
-}
+#include <mcc/entity/bounding_box.hpp>
+#include <mcc/thread_pool.hpp>
 
 namespace mcc::entity {
-    // Entities base class
-    class Entity {
+    // Optional components of an entity, as the bits of a signature. Every entity has a position.
+    enum Component : uint32_t {
+        Velocity = 1 << 0,
+        Bounds = 1 << 1,
+    };
+
+    using Signature = uint32_t;
+
+    // Refers to an entity of a registry. Stays valid while other entities are created and destroyed, and stops referring to
+    // anything once its entity is destroyed, even if the slot is reused, since each reuse bumps the slot's generation.
+    struct Handle {
+        uint32_t index = 0;
+        uint32_t generation = 0; // 0 = null handle
+
+        inline bool operator==(const Handle& rhs) const { return this->index == rhs.index && this->generation == rhs.generation; }
+        inline bool operator!=(const Handle& rhs) const { return !(*this == rhs); }
+    };
+
+    // The entities with the same signature, with each component on its own contiguous array, so that systems walk dense
+    // arrays of only the components they use. The arrays of the components outside of the signature are empty.
+    struct Archetype {
+        Signature signature;
+        std::vector<glm::i64vec3> chunk_pos; // Coordinates of the chunk the entity is present in
+        std::vector<glm::f32vec3> pos;       // Coordinates of the entity inside the chunk
+        std::vector<glm::f32vec3> prev_pos;  // Position at the previous tick, relative to the current chunk, for interpolation
+        std::vector<glm::f32vec3> velocity;  // Per second
+        std::vector<BoundingBox> bounds;     // Relative to pos
+        std::vector<Handle> handles;
+
+        inline size_t size() const { return this->handles.size(); }
+    };
+
+    /*
+        Stores entities grouped by archetype. Destroying an entity moves the last entity of its archetype into its place,
+        so the arrays stay dense, and handles are resolved through a slot table.
+        Not thread safe: systems may run in parallel over the arrays, but entities must only be created, destroyed or
+        changed in signature by one thread at a time, while no system is running.
+    */
+    class Registry final {
     public:
-        Entity(glm::i64vec3 chunk_pos, glm::f32vec3 pos);
-        virtual ~Entity() = default;
+        Registry() = default;
+        Registry(const Registry&) = delete;
+        Registry(Registry&&) = default;
+        ~Registry() = default;
+
+        // The components in the signature other than the position start zeroed.
+        Handle create(Signature signature, glm::i64vec3 chunk_pos, glm::f32vec3 pos);
+        // Creates count entities with the same signature on the same chunk, with zeroed components, and returns the
+        // archetype they were appended to and the row of the first one, so that their components can be filled in bulk.
+        // The handles are appended to handles, if not null.
+        std::pair<Archetype*, size_t> create_many(Signature signature, glm::i64vec3 chunk_pos, size_t count, std::vector<Handle>* handles = nullptr);
+        // Destroying a dead handle does nothing.
+        void destroy(Handle handle);
+        bool is_alive(Handle handle) const;
+
+        // Moves an entity to the archetype of another signature, keeping the components both signatures have.
+        void set_signature(Handle handle, Signature signature);
+        Signature get_signature(Handle handle) const;
+
+        // The references are invalidated by the next structural change (create, destroy or set_signature).
+        // The handle must be alive and have the component accessed.
+        inline glm::i64vec3& get_chunk_position(Handle handle) { auto& s = this->slots[handle.index]; return this->archetypes[s.archetype].chunk_pos[s.row]; }
+        inline glm::f32vec3& get_position(Handle handle) { auto& s = this->slots[handle.index]; return this->archetypes[s.archetype].pos[s.row]; }
+        inline glm::f32vec3& get_previous_position(Handle handle) { auto& s = this->slots[handle.index]; return this->archetypes[s.archetype].prev_pos[s.row]; }
+        inline glm::f32vec3& get_velocity(Handle handle) { auto& s = this->slots[handle.index]; return this->archetypes[s.archetype].velocity[s.row]; }
+        inline BoundingBox& get_bounds(Handle handle) { auto& s = this->slots[handle.index]; return this->archetypes[s.archetype].bounds[s.row]; }
 
-        virtual void update(float dt) = 0;
-        virtual void load(std::istream& in) = 0;
-        virtual void unload(std::ostream& out) = 0;
+        // Calls func(archetype) for every non-empty archetype with all the components in required.
+        // The component arrays may be modified, but no entity may be created or destroyed until it returns.
+        template <typename F>
+        void each(Signature required, F&& func) {
+            for (auto& archetype : this->archetypes) {
+                if ((archetype.signature & required) == required && archetype.size() > 0) {
+                    func(archetype);
+                }
+            }
+        }
 
-        // Returns the coordinates of the chunk the entity is present in
-        inline glm::i64vec3 get_chunk_position() const { return this->chunk_pos; }
-        // Returns the coordinates of the entity inside the chunk
-        inline glm::f32vec3 get_position() const { return this->pos; }
+        // Sorts the entities of each archetype by handle index, so that systems visit them in an order which doesn't
+        // depend on the order in which entities were destroyed.
+        void sort();
 
-        inline Entity* get_prev() { return this->prev; }
-        inline const Entity* get_prev() const { return this->prev;}
-        inline Entity* get_next() { return this->prev; }
-        inline const Entity* get_next() const { return this->prev;}
+        // Number of live entities
+        inline size_t size() const { return this->slots.size() - this->free_slots.size(); }
 
     private:
-        friend map::Chunk;
+        static constexpr uint32_t free_archetype = ~uint32_t(0);
 
-        glm::i64vec3 chunk_pos;
-        glm::f32vec3 pos;
+        struct Slot {
+            uint32_t generation;
+            uint32_t archetype; // free_archetype if the slot is free
+            uint32_t row;
+        };
 
-        Entity* prev;
-        Entity* next;
+        uint32_t get_archetype(Signature signature);
+        // Appends a zeroed entity to an archetype, returning its row
+        uint32_t push(uint32_t archetype, Handle handle);
+        // Removes a row, moving the last entity of the archetype into its place
+        void erase(uint32_t archetype, uint32_t row);
+
+        std::vector<Archetype> archetypes;
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free_slots;
     };
-}
\ No newline at end of file
+
+    // Splits the entities with all the components in required into batches of up to batch_size entities of the same
+    // archetype, and calls func(archetype, begin, end) for each. If a thread pool is passed, the batches are split between
+    // its threads, otherwise they run in order on the calling thread. The batches don't depend on the thread count.
+    void for_each_batch(
+        Registry& registry,
+        Signature required,
+        size_t batch_size,
+        const std::function<void(Archetype& archetype, size_t begin, size_t end)>& func,
+        ThreadPool* pool = nullptr
+    );
+
+    // Moves the entities with a velocity by velocity * dt. Entities leaving their chunk are carried into the chunk they
+    // entered, so that positions stay in [0, chunk_extent). If a thread pool is passed, the entities are split between its threads.
+    void integrate(Registry& registry, float dt, float chunk_extent, ThreadPool* pool = nullptr);
+}
@@ -0,0 +1,303 @@
+#include <mcc/entity/serialization.hpp>
+
+#include <cstring>
+#include <unordered_map>
+
+using namespace mcc;
+using namespace mcc::entity;
+
+namespace {
+    struct ChunkHeader {
+        char magic[4];
+        uint32_t version;
+        int64_t chunk_pos[3];
+        uint32_t block_count;
+        uint32_t entity_count;
+        uint64_t size;
+    };
+
+    struct BlockHeader {
+        uint32_t signature;
+        uint32_t count;
+        uint64_t size;
+    };
+
+    static_assert(sizeof(ChunkHeader) == 48 && sizeof(BlockHeader) == 16, "Unexpected padding on the entity chunk headers");
+    static_assert(sizeof(glm::f32vec3) == 12 && sizeof(BoundingBox) == 24, "Components must be tightly packed to be viewed in place");
+
+    const Signature known_components = Velocity | Bounds;
+
+    inline bool is_little_endian() {
+        uint16_t one = 1;
+        unsigned char first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    inline size_t align(size_t size) {
+        return (size + 15) & ~size_t(15);
+    }
+
+    // Bytes taken by a block of count entities with a signature
+    inline size_t get_block_size(Signature signature, size_t count) {
+        size_t size = sizeof(BlockHeader) + align(count * sizeof(glm::f32vec3));
+        if (signature & Velocity) {
+            size += align(count * sizeof(glm::f32vec3));
+        }
+        if (signature & Bounds) {
+            size += align(count * sizeof(BoundingBox));
+        }
+        return size;
+    }
+
+    struct ChunkHash {
+        inline size_t operator()(const glm::i64vec3& chunk) const {
+            uint64_t h = uint64_t(chunk.x) * 0x9E3779B97F4A7C15ull ^ uint64_t(chunk.y) * 0xC2B2AE3D27D4EB4Full ^
+                         uint64_t(chunk.z) * 0x165667B19E3779F9ull;
+            return size_t(h ^ (h >> 32));
+        }
+    };
+
+    // Rows of each archetype on each chunk saved, as rows[chunk][archetype]. Returns the archetypes.
+    std::vector<Archetype*> find_rows(Registry& registry, const std::vector<glm::i64vec3>& chunks, std::vector<std::vector<std::vector<uint32_t>>>& rows) {
+        std::unordered_map<glm::i64vec3, size_t, ChunkHash> indices;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            indices.insert({ chunks[i], i });
+        }
+
+        std::vector<Archetype*> archetypes;
+        registry.each(0, [&](Archetype& archetype) {
+            archetypes.push_back(&archetype);
+        });
+
+        rows.assign(chunks.size(), std::vector<std::vector<uint32_t>>(archetypes.size()));
+        for (size_t a = 0; a < archetypes.size(); ++a) {
+            auto& archetype = *archetypes[a];
+
+            // Entities on the same chunk tend to be next to each other, so the last chunk found is checked first
+            auto last = indices.end();
+            for (uint32_t row = 0; row < archetype.size(); ++row) {
+                if (last == indices.end() || last->first != archetype.chunk_pos[row]) {
+                    last = indices.find(archetype.chunk_pos[row]);
+                    if (last == indices.end()) {
+                        continue;
+                    }
+                }
+                rows[last->second][a].push_back(row);
+            }
+        }
+
+        return archetypes;
+    }
+
+    // Appends a chunk to out[c] for each chunk, with the rows found by find_rows()
+    void write_chunks(
+        const std::vector<Archetype*>& archetypes,
+        const std::vector<std::vector<std::vector<uint32_t>>>& rows,
+        const std::vector<glm::i64vec3>& chunks,
+        std::vector<std::vector<unsigned char>>& out
+    ) {
+        out.resize(chunks.size());
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            ChunkHeader header = {};
+            std::memcpy(header.magic, "MCCE", 4);
+            header.version = chunk_format_version;
+            header.chunk_pos[0] = chunks[c].x;
+            header.chunk_pos[1] = chunks[c].y;
+            header.chunk_pos[2] = chunks[c].z;
+            header.size = sizeof(ChunkHeader);
+            for (size_t a = 0; a < archetypes.size(); ++a) {
+                if (!rows[c][a].empty()) {
+                    header.block_count += 1;
+                    header.entity_count += uint32_t(rows[c][a].size());
+                    header.size += get_block_size(archetypes[a]->signature, rows[c][a].size());
+                }
+            }
+
+            // Size the buffer once, zeroing the padding, and gather the components straight into it
+            auto& buffer = out[c];
+            auto start = buffer.size();
+            buffer.resize(start + size_t(header.size), 0);
+            auto data = buffer.data() + start;
+            std::memcpy(data, &header, sizeof(ChunkHeader));
+            data += sizeof(ChunkHeader);
+
+            for (size_t a = 0; a < archetypes.size(); ++a) {
+                auto& archetype = *archetypes[a];
+                auto& block_rows = rows[c][a];
+                if (block_rows.empty()) {
+                    continue;
+                }
+
+                BlockHeader block_header = { archetype.signature, uint32_t(block_rows.size()), get_block_size(archetype.signature, block_rows.size()) };
+                std::memcpy(data, &block_header, sizeof(BlockHeader));
+                data += sizeof(BlockHeader);
+
+                auto pos = (glm::f32vec3*)data;
+                for (size_t i = 0; i < block_rows.size(); ++i) {
+                    pos[i] = archetype.pos[block_rows[i]];
+                }
+                data += align(block_rows.size() * sizeof(glm::f32vec3));
+
+                if (archetype.signature & Velocity) {
+                    auto velocity = (glm::f32vec3*)data;
+                    for (size_t i = 0; i < block_rows.size(); ++i) {
+                        velocity[i] = archetype.velocity[block_rows[i]];
+                    }
+                    data += align(block_rows.size() * sizeof(glm::f32vec3));
+                }
+
+                if (archetype.signature & Bounds) {
+                    for (size_t i = 0; i < block_rows.size(); ++i) {
+                        auto& box = archetype.bounds[block_rows[i]];
+                        auto low = box.get_low(), high = box.get_high();
+                        std::memcpy(data + i * sizeof(BoundingBox), &low, sizeof(glm::f32vec3));
+                        std::memcpy(data + i * sizeof(BoundingBox) + sizeof(glm::f32vec3), &high, sizeof(glm::f32vec3));
+                    }
+                    data += align(block_rows.size() * sizeof(BoundingBox));
+                }
+            }
+        }
+    }
+}
+
+Result<ChunkView, std::string> ChunkView::parse(const unsigned char* data, size_t size) {
+    if (!is_little_endian()) {
+        return Result<ChunkView, std::string>::error(
+            "mcc::entity::ChunkView::parse() failed:\nSerialized entities can't be viewed in place on big endian machines"
+        );
+    }
+
+    if ((uintptr_t(data) & 7) != 0) {
+        return Result<ChunkView, std::string>::error(
+            "mcc::entity::ChunkView::parse() failed:\nThe data must be aligned to 8 bytes"
+        );
+    }
+
+    if (size < sizeof(ChunkHeader)) {
+        return Result<ChunkView, std::string>::error(
+            "mcc::entity::ChunkView::parse() failed:\nThe data is smaller than a chunk header"
+        );
+    }
+
+    auto header = (const ChunkHeader*)data;
+    if (std::memcmp(header->magic, "MCCE", 4) != 0) {
+        return Result<ChunkView, std::string>::error(
+            "mcc::entity::ChunkView::parse() failed:\nThe data doesn't start with an entity chunk"
+        );
+    }
+
+    if (header->version != chunk_format_version) {
+        return Result<ChunkView, std::string>::error(
+            "mcc::entity::ChunkView::parse() failed:\nUnsupported entity chunk version '" + std::to_string(header->version) +
+            "', expected '" + std::to_string(chunk_format_version) + "'"
+        );
+    }
+
+    if (header->size < sizeof(ChunkHeader) || header->size > size || header->size % 16 != 0) {
+        return Result<ChunkView, std::string>::error(
+            "mcc::entity::ChunkView::parse() failed:\nInvalid entity chunk size '" + std::to_string(header->size) + "'"
+        );
+    }
+
+    ChunkView view;
+    view.chunk_pos = { header->chunk_pos[0], header->chunk_pos[1], header->chunk_pos[2] };
+    view.entity_count = header->entity_count;
+    view.size = size_t(header->size);
+
+    size_t offset = sizeof(ChunkHeader), entity_count = 0;
+    for (uint32_t i = 0; i < header->block_count; ++i) {
+        if (view.size - offset < sizeof(BlockHeader)) {
+            return Result<ChunkView, std::string>::error(
+                "mcc::entity::ChunkView::parse() failed:\nBlock " + std::to_string(i) + " starts past the end of the chunk"
+            );
+        }
+
+        auto block_header = (const BlockHeader*)(data + offset);
+        if (block_header->signature & ~known_components) {
+            return Result<ChunkView, std::string>::error(
+                "mcc::entity::ChunkView::parse() failed:\nBlock " + std::to_string(i) + " has unknown components"
+            );
+        }
+
+        auto block_size = get_block_size(block_header->signature, block_header->count);
+        if (block_header->size != block_size || view.size - offset < block_size) {
+            return Result<ChunkView, std::string>::error(
+                "mcc::entity::ChunkView::parse() failed:\nBlock " + std::to_string(i) + " has an invalid size"
+            );
+        }
+
+        Block block;
+        block.signature = block_header->signature;
+        block.count = block_header->count;
+
+        auto array = data + offset + sizeof(BlockHeader);
+        block.pos = (const glm::f32vec3*)array;
+        array += align(block.count * sizeof(glm::f32vec3));
+        block.velocity = nullptr;
+        if (block.signature & Velocity) {
+            block.velocity = (const glm::f32vec3*)array;
+            array += align(block.count * sizeof(glm::f32vec3));
+        }
+        block.bounds = nullptr;
+        if (block.signature & Bounds) {
+            block.bounds = (const BoundingBox*)array;
+        }
+
+        view.blocks.push_back(block);
+        offset += block_size;
+        entity_count += block.count;
+    }
+
+    if (entity_count != view.entity_count) {
+        return Result<ChunkView, std::string>::error(
+            "mcc::entity::ChunkView::parse() failed:\nThe blocks hold " + std::to_string(entity_count) +
+            " entities, but the header says " + std::to_string(view.entity_count)
+        );
+    }
+
+    return Result<ChunkView, std::string>::success(std::move(view));
+}
+
+void mcc::entity::save_chunks(Registry& registry, const std::vector<glm::i64vec3>& chunks, std::vector<std::vector<unsigned char>>& out) {
+    std::vector<std::vector<std::vector<uint32_t>>> rows;
+    auto archetypes = find_rows(registry, chunks, rows);
+    write_chunks(archetypes, rows, chunks, out);
+}
+
+void mcc::entity::unload_chunks(Registry& registry, const std::vector<glm::i64vec3>& chunks, std::vector<std::vector<unsigned char>>& out) {
+    std::vector<std::vector<std::vector<uint32_t>>> rows;
+    auto archetypes = find_rows(registry, chunks, rows);
+    write_chunks(archetypes, rows, chunks, out);
+
+    // Gather the handles first, since destroying an entity moves another into its row
+    std::vector<Handle> handles;
+    for (auto& chunk_rows : rows) {
+        for (size_t a = 0; a < archetypes.size(); ++a) {
+            for (auto row : chunk_rows[a]) {
+                handles.push_back(archetypes[a]->handles[row]);
+            }
+        }
+    }
+    for (auto handle : handles) {
+        registry.destroy(handle);
+    }
+}
+
+void mcc::entity::load_chunk(Registry& registry, const ChunkView& chunk, std::vector<Handle>* handles) {
+    for (auto& block : chunk.get_blocks()) {
+        if (block.count == 0) {
+            continue;
+        }
+
+        auto [archetype, first] = registry.create_many(block.signature, chunk.get_chunk_position(), block.count, handles);
+        std::memcpy(&archetype->pos[first], block.pos, block.count * sizeof(glm::f32vec3));
+        std::memcpy(&archetype->prev_pos[first], block.pos, block.count * sizeof(glm::f32vec3));
+        if (block.signature & Velocity) {
+            std::memcpy(&archetype->velocity[first], block.velocity, block.count * sizeof(glm::f32vec3));
+        }
+        if (block.signature & Bounds) {
+            std::memcpy((void*)&archetype->bounds[first], block.bounds, block.count * sizeof(BoundingBox));
+        }
+    }
+}
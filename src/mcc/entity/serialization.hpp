@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <mcc/result.hpp>
+#include <mcc/entity/bounding_box.hpp>
+#include <mcc/entity/entity.hpp>
+
+namespace mcc::entity {
+    /*
+        Binary format of the entities of a chunk. Each chunk is stored as a header followed by a block per archetype, which
+        holds the components of its entities as contiguous arrays, in the same layout as Archetype. Handles and previous
+        positions aren't stored, and neither is the chunk position of each entity, since they all share the chunk's.
+        The format is little endian. Every block and array starts on a 16 byte boundary relative to the start of the chunk,
+        and chunks take a multiple of 16 bytes, so that chunks written one after another can be viewed in place.
+
+        Chunk header (48 bytes):
+            char[4]    magic          "MCCE"
+            uint32     version        chunk_format_version
+            int64[3]   chunk_pos
+            uint32     block_count
+            uint32     entity_count
+            uint64     size           Bytes taken by the chunk, including this header
+        Block header (16 bytes), followed by pos[count], velocity[count] and bounds[count] (low then high), each padded to
+        16 bytes, with only the arrays of the components in the signature:
+            uint32     signature
+            uint32     count
+            uint64     size           Bytes taken by the block, including this header
+    */
+    const uint32_t chunk_format_version = 1;
+
+    // View of a serialized chunk, pointing into the buffer it was parsed from, which must outlive it.
+    class ChunkView final {
+    public:
+        struct Block {
+            Signature signature;
+            size_t count;
+            const glm::f32vec3* pos;
+            const glm::f32vec3* velocity; // Null if the signature has no velocity
+            const BoundingBox* bounds;    // Null if the signature has no bounds
+        };
+
+        // Checks the chunk at the start of data, which must be aligned to 8 bytes (e.g. a memory mapped file). Only the
+        // headers are read, so parsing doesn't depend on the number of entities.
+        static Result<ChunkView, std::string> parse(const unsigned char* data, size_t size);
+
+        inline glm::i64vec3 get_chunk_position() const { return this->chunk_pos; }
+        inline size_t get_entity_count() const { return this->entity_count; }
+        // Bytes taken by the chunk. The next chunk of a buffer starts right after.
+        inline size_t get_size() const { return this->size; }
+        inline const std::vector<Block>& get_blocks() const { return this->blocks; }
+
+    private:
+        ChunkView() = default;
+
+        glm::i64vec3 chunk_pos;
+        size_t entity_count, size;
+        std::vector<Block> blocks;
+    };
+
+    // Appends a serialized chunk to out[i] with the entities of the registry on chunks[i], for each i. Walks the registry
+    // once, however many chunks are saved.
+    void save_chunks(Registry& registry, const std::vector<glm::i64vec3>& chunks, std::vector<std::vector<unsigned char>>& out);
+    // Same as save_chunks(), but also destroys the entities saved.
+    void unload_chunks(Registry& registry, const std::vector<glm::i64vec3>& chunks, std::vector<std::vector<unsigned char>>& out);
+    // Creates the entities of a chunk, copying each block into its archetype at once. The handles of the entities created
+    // are appended to handles, if not null.
+    void load_chunk(Registry& registry, const ChunkView& chunk, std::vector<Handle>* handles = nullptr);
+}
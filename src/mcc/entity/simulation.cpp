@@ -0,0 +1,58 @@
+#include <mcc/entity/simulation.hpp>
+
+using namespace mcc;
+using namespace mcc::entity;
+
+Simulation::Simulation(float tick_rate, float chunk_extent, ThreadPool* pool, Mode mode) :
+    pool(pool), mode(mode), tick_dt(1.0f / tick_rate), chunk_extent(chunk_extent), accumulator(0.0f), tick_count(0) {
+
+}
+
+void Simulation::add_system(Signature required, System system) {
+    this->systems.push_back({ required, std::move(system) });
+}
+
+int Simulation::advance(float frame_dt) {
+    this->accumulator += glm::max(frame_dt, 0.0f);
+
+    int ticks = 0;
+    while (this->accumulator >= this->tick_dt && ticks < max_ticks_per_frame) {
+        this->tick();
+        this->accumulator -= this->tick_dt;
+        ticks += 1;
+    }
+
+    if (this->accumulator >= this->tick_dt) {
+        this->accumulator = glm::mod(this->accumulator, this->tick_dt);
+    }
+    return ticks;
+}
+
+void Simulation::tick() {
+    // Number of entities updated by each task
+    const size_t entities_per_task = 4096;
+
+    auto pool = this->mode == Mode::Parallel ? this->pool : nullptr;
+    if (this->mode == Mode::Deterministic) {
+        this->registry.sort();
+    }
+
+    // Keep the positions at the start of the tick, to interpolate from
+    this->registry.each(0, [](Archetype& archetype) {
+        archetype.prev_pos = archetype.pos;
+    });
+
+    for (auto& entry : this->systems) {
+        float dt = this->tick_dt;
+        for_each_batch(this->registry, entry.required, entities_per_task, [&](Archetype& archetype, size_t begin, size_t end) {
+            entry.system(archetype, begin, end, dt);
+        }, pool);
+    }
+
+    integrate(this->registry, this->tick_dt, this->chunk_extent, pool);
+    this->tick_count += 1;
+}
+
+glm::f32vec3 Simulation::get_interpolated_position(Handle handle) {
+    return glm::mix(this->registry.get_previous_position(handle), this->registry.get_position(handle), this->get_alpha());
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <mcc/entity/entity.hpp>
+#include <mcc/thread_pool.hpp>
+
+namespace mcc::entity {
+    /*
+        Runs the entities of a registry at a fixed tick rate, independently of the frame rate. Each frame advances the
+        simulation by the real time elapsed, running as many ticks as fit, and the renderer draws the entities interpolated
+        between the last two ticks, so that their motion stays smooth when ticks and frames don't line up.
+        Each tick runs the systems in the order they were added, and then moves the entities by their velocities.
+    */
+    class Simulation final {
+    public:
+        enum class Mode {
+            Parallel,      // Batches run on the thread pool, in any order
+            Deterministic, // Entities are sorted by handle and batches run in order on the calling thread, so that systems
+                           // with shared side effects (e.g. accumulating into a single value) give the same result every run
+        };
+
+        // Called for the entities [begin, end) of an archetype with the components the system requires.
+        // Systems may change the components of the entities in their batch, but not create or destroy entities.
+        using System = std::function<void(Archetype& archetype, size_t begin, size_t end, float dt)>;
+
+        // pool may be null, in which case everything runs on the calling thread.
+        Simulation(float tick_rate, float chunk_extent, ThreadPool* pool, Mode mode = Mode::Parallel);
+        Simulation(const Simulation&) = delete;
+        Simulation(Simulation&&) = delete;
+        ~Simulation() = default;
+
+        void add_system(Signature required, System system);
+
+        // Advances the simulation by frame_dt seconds of real time, returning the number of ticks run. At most
+        // max_ticks_per_frame ticks run per call and the rest of the time is dropped, so that a long stall (e.g. loading)
+        // doesn't make the following frames catch up with more and more ticks.
+        int advance(float frame_dt);
+        void tick();
+
+        // Position of an entity interpolated between the last two ticks, relative to its current chunk
+        glm::f32vec3 get_interpolated_position(Handle handle);
+
+        // Fraction of a tick elapsed since the last tick, in [0, 1)
+        inline float get_alpha() const { return this->accumulator / this->tick_dt; }
+        inline float get_tick_dt() const { return this->tick_dt; }
+        inline uint64_t get_tick() const { return this->tick_count; }
+        inline Registry& get_registry() { return this->registry; }
+        inline void set_mode(Mode mode) { this->mode = mode; }
+
+    private:
+        static constexpr int max_ticks_per_frame = 8;
+
+        struct Entry {
+            Signature required;
+            System system;
+        };
+
+        Registry registry;
+        std::vector<Entry> systems;
+        ThreadPool* pool;
+        Mode mode;
+        float tick_dt, chunk_extent;
+        float accumulator;
+        uint64_t tick_count;
+    };
+}
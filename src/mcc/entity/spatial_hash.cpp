@@ -0,0 +1,293 @@
+#include <mcc/entity/spatial_hash.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+using namespace mcc;
+using namespace mcc::entity;
+
+SpatialHash::SpatialHash(float chunk_extent, float cell_size) :
+    chunk_extent(chunk_extent), max_extent(0.0f), count(0) {
+    this->cells_per_chunk = glm::max(1, int(std::round(chunk_extent / cell_size)));
+    this->cell_size = chunk_extent / float(this->cells_per_chunk);
+}
+
+void SpatialHash::update(Handle handle, glm::i64vec3 chunk_pos, glm::f32vec3 pos, const BoundingBox& bounds) {
+    std::unique_lock lock(this->mutex);
+    this->update_locked(handle, chunk_pos, pos, bounds);
+}
+
+void SpatialHash::update(Registry& registry) {
+    std::unique_lock lock(this->mutex);
+    registry.each(0, [&](Archetype& archetype) {
+        bool has_bounds = archetype.signature & Bounds;
+        for (size_t i = 0; i < archetype.size(); ++i) {
+            auto bounds = has_bounds ? archetype.bounds[i] : BoundingBox({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f });
+            this->update_locked(archetype.handles[i], archetype.chunk_pos[i], archetype.pos[i], bounds);
+        }
+    });
+}
+
+void SpatialHash::remove(Handle handle) {
+    std::unique_lock lock(this->mutex);
+    if (handle.generation == 0 || handle.index >= this->records.size() ||
+        this->records[handle.index].generation != handle.generation) {
+        return;
+    }
+
+    auto& record = this->records[handle.index];
+    this->erase(record.cell, record.row);
+    record.generation = 0;
+    this->count -= 1;
+}
+
+bool SpatialHash::contains(Handle handle) const {
+    std::shared_lock lock(this->mutex);
+    return handle.generation != 0 && handle.index < this->records.size() &&
+           this->records[handle.index].generation == handle.generation;
+}
+
+void SpatialHash::clear() {
+    std::unique_lock lock(this->mutex);
+    this->cells.clear();
+    this->records.clear();
+    this->count = 0;
+    this->max_extent = 0.0f;
+}
+
+size_t SpatialHash::size() const {
+    std::shared_lock lock(this->mutex);
+    return this->count;
+}
+
+void SpatialHash::update_locked(Handle handle, glm::i64vec3 chunk_pos, glm::f32vec3 pos, const BoundingBox& bounds) {
+    auto extent = glm::max(-bounds.get_low(), bounds.get_high());
+    this->max_extent = glm::max(this->max_extent, glm::max(extent.x, glm::max(extent.y, extent.z)));
+
+    if (handle.index >= this->records.size()) {
+        this->records.resize(handle.index + 1);
+    }
+
+    auto cell = this->get_cell(chunk_pos, pos);
+    auto& record = this->records[handle.index];
+    record.chunk_pos = chunk_pos;
+    record.pos = pos;
+    record.bounds = bounds;
+
+    // Entities which stay on the same cell, the common case, don't touch the map
+    if (record.generation != 0) {
+        record.generation = handle.generation;
+        if (record.cell == cell) {
+            return;
+        }
+        this->erase(record.cell, record.row);
+    } else {
+        record.generation = handle.generation;
+        this->count += 1;
+    }
+
+    auto& indices = this->cells[cell];
+    indices.push_back(handle.index);
+    record.cell = cell;
+    record.row = uint32_t(indices.size() - 1);
+}
+
+void SpatialHash::erase(const glm::i64vec3& cell, uint32_t row) {
+    auto it = this->cells.find(cell);
+    auto& indices = it->second;
+    if (row != indices.size() - 1) {
+        indices[row] = indices.back();
+        this->records[indices[row]].row = row;
+    }
+    indices.pop_back();
+
+    // Drop empty cells, so that the map only grows with the space occupied at once
+    if (indices.empty()) {
+        this->cells.erase(it);
+    }
+}
+
+template <typename F>
+void SpatialHash::visit(glm::i64vec3 min, glm::i64vec3 max, F&& func) const {
+    // Large ranges over a sparse grid are cheaper to answer by walking every stored cell
+    auto range = glm::f64vec3(max - min + glm::i64vec3(1));
+    if (range.x * range.y * range.z > double(this->cells.size())) {
+        for (auto& cell : this->cells) {
+            if (cell.first.x >= min.x && cell.first.y >= min.y && cell.first.z >= min.z &&
+                cell.first.x <= max.x && cell.first.y <= max.y && cell.first.z <= max.z) {
+                for (auto index : cell.second) {
+                    func(this->records[index]);
+                }
+            }
+        }
+        return;
+    }
+
+    glm::i64vec3 key;
+    for (key.x = min.x; key.x <= max.x; ++key.x) {
+        for (key.y = min.y; key.y <= max.y; ++key.y) {
+            for (key.z = min.z; key.z <= max.z; ++key.z) {
+                auto it = this->cells.find(key);
+                if (it != this->cells.end()) {
+                    for (auto index : it->second) {
+                        func(this->records[index]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::query_radius(glm::i64vec3 chunk_pos, glm::f32vec3 pos, float radius, std::vector<Handle>& out) const {
+    std::shared_lock lock(this->mutex);
+    auto min = this->get_cell(chunk_pos, pos - radius);
+    auto max = this->get_cell(chunk_pos, pos + radius);
+    this->visit(min, max, [&](const Record& record) {
+        auto offset = this->get_offset(record, chunk_pos, pos);
+        if (glm::dot(offset, offset) <= radius * radius) {
+            out.push_back({ uint32_t(&record - this->records.data()), record.generation });
+        }
+    });
+}
+
+void SpatialHash::query_box(glm::i64vec3 chunk_pos, glm::f32vec3 pos, const BoundingBox& box, std::vector<Handle>& out) const {
+    std::shared_lock lock(this->mutex);
+    auto min = this->get_cell(chunk_pos, pos + box.get_low() - this->max_extent);
+    auto max = this->get_cell(chunk_pos, pos + box.get_high() + this->max_extent);
+    this->visit(min, max, [&](const Record& record) {
+        if (record.bounds.translate(this->get_offset(record, chunk_pos, pos)).intersects(box)) {
+            out.push_back({ uint32_t(&record - this->records.data()), record.generation });
+        }
+    });
+}
+
+void SpatialHash::query_nearest(glm::i64vec3 chunk_pos, glm::f32vec3 pos, size_t k, float max_distance, std::vector<Handle>& out) const {
+    std::shared_lock lock(this->mutex);
+    if (k == 0 || this->count == 0) {
+        return;
+    }
+
+    // Candidates, as squared distance and handle index. Sorting by index too keeps ties in a stable order.
+    std::vector<std::pair<float, uint32_t>> found;
+    auto add = [&](uint32_t index) {
+        auto offset = this->get_offset(this->records[index], chunk_pos, pos);
+        auto distance = glm::dot(offset, offset);
+        if (distance <= max_distance * max_distance) {
+            found.push_back({ distance, index });
+        }
+    };
+
+    // Search rings of cells around the cell of pos, stopping once k entities were found closer than any cell not searched
+    // yet. The cells outside ring r are at least r cells away from pos.
+    auto center = this->get_cell(chunk_pos, pos);
+    auto last_ring = int64_t(std::ceil(max_distance / this->cell_size));
+    size_t seen = 0;
+    for (int64_t r = 0; r <= last_ring; ++r) {
+        auto side = double(2 * r + 1);
+        if (side * side * side > double(this->cells.size())) {
+            // The ring has more cells than the map, so just check every entity
+            found.clear();
+            for (auto& cell : this->cells) {
+                for (auto index : cell.second) {
+                    add(index);
+                }
+            }
+            break;
+        }
+
+        glm::i64vec3 o;
+        for (o.x = -r; o.x <= r; ++o.x) {
+            for (o.y = -r; o.y <= r; ++o.y) {
+                // Only the faces of the ring cube are new
+                bool face = o.x == -r || o.x == r || o.y == -r || o.y == r;
+                int64_t step = face ? 1 : glm::max(int64_t(1), 2 * r);
+                for (o.z = -r; o.z <= r; o.z += step) {
+                    auto it = this->cells.find(center + o);
+                    if (it != this->cells.end()) {
+                        for (auto index : it->second) {
+                            add(index);
+                        }
+                        seen += it->second.size();
+                    }
+                }
+            }
+        }
+
+        if (seen == this->count) {
+            break;
+        }
+        if (found.size() >= k) {
+            std::nth_element(found.begin(), found.begin() + (k - 1), found.end());
+            float reach = float(r) * this->cell_size;
+            if (found[k - 1].first <= reach * reach) {
+                break;
+            }
+        }
+    }
+
+    auto end = found.begin() + glm::min(k, found.size());
+    std::partial_sort(found.begin(), end, found.end());
+    for (auto it = found.begin(); it != end; ++it) {
+        out.push_back({ it->second, this->records[it->second].generation });
+    }
+}
+
+void SpatialHash::find_pairs(std::vector<std::pair<Handle, Handle>>& out, ThreadPool* pool) const {
+    // Number of cells checked by each task
+    const size_t cells_per_task = 256;
+
+    std::shared_lock lock(this->mutex);
+
+    std::vector<const std::pair<const glm::i64vec3, Cell>*> cells;
+    cells.reserve(this->cells.size());
+    for (auto& cell : this->cells) {
+        cells.push_back(&cell);
+    }
+
+    // Pairs found by each range of cells
+    std::vector<std::vector<std::pair<Handle, Handle>>> task_pairs((cells.size() + cells_per_task - 1) / cells_per_task);
+    ThreadPool::parallel_for_range(pool, cells.size(), cells_per_task, [&](size_t begin, size_t end) {
+        auto& pairs = task_pairs[begin / cells_per_task];
+        auto test = [&](uint32_t a, uint32_t b) {
+            auto& ra = this->records[a];
+            auto& rb = this->records[b];
+            if (ra.bounds.intersects(rb.bounds.translate(this->get_offset(rb, ra.chunk_pos, ra.pos)))) {
+                pairs.push_back({ { a, ra.generation }, { b, rb.generation } });
+            }
+        };
+
+        for (size_t j = begin; j < end; ++j) {
+            auto& key = cells[j]->first;
+            auto& indices = cells[j]->second;
+            for (size_t a = 0; a < indices.size(); ++a) {
+                for (size_t b = a + 1; b < indices.size(); ++b) {
+                    test(indices[a], indices[b]);
+                }
+
+                // Other entities may only intersect this one if their positions are within its bounds grown by the
+                // largest extent. Each pair of cells is checked once, from the cell with the lowest coordinates.
+                auto& record = this->records[indices[a]];
+                auto min = this->get_cell(record.chunk_pos, record.pos + record.bounds.get_low() - this->max_extent);
+                auto max = this->get_cell(record.chunk_pos, record.pos + record.bounds.get_high() + this->max_extent);
+                glm::i64vec3 other;
+                for (other.x = glm::max(min.x, key.x); other.x <= max.x; ++other.x) {
+                    for (other.y = other.x == key.x ? glm::max(min.y, key.y) : min.y; other.y <= max.y; ++other.y) {
+                        for (other.z = other.x == key.x && other.y == key.y ? glm::max(min.z, key.z + 1) : min.z; other.z <= max.z; ++other.z) {
+                            auto it = this->cells.find(other);
+                            if (it != this->cells.end()) {
+                                for (auto b : it->second) {
+                                    test(indices[a], b);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    for (auto& pairs : task_pairs) {
+        out.insert(out.end(), pairs.begin(), pairs.end());
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <mcc/entity/bounding_box.hpp>
+#include <mcc/entity/entity.hpp>
+#include <mcc/thread_pool.hpp>
+
+namespace mcc::entity {
+    /*
+        Indexes entities by location, on a grid of cells which evenly divides the chunks. Only the cells holding entities
+        are stored, on a hash map keyed by the global coordinates of the cell, so the grid is unbounded and moving an
+        entity only touches the cells it leaves and enters.
+        Each entity is stored on the cell of its position, and its bounds may extend past that cell (a loose grid): the
+        queries on bounds look further by the largest extent ever indexed, so bounds should be kept smaller than a cell.
+        Queries take a shared lock and may run on many threads at once. Changes take an exclusive lock.
+    */
+    class SpatialHash final {
+    public:
+        // cell_size is rounded so that a whole number of cells fits in a chunk.
+        SpatialHash(float chunk_extent, float cell_size);
+        SpatialHash(const SpatialHash&) = delete;
+        SpatialHash(SpatialHash&&) = delete;
+        ~SpatialHash() = default;
+
+        // Indexes an entity, or moves it if it is already indexed. The bounds are relative to pos.
+        void update(Handle handle, glm::i64vec3 chunk_pos, glm::f32vec3 pos, const BoundingBox& bounds);
+        // Updates every entity of a registry under a single lock. Entities without bounds are indexed as points.
+        // Destroyed entities must still be removed with remove().
+        void update(Registry& registry);
+        // Removing an entity which isn't indexed does nothing.
+        void remove(Handle handle);
+        bool contains(Handle handle) const;
+        void clear();
+
+        // The following queries append their results to out.
+        // Entities whose position is within radius of pos, in no particular order.
+        void query_radius(glm::i64vec3 chunk_pos, glm::f32vec3 pos, float radius, std::vector<Handle>& out) const;
+        // Entities whose bounds intersect box, which is relative to pos, in no particular order.
+        void query_box(glm::i64vec3 chunk_pos, glm::f32vec3 pos, const BoundingBox& box, std::vector<Handle>& out) const;
+        // The k entities whose positions are closest to pos, up to max_distance away, sorted by distance.
+        void query_nearest(glm::i64vec3 chunk_pos, glm::f32vec3 pos, size_t k, float max_distance, std::vector<Handle>& out) const;
+        // Every pair of entities whose bounds intersect, once each. If a thread pool is passed, the cells are split
+        // between its threads.
+        void find_pairs(std::vector<std::pair<Handle, Handle>>& out, ThreadPool* pool = nullptr) const;
+
+        // Number of indexed entities
+        size_t size() const;
+        inline float get_cell_size() const { return this->cell_size; }
+
+    private:
+        // An indexed entity, stored by handle index, so that moving an entity within its cell doesn't touch the map
+        struct Record {
+            uint32_t generation = 0; // 0 if the slot isn't indexed
+            uint32_t row;            // Index on the cell
+            glm::i64vec3 cell;
+            glm::i64vec3 chunk_pos;
+            glm::f32vec3 pos;
+            BoundingBox bounds = BoundingBox({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }); // Relative to pos
+        };
+
+        struct CellHash {
+            inline size_t operator()(const glm::i64vec3& cell) const {
+                uint64_t h = uint64_t(cell.x) * 0x9E3779B97F4A7C15ull ^ uint64_t(cell.y) * 0xC2B2AE3D27D4EB4Full ^
+                             uint64_t(cell.z) * 0x165667B19E3779F9ull;
+                return size_t(h ^ (h >> 32));
+            }
+        };
+
+        using Cell = std::vector<uint32_t>; // Handle indices of the entities on the cell
+
+        inline glm::i64vec3 get_cell(glm::i64vec3 chunk_pos, glm::f32vec3 pos) const {
+            return chunk_pos * glm::i64vec3(this->cells_per_chunk) + glm::i64vec3(glm::floor(pos / this->cell_size));
+        }
+
+        // Position of a record relative to pos on chunk_pos
+        inline glm::f32vec3 get_offset(const Record& record, glm::i64vec3 chunk_pos, glm::f32vec3 pos) const {
+            return glm::f32vec3(record.chunk_pos - chunk_pos) * this->chunk_extent + (record.pos - pos);
+        }
+
+        void update_locked(Handle handle, glm::i64vec3 chunk_pos, glm::f32vec3 pos, const BoundingBox& bounds);
+        // Removes a row from a cell, moving the last entry of the cell into its place
+        void erase(const glm::i64vec3& cell, uint32_t row);
+
+        // Calls func(record) for every record on the cells in [min, max]
+        template <typename F>
+        void visit(glm::i64vec3 min, glm::i64vec3 max, F&& func) const;
+
+        float chunk_extent, cell_size;
+        int cells_per_chunk;
+        float max_extent; // Largest distance from an entity's position to a face of its bounds
+
+        mutable std::shared_mutex mutex;
+        std::unordered_map<glm::i64vec3, Cell, CellHash> cells;
+        std::vector<Record> records;
+        size_t count;
+    };
+}
@@ -1,4 +1,5 @@
 #include <mcc/config.hpp>
+#include <mcc/thread_pool.hpp>
 
 #include <mcc/data/manager.hpp>
 #include <mcc/data/model.hpp>
@@ -11,6 +12,7 @@
 #include <mcc/gl/shader.hpp>
 #include <mcc/gl/vertex_array.hpp>
 #include <mcc/gl/mesh.hpp>
+#include <mcc/gl/quad_mesh.hpp>
 #include <mcc/gl/debug.hpp>
 #include <mcc/gl/deferred_renderer.hpp>
 #include <mcc/ui/camera.hpp>
@@ -18,12 +20,16 @@
 #include <mcc/map/chunk.hpp>
 #include <mcc/map/generator.hpp>
 
+#include <mcc/entity/simulation.hpp>
+
 #include <iostream>
 #include <chrono>
 #include <random>
 
 mcc::ui::Camera* camera;
-float dt = 1.0f / 60.0f;
+float dt = 0.0f; // Real time taken by the last frame, in seconds
+const float look_scale = 1.0f / 60.0f; // Radians turned per pixel moved, at a sensitivity of 1
+const float entity_chunk_extent = 32.0f;
 float camera_sensitivity = 0.1f;
 float camera_speed = 1.0f;
 const glm::vec4 sky_color = { 0.1f, 0.5f, 0.8f, 1.0f };
@@ -45,6 +51,8 @@ public:
         for (int i = 2; i < 256; ++i) {
             palette[i].color = { i % 128 + 128, i % 128 + 64, i % 128 + 32, 255 };
         }
+        palette[2].color = { 255, 220, 150, 255 };
+        palette[2].emission = 14;
     }
 
     virtual unsigned char generate_material(glm::f64vec3 pos, int level) override {
@@ -76,10 +84,20 @@ public:
 
         //unsigned char mat = int(abs(glm::round(glm::sin(float(p1.x + p1.y + p1.z)) * 254))) + 1;
         unsigned char mat = 1;
-        
-        return (glm::cos(float(p2.x)) +
-                glm::cos(float(p2.y)) +
-                glm::cos(float(p2.z))) < 0 ? mat : 0;
+
+        bool solid = (glm::cos(float(p2.x)) +
+                      glm::cos(float(p2.y)) +
+                      glm::cos(float(p2.z))) < 0;
+        if (!solid) {
+            return 0;
+        }
+
+        // Scatter a few glowing blocks, which light up the caves around them
+        auto cell = glm::floor(glm::vec3(p1));
+        if (glm::fract(glm::sin(glm::dot(cell, glm::vec3(12.9898f, 78.233f, 37.719f))) * 43758.5453f) > 0.995f) {
+            return 2;
+        }
+        return mat;
     }
 };
 
@@ -91,8 +109,8 @@ void glfw_cursor_pos_callback(GLFWwindow* win, double x, double y) {
     static double px = INFINITY, py;
     if (px != INFINITY) {
         camera->rotate(glm::vec2(
-            -(y - py) * camera_sensitivity * dt,
-            -(x - px) * camera_sensitivity * dt
+            -(y - py) * camera_sensitivity * look_scale,
+            -(x - px) * camera_sensitivity * look_scale
         ));       
         camera->update();
     }
@@ -215,11 +233,25 @@ int main(int argc, char** argv) {
         glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
     }
 
-    // Setup debug renderer
+    // Setup debug renderer and the vertex arrays shared by meshes
     mcc::gl::Debug::init();
+    mcc::gl::Mesh::init();
+    mcc::gl::QuadMesh::init();
+
+    // Setup worker threads
+    auto thread_pool = mcc::ThreadPool(int(config["system.threads"].unwrap().as_integer().unwrap()));
+
+    // Setup entity simulation
+    auto simulation = mcc::entity::Simulation(
+        float(config["simulation.tick_rate"].unwrap().as_integer().unwrap()),
+        entity_chunk_extent,
+        &thread_pool,
+        config["simulation.deterministic"].unwrap().as_integer().unwrap() != 0 ?
+            mcc::entity::Simulation::Mode::Deterministic : mcc::entity::Simulation::Mode::Parallel
+    );
 
     // Setup asset manager
-    auto model_loader = mcc::data::Model::Loader(config);
+    auto model_loader = mcc::data::Model::Loader(config, &thread_pool);
     auto manager = mcc::data::Manager(config, { { "model", &model_loader } });
 
     // Setup camera
@@ -238,16 +270,28 @@ int main(int argc, char** argv) {
     glfwSwapInterval(1);
   
     // Prepare renderer
-    auto renderer = mcc::gl::DeferredRenderer::create(win_width, win_height).unwrap();
+    auto renderer = mcc::gl::DeferredRenderer::create(
+        win_width, win_height,
+        int(config["renderer.ssao_samples"].unwrap().as_integer().unwrap()),
+        int(config["renderer.ssao_scale"].unwrap().as_integer().unwrap())
+    ).unwrap();
     renderer.set_sky_color({0.0f, 0.5f, 1.0f});
+    renderer.set_ssao(config["renderer.ssao"].unwrap().as_integer().unwrap() != 0);
+    bool baked_ao = config["renderer.baked_ao"].unwrap().as_integer().unwrap() != 0;
+    bool baked_light = config["renderer.baked_light"].unwrap().as_integer().unwrap() != 0;
 
     // Prepare mesh shader
+    const char* mesh_fragment_shader = mcc::gl::DeferredRenderer::get_opaque_fragment_shader();
+
     auto mesh_shader = mcc::gl::Shader::create(R"(
         #version 330 core
 
         layout (location = 0) in vec3 vert_pos;
         layout (location = 1) in vec3 vert_normal;
         layout (location = 2) in vec4 vert_color;
+        layout (location = 3) in float vert_ao;
+        layout (location = 4) in vec3 vert_offset; // Per draw offset of batched meshes, zero otherwise
+        layout (location = 5) in vec2 vert_light; // Baked sky and block light levels (0 - 15)
 
         uniform mat4 model;
         uniform mat4 view;
@@ -256,50 +300,135 @@ int main(int argc, char** argv) {
         out vec3 frag_albedo;
         out vec3 frag_pos;
         out vec3 frag_normal;
+        out float frag_ao;
 
         void main() {
-            vec4 view_pos = view * model * vec4(vert_pos, 1.0f);
+            vec4 view_pos = view * model * vec4(vert_pos + vert_offset, 1.0f);
             frag_pos = view_pos.xyz;
             gl_Position = projection * view_pos;
             frag_albedo = vert_color.rgb;
+            // The baked light fades by a constant factor per level, and darkens the surface as the occlusion does
+            frag_ao = vert_ao * pow(0.8f, 15.0f - max(vert_light.x, vert_light.y));
             mat3 normal_matrix = transpose(inverse(mat3(view * model)));
             frag_normal = normal_matrix * vert_normal;
         }
-    )", R"(
+    )", mesh_fragment_shader).unwrap();
+
+    auto model_loc = mesh_shader.get_uniform_location("model").unwrap();
+    auto view_loc = mesh_shader.get_uniform_location("view").unwrap();
+    auto projection_loc = mesh_shader.get_uniform_location("projection").unwrap();
+
+    // Prepare transparent mesh shader, lit here instead of on the screen quad
+    const char* transparent_fragment_shader = R"(
         #version 330 core
 
-        in vec3 frag_albedo;
+        in vec4 frag_color;
         in vec3 frag_pos;
         in vec3 frag_normal;
+        in float frag_ao;
+
+        layout (location = 0) out vec4 accum;
+        layout (location = 1) out float revealage;
+
+        uniform mat4 view;
+        uniform vec3 sky_color;
+        uniform float z_far;
 
-        layout (location = 0) out vec3 albedo;
-        layout (location = 1) out vec3 position;
-        layout (location = 2) out vec3 normal;
+        const vec3 world_light_dir = normalize(vec3(-0.7, 1.5, 0.5));
 
         void main() {
-            albedo = frag_albedo;
-            position = frag_pos;
-            normal = normalize(frag_normal);
+            // Same lighting and fog as the opaque surfaces
+            vec3 normal = normalize(frag_normal);
+            vec3 light_dir = normalize(mat3(view) * world_light_dir);
+            vec3 lighting = frag_color.rgb * frag_ao * 0.3f;
+            lighting += max(dot(normal, light_dir), 0.0f) * frag_color.rgb * frag_ao;
+            float depth = min(1.0f, length(frag_pos) / z_far);
+            vec3 color = mix(lighting, sky_color, depth * depth);
+
+            // Closer and more opaque surfaces weigh more on the blended color
+            float alpha = frag_color.a;
+            float weight = clamp(pow(min(1.0f, alpha * 10.0f) + 0.01f, 3.0f) * 1e8f * pow(1.0f - gl_FragCoord.z * 0.9f, 3.0f), 1e-2f, 3e3f);
+            accum = vec4(color * alpha, alpha) * weight;
+            revealage = alpha;
         }
-    )").unwrap();
+    )";
 
-    auto model_loc = mesh_shader.get_uniform_location("model").unwrap();
-    auto view_loc = mesh_shader.get_uniform_location("view").unwrap();
-    auto projection_loc = mesh_shader.get_uniform_location("projection").unwrap();
+    auto transparent_shader = mcc::gl::Shader::create(R"(
+        #version 330 core
+
+        layout (location = 0) in vec3 vert_pos;
+        layout (location = 1) in vec3 vert_normal;
+        layout (location = 2) in vec4 vert_color;
+        layout (location = 3) in float vert_ao;
+        layout (location = 4) in vec3 vert_offset; // Per draw offset of batched meshes, zero otherwise
+        layout (location = 5) in vec2 vert_light; // Baked sky and block light levels (0 - 15)
+
+        uniform mat4 model;
+        uniform mat4 view;
+        uniform mat4 projection;
+        
+        out vec4 frag_color;
+        out vec3 frag_pos;
+        out vec3 frag_normal;
+        out float frag_ao;
+
+        void main() {
+            vec4 view_pos = view * model * vec4(vert_pos + vert_offset, 1.0f);
+            frag_pos = view_pos.xyz;
+            gl_Position = projection * view_pos;
+            frag_color = vert_color;
+            frag_ao = vert_ao * pow(0.8f, 15.0f - max(vert_light.x, vert_light.y)); // Same baked light as the opaque surfaces
+            mat3 normal_matrix = transpose(inverse(mat3(view * model)));
+            frag_normal = normal_matrix * vert_normal;
+        }
+    )", transparent_fragment_shader).unwrap();
+
+    auto transparent_model_loc = transparent_shader.get_uniform_location("model").unwrap();
+    auto transparent_view_loc = transparent_shader.get_uniform_location("view").unwrap();
+    auto transparent_projection_loc = transparent_shader.get_uniform_location("projection").unwrap();
+    auto transparent_sky_color_loc = transparent_shader.get_uniform_location("sky_color").unwrap();
+    auto transparent_z_far_loc = transparent_shader.get_uniform_location("z_far").unwrap();
+
+    // Prepare the shaders of models drawn from packed quads
+    bool vertex_pulling = config["renderer.vertex_pulling"].unwrap().as_integer().unwrap() != 0;
+    auto quad_shader = mcc::gl::Shader::create(mcc::gl::QuadMesh::get_vertex_shader(), mesh_fragment_shader).unwrap();
+    auto quad_transparent_shader = mcc::gl::Shader::create(mcc::gl::QuadMesh::get_vertex_shader(), transparent_fragment_shader).unwrap();
+
+    // Binds a quad shader and sets its uniforms
+    auto bind_quad_shader = [&](mcc::gl::Shader& shader, const glm::mat4& model, const mcc::gl::QuadMesh& mesh) {
+        shader.bind();
+        glUniformMatrix4fv(shader.get_uniform_location("model").unwrap(), 1, GL_FALSE, &model[0][0]);
+        glUniformMatrix4fv(shader.get_uniform_location("view").unwrap(), 1, GL_FALSE, &camera->get_view()[0][0]);
+        glUniformMatrix4fv(shader.get_uniform_location("projection").unwrap(), 1, GL_FALSE, &camera->get_projection()[0][0]);
+        glUniform1f(shader.get_uniform_location("voxel_size").unwrap(), mesh.get_voxel_size());
+        glUniform1i(shader.get_uniform_location("quads").unwrap(), mcc::gl::QuadMesh::texture_unit);
+    };
 
     // Setup terrain
     auto generator = Generator();
-    auto chunk = mcc::map::Chunk(generator, nullptr, { 0.0, 0.0, 0.0 }, 256.0f, 32, 8);
+    auto chunk_arena = mcc::gl::MeshArena();
+    auto chunk = mcc::map::Chunk(generator, chunk_arena, nullptr, { 0.0, 0.0, 0.0 }, 256.0f, 32, 8, baked_ao, baked_light);
+    std::vector<mcc::gl::MeshArena::Draw> chunk_draws;
 
     auto obj = manager.get<mcc::data::Model>("model.chr_knight").unwrap();
+    auto knight = simulation.get_registry().create(mcc::entity::Velocity | mcc::entity::Bounds, { 0, 0, 0 }, { 0.0f, 0.0f, 0.0f });
+    // The knight is drawn turned around its origin, so its box spans the negative X and Z axes
+    auto knight_size = obj->get_size();
+    simulation.get_registry().get_bounds(knight) = mcc::entity::BoundingBox({ -knight_size.x, 0.0f, -knight_size.z }, { 0.0f, knight_size.y, 0.0f });
 
     glEnable(GL_CULL_FACE);
     glFrontFace(GL_CCW);
 
     // Main loop
+    auto last_frame = std::chrono::steady_clock::now();
     while (!glfwWindowShouldClose(win)) {
         glfwPollEvents();
 
+        // Input moves the camera by the real time elapsed, clamped so that a stall doesn't throw it away
+        auto now = std::chrono::steady_clock::now();
+        dt = glm::min(std::chrono::duration<float>(now - last_frame).count(), 0.25f);
+        last_frame = now;
+
         // Get input
         if (glfwGetKey(win, GLFW_KEY_W) == GLFW_PRESS) {
             camera->move(camera->get_forward() * dt * camera_speed);
@@ -324,10 +453,30 @@ int main(int argc, char** argv) {
         }
 
         camera->update();
+        simulation.advance(dt);
+        auto knight_position = glm::vec3(simulation.get_registry().get_chunk_position(knight)) * entity_chunk_extent +
+                               simulation.get_interpolated_position(knight);
         chunk.update(*camera, float(config["camera.lod_multiplier"].unwrap().as_double().unwrap()));
+        chunk.update_light(thread_pool, thread_pool.get_thread_count() * 4);
+        chunk.update_seams(thread_pool, thread_pool.get_thread_count() * 4);
+
+        // Highlight the voxel under the crosshair
+        mcc::gl::RayHit crosshair_hit;
+        const mcc::map::Chunk* crosshair_chunk = nullptr;
+        if (chunk.raycast({ camera->get_position(), camera->get_forward(), camera->get_z_far() }, crosshair_hit, &crosshair_chunk)) {
+            auto vox_sz = crosshair_chunk->get_voxel_size();
+            auto position = glm::vec3(crosshair_chunk->get_voxel_position(crosshair_hit.voxel)) + glm::vec3(vox_sz * 0.5f);
+            mcc::gl::Debug::draw_box(position, glm::vec3(vox_sz * 0.5f), glm::vec4(1.0f, 1.0f, 0.0f, 0.5f));
+        }
+
+        // Compact the chunk meshes when most of the free space is scattered across small blocks
+        auto arena_stats = chunk_arena.get_stats();
+        if (arena_stats.free_block_count > 64 && arena_stats.fragmentation() > 0.5f) {
+            chunk_arena.defragment().unwrap();
+        }
 
         renderer.render(
-            1.0f / 144.0f,
+            dt,
             *camera,
             [&]() {
                 // Draw opaque scene
@@ -335,16 +484,47 @@ int main(int argc, char** argv) {
                 glUniformMatrix4fv(view_loc, 1, GL_FALSE, &camera->get_view()[0][0]);
                 glUniformMatrix4fv(projection_loc, 1, GL_FALSE, &camera->get_projection()[0][0]);
 
-                chunk.draw(*camera, model_loc);
+                // Draw the whole terrain in a single batch
+                chunk_draws.clear();
+                chunk.draw(*camera, chunk_draws);
+                glm::mat4 identity = glm::mat4(1.0f);
+                glUniformMatrix4fv(model_loc, 1, GL_FALSE, &identity[0][0]);
+                chunk_arena.draw_opaque(chunk_draws, camera->get_position());
 
-                glm::mat4 model = glm::mat4(1.0f);
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), knight_position);
                 model = glm::rotate(model, glm::pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f));
-                model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-                glUniformMatrix4fv(model_loc, 1, GL_FALSE, &model[0][0]);
-                obj->get_mesh().draw_opaque();
+                auto model_camera_pos = glm::vec3(glm::inverse(model) * glm::vec4(camera->get_position(), 1.0f));
+                if (vertex_pulling) {
+                    bind_quad_shader(quad_shader, model, obj->get_quad_mesh());
+                    obj->get_quad_mesh().draw_opaque(model_camera_pos);
+                } else {
+                    glUniformMatrix4fv(model_loc, 1, GL_FALSE, &model[0][0]);
+                    obj->get_mesh(*camera, model).draw_opaque(model_camera_pos);
+                }
             },
             [&]() {
-                // Draw transparent scene
+                // Draw transparent scene, reusing the batch gathered by the opaque pass
+                transparent_shader.bind();
+                glUniformMatrix4fv(transparent_view_loc, 1, GL_FALSE, &camera->get_view()[0][0]);
+                glUniformMatrix4fv(transparent_projection_loc, 1, GL_FALSE, &camera->get_projection()[0][0]);
+                glUniform3fv(transparent_sky_color_loc, 1, &renderer.get_sky_color()[0]);
+                glUniform1f(transparent_z_far_loc, camera->get_z_far());
+
+                glm::mat4 identity = glm::mat4(1.0f);
+                glUniformMatrix4fv(transparent_model_loc, 1, GL_FALSE, &identity[0][0]);
+                chunk_arena.draw_transparent(chunk_draws);
+
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), knight_position);
+                model = glm::rotate(model, glm::pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f));
+                if (vertex_pulling) {
+                    bind_quad_shader(quad_transparent_shader, model, obj->get_quad_mesh());
+                    glUniform3fv(quad_transparent_shader.get_uniform_location("sky_color").unwrap(), 1, &renderer.get_sky_color()[0]);
+                    glUniform1f(quad_transparent_shader.get_uniform_location("z_far").unwrap(), camera->get_z_far());
+                    obj->get_quad_mesh().draw_transparent();
+                } else {
+                    glUniformMatrix4fv(transparent_model_loc, 1, GL_FALSE, &model[0][0]);
+                    obj->get_mesh(*camera, model).draw_transparent();
+                }
             }
         );
 
@@ -355,6 +535,8 @@ int main(int argc, char** argv) {
 
     delete camera;
 
+    mcc::gl::QuadMesh::terminate();
+    mcc::gl::Mesh::terminate();
     mcc::gl::Debug::terminate();
 
     glfwDestroyWindow(win);
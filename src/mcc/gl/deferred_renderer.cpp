@@ -10,24 +10,98 @@
 using namespace mcc;
 using namespace mcc::gl;
 
+namespace {
+    // Functions shared by the passes which read the GBuffer, inserted after the #version line of their fragment shaders
+    const char* gbuffer_functions = R"(
+        uniform sampler2D depth_tex;
+        uniform sampler2D normal_tex;
+        uniform mat4 inv_projection;
+
+        // Inverse of encode_normal() in DeferredRenderer::get_opaque_fragment_shader()
+        vec3 decode_normal(vec2 e) {
+            vec2 f = e * 2.0 - 1.0;
+            vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+            float t = clamp(-n.z, 0.0, 1.0);
+            n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+            return normalize(n);
+        }
+
+        // The view space z and w of a point only depend on its depth, so the z coordinate is cheaper to get than the
+        // whole position
+        float get_view_z(vec2 uv) {
+            float ndc_z = texture(depth_tex, uv).r * 2.0 - 1.0;
+            vec2 zw = inv_projection[2].zw * ndc_z + inv_projection[3].zw;
+            return zw.x / zw.y;
+        }
+
+        vec3 get_view_position(vec2 uv) {
+            vec4 ndc = vec4(vec3(uv, texture(depth_tex, uv).r) * 2.0 - 1.0, 1.0);
+            vec4 position = inv_projection * ndc;
+            return position.xyz / position.w;
+        }
+
+        // Weight of a neighbour on the SSAO blur and upsampling, which falls off as its surface strays from the one of
+        // the pixel filtered, with view space depth z and normal
+        float get_bilateral_weight(float z, vec3 normal, vec2 uv) {
+            float dz = (get_view_z(uv) - z) / z;
+            float facing = max(dot(normal, decode_normal(texture(normal_tex, uv).rg)), 0.0);
+            return exp(-abs(dz) * 32.0) * pow(facing, 8.0);
+        }
+    )";
+
+    std::string with_gbuffer_functions(const char* fs, const std::string& defines = "") {
+        return std::string("#version 330 core\n") + defines + gbuffer_functions + fs;
+    }
+}
+
+const char* DeferredRenderer::get_opaque_fragment_shader() {
+    return R"(
+        #version 330 core
+
+        in vec3 frag_albedo;
+        in vec3 frag_normal;
+        in float frag_ao;
+
+        layout (location = 0) out vec4 albedo;
+        layout (location = 1) out vec2 normal;
+
+        // Octahedral encoding: projects the normal onto an octahedron, unfolds it into a square and maps it to [0, 1]^2
+        vec2 encode_normal(vec3 n) {
+            n /= abs(n.x) + abs(n.y) + abs(n.z);
+            vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+            return e * 0.5 + 0.5;
+        }
+
+        void main() {
+            albedo = vec4(frag_albedo, frag_ao);
+            normal = encode_normal(normalize(frag_normal));
+        }
+    )";
+}
+
 mcc::gl::DeferredRenderer::DeferredRenderer() {
     this->width = this->height = 0;
     this->wireframe = false;
     this->sky_color = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
     this->debug_rendering = false;
+    this->ssao_enabled = true;
 
     this->gbuffer.fbo = 0;
     this->gbuffer.albedo = 0;
-    this->gbuffer.position = 0;
     this->gbuffer.normal = 0;
     this->gbuffer.depth = 0;
 
+    this->ssao.width = this->ssao.height = 0;
     this->ssao.fbo = 0;
     this->ssao.color_buffer = 0;
     this->ssao.noise = 0;
 
     this->ssao_blur.fbo = 0;
     this->ssao_blur.color_buffer = 0;
+
+    this->oit.fbo = 0;
+    this->oit.accum = 0;
+    this->oit.revealage = 0;
 }
 
 mcc::gl::DeferredRenderer::DeferredRenderer(DeferredRenderer&& rhs) {
@@ -40,18 +114,19 @@ DeferredRenderer& mcc::gl::DeferredRenderer::operator=(DeferredRenderer&& rhs) {
     this->wireframe = rhs.wireframe;
     this->sky_color = rhs.sky_color;
     this->debug_rendering = rhs.debug_rendering;
+    this->ssao_enabled = rhs.ssao_enabled;
 
     this->gbuffer.fbo = rhs.gbuffer.fbo;
     this->gbuffer.albedo = rhs.gbuffer.albedo;
-    this->gbuffer.position = rhs.gbuffer.position;
     this->gbuffer.normal = rhs.gbuffer.normal;
     this->gbuffer.depth = rhs.gbuffer.depth;
     rhs.gbuffer.fbo = 0;
     rhs.gbuffer.albedo = 0;
-    rhs.gbuffer.position = 0;
     rhs.gbuffer.normal = 0;
     rhs.gbuffer.depth = 0;
 
+    this->ssao.width = rhs.ssao.width;
+    this->ssao.height = rhs.ssao.height;
     this->ssao.fbo = rhs.ssao.fbo;
     this->ssao.color_buffer = rhs.ssao.color_buffer;
     this->ssao.noise = rhs.ssao.noise;
@@ -67,6 +142,14 @@ DeferredRenderer& mcc::gl::DeferredRenderer::operator=(DeferredRenderer&& rhs) {
     rhs.ssao_blur.fbo = 0;
     rhs.ssao_blur.color_buffer = 0;
 
+    this->oit.fbo = rhs.oit.fbo;
+    this->oit.accum = rhs.oit.accum;
+    this->oit.revealage = rhs.oit.revealage;
+    this->oit.shader = std::move(rhs.oit.shader);
+    rhs.oit.fbo = 0;
+    rhs.oit.accum = 0;
+    rhs.oit.revealage = 0;
+
     this->ss_shader = std::move(rhs.ss_shader);
     this->ss_quad = std::move(rhs.ss_quad);
 
@@ -82,10 +165,6 @@ mcc::gl::DeferredRenderer::~DeferredRenderer() {
         glDeleteTextures(1, &this->gbuffer.albedo);
     }
 
-    if (this->gbuffer.position != 0) {
-        glDeleteTextures(1, &this->gbuffer.position);
-    }
-
     if (this->gbuffer.normal != 0) {
         glDeleteTextures(1, &this->gbuffer.normal);
     }
@@ -113,9 +192,36 @@ mcc::gl::DeferredRenderer::~DeferredRenderer() {
     if (this->ssao_blur.color_buffer != 0) {
         glDeleteTextures(1, &this->ssao_blur.color_buffer);
     }
+
+    if (this->oit.fbo != 0) {
+        glDeleteFramebuffers(1, &this->oit.fbo);
+    }
+
+    if (this->oit.accum != 0) {
+        glDeleteTextures(1, &this->oit.accum);
+    }
+
+    if (this->oit.revealage != 0) {
+        glDeleteTextures(1, &this->oit.revealage);
+    }
 }
 
-Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int width, int height) {
+Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int width, int height, int ssao_samples, int ssao_scale) {
+    // The samples are uploaded as an uniform array, which must fit in the fragment shader uniform storage
+    if (ssao_samples < 1 || ssao_samples > 128) {
+        std::stringstream ss;
+        ss << "mcc::gl::DeferredRenderer::create() failed:" << std::endl;
+        ss << "Invalid SSAO sample count '" << ssao_samples << "', must be between 1 and 128";
+        return Result<DeferredRenderer, std::string>::error(ss.str());
+    }
+
+    if (ssao_scale < 1) {
+        std::stringstream ss;
+        ss << "mcc::gl::DeferredRenderer::create() failed:" << std::endl;
+        ss << "Invalid SSAO scale '" << ssao_scale << "', must be at least 1";
+        return Result<DeferredRenderer, std::string>::error(ss.str());
+    }
+
     auto renderer = DeferredRenderer();
 
     renderer.width = width;
@@ -153,32 +259,26 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
 
     glGenTextures(1, &renderer.gbuffer.albedo);
     glBindTexture(GL_TEXTURE_2D, renderer.gbuffer.albedo);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, renderer.width, renderer.height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, renderer.width, renderer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); // Alpha stores baked ambient occlusion times the baked light
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer.gbuffer.albedo, 0);
 
-    glGenTextures(1, &renderer.gbuffer.position);
-    glBindTexture(GL_TEXTURE_2D, renderer.gbuffer.position);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, renderer.width, renderer.height, 0, GL_RGB, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, renderer.gbuffer.position, 0);
-
     glGenTextures(1, &renderer.gbuffer.normal);
     glBindTexture(GL_TEXTURE_2D, renderer.gbuffer.normal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, renderer.width, renderer.height, 0, GL_RGB, GL_FLOAT, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, renderer.width, renderer.height, 0, GL_RG, GL_UNSIGNED_SHORT, nullptr); // Octahedral encoded
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, renderer.gbuffer.normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, renderer.gbuffer.normal, 0);
 
+    // View space positions are reconstructed from the depth, so it is also sampled by the SSAO and composite passes
     glGenTextures(1, &renderer.gbuffer.depth);
     glBindTexture(GL_TEXTURE_2D, renderer.gbuffer.depth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, renderer.width, renderer.height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, renderer.width, renderer.height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, renderer.gbuffer.depth, 0);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -194,15 +294,20 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    // SSAO framebuffer and textures
+    // SSAO framebuffer and textures, at a fraction of the window resolution. The filters clamp their taps to the edges.
+    renderer.ssao.width = glm::max(1, renderer.width / ssao_scale);
+    renderer.ssao.height = glm::max(1, renderer.height / ssao_scale);
+
     glGenFramebuffers(1, &renderer.ssao.fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, renderer.ssao.fbo);
 
     glGenTextures(1, &renderer.ssao.color_buffer);
     glBindTexture(GL_TEXTURE_2D, renderer.ssao.color_buffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, renderer.width, renderer.height, 0, GL_RED, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, renderer.ssao.width, renderer.ssao.height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer.ssao.color_buffer, 0);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -219,7 +324,7 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
     // SSAO kernel
     std::uniform_real_distribution<float> random_floats(0.0f, 1.0f);
     std::default_random_engine generator;
-    renderer.ssao.samples.resize(64);
+    renderer.ssao.samples.resize(ssao_samples);
     for (int i = 0; i < renderer.ssao.samples.size(); ++i) {
         auto sample = glm::vec3(
             random_floats(generator) * 2.0 - 1.0,
@@ -259,9 +364,11 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
 
     glGenTextures(1, &renderer.ssao_blur.color_buffer);
     glBindTexture(GL_TEXTURE_2D, renderer.ssao_blur.color_buffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, renderer.width, renderer.height, 0, GL_RED, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, renderer.ssao.width, renderer.ssao.height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer.ssao_blur.color_buffer, 0);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -275,6 +382,40 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
         return Result<DeferredRenderer, std::string>::error(ss.str());
     }
 
+    // Transparency framebuffer and textures
+    glGenFramebuffers(1, &renderer.oit.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, renderer.oit.fbo);
+
+    glGenTextures(1, &renderer.oit.accum);
+    glBindTexture(GL_TEXTURE_2D, renderer.oit.accum);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, renderer.width, renderer.height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer.oit.accum, 0);
+
+    glGenTextures(1, &renderer.oit.revealage);
+    glBindTexture(GL_TEXTURE_2D, renderer.oit.revealage);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, renderer.width, renderer.height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, renderer.oit.revealage, 0);
+
+    // Transparent surfaces are depth tested against the opaque scene
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, renderer.gbuffer.depth, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        glDeleteFramebuffers(1, &renderer.oit.fbo);
+        renderer.oit.fbo = 0;
+
+        std::stringstream ss;
+        ss << "mcc::gl::DeferredRenderer::create() failed:" << std::endl;
+        ss << "Transparency framebuffer is not complete" << std::endl;
+        ss << "glCheckFramebufferStatus() didn't return GL_FRAMEBUFFER_COMPLETE";
+        return Result<DeferredRenderer, std::string>::error(ss.str());
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
     // SSAO shader
     renderer.ssao.shader = Shader::create(R"(
         #version 330 core
@@ -288,17 +429,11 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
             gl_Position = vec4(vert_pos, 0.0f, 1.0f);
             frag_uv = vert_uv;            
         }
-    )", R"(
-        #version 330 core
-
+    )", with_gbuffer_functions(R"(
         in vec2 frag_uv;
 
         out float frag_color;
-        
-        const int NUM_SAMPLES = 64;
 
-        uniform sampler2D position_tex;
-        uniform sampler2D normal_tex;
         uniform sampler2D noise_tex;
 
         uniform mat4 projection;
@@ -311,8 +446,14 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
         const float constrast = 1.1;
 
         void main() {
-            vec3 frag_pos = texture(position_tex, frag_uv).xyz;
-            vec3 normal = normalize(texture(normal_tex, frag_uv).xyz);
+            if (texture(depth_tex, frag_uv).r == 1.0) {
+                // Sky, nothing to occlude
+                frag_color = 1.0;
+                return;
+            }
+
+            vec3 frag_pos = get_view_position(frag_uv);
+            vec3 normal = decode_normal(texture(normal_tex, frag_uv).rg);
             vec3 random_vec = normalize(texture(noise_tex, frag_uv * noise_scale).xyz);
 
             vec3 tangent = normalize(random_vec - normal * dot(random_vec, normal));
@@ -328,7 +469,7 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
                 offset.xy /= offset.w;
                 offset.xy = offset.xy * 0.5 + 0.5;
                 
-                float sample_depth = texture(position_tex, offset.xy).z;
+                float sample_depth = get_view_z(offset.xy);
                 float range_check = smoothstep(0.0, 1.0, radius / abs(frag_pos.z - sample_depth));
                 occlusion += (sample_depth >= sample_pos.z + bias ? 1.0 : 0.0) * range_check;
             }
@@ -337,7 +478,7 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
             occlusion = pow(occlusion, magnitude);
             frag_color = constrast * (occlusion - 0.5) + 0.5;
         }
-    )").unwrap();
+    )", "#define NUM_SAMPLES " + std::to_string(ssao_samples) + "\n").c_str()).unwrap();
 
     // SSAO Blur shader
     renderer.ssao_blur.shader = Shader::create(R"(
@@ -352,27 +493,36 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
             gl_Position = vec4(vert_pos, 0.0f, 1.0f);
             frag_uv = vert_uv;            
         }
-    )", R"(
-        #version 330 core
-
+    )", with_gbuffer_functions(R"(
         in vec2 frag_uv;
 
         out float frag_color;
 
         uniform sampler2D ssao_tex;
+        uniform vec2 direction; // One SSAO texel along the blur axis
+
+        const int RADIUS = 4;
 
         void main() {
-            vec2 texel_size = 1.0 / vec2(textureSize(ssao_tex, 0));
-            float result = 0.0;
-            for (int x = -2; x < 2; ++x) {
-                for (int y = -2; y < 2; ++y) {
-                    vec2 offset = vec2(float(x), float(y)) * texel_size;
-                    result += texture(ssao_tex, frag_uv + offset).r;
+            float z = get_view_z(frag_uv);
+            vec3 normal = decode_normal(texture(normal_tex, frag_uv).rg);
+
+            float result = texture(ssao_tex, frag_uv).r;
+            float total = 1.0;
+            for (int i = -RADIUS; i <= RADIUS; ++i) {
+                if (i == 0) {
+                    continue;
                 }
+
+                // Gaussian falloff with sigma RADIUS / 2
+                vec2 uv = frag_uv + direction * float(i);
+                float weight = exp(-2.0 * float(i * i) / float(RADIUS * RADIUS)) * get_bilateral_weight(z, normal, uv);
+                result += texture(ssao_tex, uv).r * weight;
+                total += weight;
             }
-            frag_color = result / (4.0 * 4.0);
+            frag_color = result / total;
         }
-    )").unwrap();
+    )").c_str()).unwrap();
 
     // Prepare screen space shader
     renderer.ss_shader = Shader::create(R"(
@@ -387,9 +537,7 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
             gl_Position = vec4(vert_pos, 0.0f, 1.0f);
             frag_uv = vert_uv;
         }
-    )", R"(
-        #version 330 core
-
+    )", with_gbuffer_functions(R"(
         #define PI 3.1415926535897932384626433832795
 
         in vec2 frag_uv;
@@ -397,22 +545,53 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
         out vec4 frag_color;
 
         uniform sampler2D albedo_tex;
-        uniform sampler2D position_tex;
-        uniform sampler2D normal_tex;
         uniform sampler2D ssao_tex;
 
         uniform vec3 sky_color;
         uniform float z_far;
+        uniform bool ssao_enabled;
 
         uniform mat4 view;
 
         const vec3 world_light_dir = normalize(vec3(-0.7, 1.5, 0.5));
 
+        // Joint bilateral upsampling: bilinear over the 4 nearest SSAO texels, each weighted by how close its surface
+        // is to the one of the pixel, so that occlusion doesn't bleed across edges
+        float get_ssao(vec2 uv, float z, vec3 normal) {
+            vec2 size = vec2(textureSize(ssao_tex, 0));
+            vec2 coord = uv * size - 0.5;
+            vec2 base = floor(coord);
+            vec2 f = coord - base;
+
+            float result = 0.0, total = 0.0;
+            for (int i = 0; i < 4; ++i) {
+                vec2 offset = vec2(float(i & 1), float(i >> 1));
+                vec2 sample_uv = (base + offset + 0.5) / size;
+                vec2 bilinear = mix(1.0 - f, f, offset);
+                float weight = (bilinear.x * bilinear.y + 0.001) * get_bilateral_weight(z, normal, sample_uv);
+                result += texture(ssao_tex, sample_uv).r * weight;
+                total += weight;
+            }
+
+            // No texel lies on the same surface, e.g. on thin geometry, so fall back to the nearest one
+            return total > 0.0001 ? result / total : texture(ssao_tex, uv).r;
+        }
+
         void main() {
-            vec3 albedo = texture(albedo_tex, frag_uv).rgb;
-            vec3 position = texture(position_tex, frag_uv).xyz;
-            vec3 normal = texture(normal_tex, frag_uv).xyz;
-            float ambient_occlusion = texture(ssao_tex, frag_uv).r;
+            vec4 albedo_ao = texture(albedo_tex, frag_uv);
+            vec3 albedo = albedo_ao.rgb;
+            if (texture(depth_tex, frag_uv).r == 1.0f) {
+                // Sky, nothing was drawn here
+                frag_color = vec4(albedo, 1.0);
+                return;
+            }
+
+            vec3 position = get_view_position(frag_uv);
+            vec3 normal = decode_normal(texture(normal_tex, frag_uv).rg);
+            float ambient_occlusion = albedo_ao.a;
+            if (ssao_enabled) {
+                ambient_occlusion *= get_ssao(frag_uv, position.z, normal);
+            }
 
             vec3 lighting = albedo * ambient_occlusion * 0.3f;
             vec3 light_dir = normalize(mat3(view) * world_light_dir);
@@ -420,16 +599,46 @@ Result<DeferredRenderer, std::string> mcc::gl::DeferredRenderer::create(int widt
             vec3 diffuse = max(dot(normal, light_dir), 0.0f) * albedo * ambient_occlusion;
             lighting += diffuse;
 
-            if (normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f) {
-                // Sky
-                lighting = albedo;
-            }
-
             // Fog
             float depth = min(1.0f, length(position) / z_far);
             float fog = depth * depth;
             frag_color = vec4(mix(lighting, sky_color, fog), 1.0);
         }
+    )").c_str()).unwrap();
+
+    // Transparency composite shader
+    renderer.oit.shader = Shader::create(R"(
+        #version 330 core
+
+        layout (location = 0) in vec2 vert_pos;
+        layout (location = 1) in vec2 vert_uv;
+
+        out vec2 frag_uv;
+
+        void main() {
+            gl_Position = vec4(vert_pos, 0.0f, 1.0f);
+            frag_uv = vert_uv;
+        }
+    )", R"(
+        #version 330 core
+
+        in vec2 frag_uv;
+
+        out vec4 frag_color;
+
+        uniform sampler2D accum_tex;
+        uniform sampler2D revealage_tex;
+
+        void main() {
+            float revealage = texture(revealage_tex, frag_uv).r;
+            if (revealage >= 1.0f) {
+                discard; // No transparent surfaces here
+            }
+
+            vec4 accum = texture(accum_tex, frag_uv);
+            vec3 average_color = accum.rgb / clamp(accum.a, 1e-4f, 5e4f);
+            frag_color = vec4(average_color, 1.0f - revealage);
+        }
     )").unwrap();
 
     return Result<DeferredRenderer, std::string>::success(std::move(renderer));
@@ -443,6 +652,7 @@ void mcc::gl::DeferredRenderer::render(float dt, const ui::Camera& camera, const
     auto view = camera.get_view();
     auto proj = camera.get_projection();
     auto vp = proj * view;
+    auto inv_proj = glm::inverse(proj);
     
     // Opaque pass
     glBindFramebuffer(GL_FRAMEBUFFER, this->gbuffer.fbo);
@@ -451,59 +661,70 @@ void mcc::gl::DeferredRenderer::render(float dt, const ui::Camera& camera, const
     glDepthMask(GL_TRUE);
     glPolygonMode(GL_FRONT_AND_BACK, this->wireframe ? GL_LINE : GL_FILL);
 
-    // Clear framebuffer
-    GLuint draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    // Clear framebuffer. The normals are left as they are, since the sky is told apart by its depth.
+    GLuint draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
     glDrawBuffers(1, &draw_buffers[0]);
     glClearColor(sky_color.r, sky_color.g, sky_color.b, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glDrawBuffers(2, &draw_buffers[1]);
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glDrawBuffers(3, &draw_buffers[0]);
-    glClear(GL_DEPTH_BUFFER_BIT);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDrawBuffers(2, &draw_buffers[0]);
 
     // Draw opaque objects
     draw_opaque();
 
-    // SSAO pass
     ss_quad.va.bind();
     
     glDisable(GL_DEPTH_TEST);
     glDepthMask(GL_FALSE);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, this->ssao.fbo);
-    glDrawBuffers(1, &draw_buffers[0]);
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, this->gbuffer.position);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, this->gbuffer.normal);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, this->ssao.noise);
-
-    auto noise_scale = glm::vec2(float(this->width) / 4.0f, float(this->height) / 4.0f);
-
-    this->ssao.shader.bind();
-    glUniform1i(this->ssao.shader.get_uniform_location("position_tex").unwrap(), 0);
-    glUniform1i(this->ssao.shader.get_uniform_location("normal_tex").unwrap(), 1);
-    glUniform1i(this->ssao.shader.get_uniform_location("noise_tex").unwrap(), 2);
-    glUniform3fv(this->ssao.shader.get_uniform_location("samples").unwrap(), this->ssao.samples.size(), &this->ssao.samples[0][0]);
-    glUniform2fv(this->ssao.shader.get_uniform_location("noise_scale").unwrap(), 1, &noise_scale[0]);
-    glUniformMatrix4fv(this->ssao.shader.get_uniform_location("projection").unwrap(), 1, GL_FALSE, &proj[0][0]);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
 
-    // SSAO Blur pass
-    glBindFramebuffer(GL_FRAMEBUFFER, this->ssao_blur.fbo);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, this->ssao.color_buffer);
-
-    this->ssao_blur.shader.bind();
-    glUniform1i(this->ssao_blur.shader.get_uniform_location("ssao_tex").unwrap(), 0);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    if (this->ssao_enabled) {
+        // SSAO pass, at the SSAO resolution
+        glViewport(0, 0, this->ssao.width, this->ssao.height);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->ssao.fbo);
+        glDrawBuffers(1, &draw_buffers[0]);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, this->gbuffer.depth);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, this->gbuffer.normal);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, this->ssao.noise);
+
+        auto noise_scale = glm::vec2(float(this->ssao.width) / 4.0f, float(this->ssao.height) / 4.0f);
+
+        this->ssao.shader.bind();
+        glUniform1i(this->ssao.shader.get_uniform_location("depth_tex").unwrap(), 0);
+        glUniform1i(this->ssao.shader.get_uniform_location("normal_tex").unwrap(), 1);
+        glUniform1i(this->ssao.shader.get_uniform_location("noise_tex").unwrap(), 2);
+        glUniform3fv(this->ssao.shader.get_uniform_location("samples").unwrap(), this->ssao.samples.size(), &this->ssao.samples[0][0]);
+        glUniform2fv(this->ssao.shader.get_uniform_location("noise_scale").unwrap(), 1, &noise_scale[0]);
+        glUniformMatrix4fv(this->ssao.shader.get_uniform_location("projection").unwrap(), 1, GL_FALSE, &proj[0][0]);
+        glUniformMatrix4fv(this->ssao.shader.get_uniform_location("inv_projection").unwrap(), 1, GL_FALSE, &inv_proj[0][0]);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // SSAO Blur passes, horizontal and then vertical. The GBuffer depth and normals are still bound.
+        this->ssao_blur.shader.bind();
+        glUniform1i(this->ssao_blur.shader.get_uniform_location("depth_tex").unwrap(), 0);
+        glUniform1i(this->ssao_blur.shader.get_uniform_location("normal_tex").unwrap(), 1);
+        glUniform1i(this->ssao_blur.shader.get_uniform_location("ssao_tex").unwrap(), 2);
+        glUniformMatrix4fv(this->ssao_blur.shader.get_uniform_location("inv_projection").unwrap(), 1, GL_FALSE, &inv_proj[0][0]);
+        auto direction_loc = this->ssao_blur.shader.get_uniform_location("direction").unwrap();
+        glActiveTexture(GL_TEXTURE2);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, this->ssao_blur.fbo);
+        glBindTexture(GL_TEXTURE_2D, this->ssao.color_buffer);
+        glUniform2f(direction_loc, 1.0f / float(this->ssao.width), 0.0f);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, this->ssao.fbo);
+        glBindTexture(GL_TEXTURE_2D, this->ssao_blur.color_buffer);
+        glUniform2f(direction_loc, 0.0f, 1.0f / float(this->ssao.height));
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        glViewport(0, 0, this->width, this->height);
+    }
 
     // Screen quad rendering
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -511,28 +732,65 @@ void mcc::gl::DeferredRenderer::render(float dt, const ui::Camera& camera, const
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, this->gbuffer.albedo);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, this->gbuffer.position);
+    glBindTexture(GL_TEXTURE_2D, this->gbuffer.depth);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, this->gbuffer.normal);
     glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, this->ssao_blur.color_buffer);
+    glBindTexture(GL_TEXTURE_2D, this->ssao.color_buffer);
 
     this->ss_shader.bind();
     glUniform1i(this->ss_shader.get_uniform_location("albedo_tex").unwrap(), 0);
-    glUniform1i(this->ss_shader.get_uniform_location("position_tex").unwrap(), 1);
+    glUniform1i(this->ss_shader.get_uniform_location("depth_tex").unwrap(), 1);
     glUniform1i(this->ss_shader.get_uniform_location("normal_tex").unwrap(), 2);
     glUniform1i(this->ss_shader.get_uniform_location("ssao_tex").unwrap(), 3);
+    glUniform1i(this->ss_shader.get_uniform_location("ssao_enabled").unwrap(), this->ssao_enabled ? 1 : 0);
     glUniform3f(this->ss_shader.get_uniform_location("sky_color").unwrap(), this->sky_color.r, this->sky_color.g, this->sky_color.b);
     glUniform1f(this->ss_shader.get_uniform_location("z_far").unwrap(), camera.get_z_far());
     glUniformMatrix4fv(this->ss_shader.get_uniform_location("view").unwrap(), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(this->ss_shader.get_uniform_location("inv_projection").unwrap(), 1, GL_FALSE, &inv_proj[0][0]);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
+    // Transparent pass, accumulated without sorting
+    glBindFramebuffer(GL_FRAMEBUFFER, this->oit.fbo);
+    glDrawBuffers(2, &draw_buffers[0]);
+    GLfloat accum_clear[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    GLfloat revealage_clear[] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, accum_clear);
+    glClearBufferfv(GL_COLOR, 1, revealage_clear);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+    glPolygonMode(GL_FRONT_AND_BACK, this->wireframe ? GL_LINE : GL_FILL);
+
+    draw_transparent();
+
+    // Composite the transparent surfaces over the lit scene
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDisable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, this->oit.accum);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, this->oit.revealage);
+
+    ss_quad.va.bind();
+    this->oit.shader.bind();
+    glUniform1i(this->oit.shader.get_uniform_location("accum_tex").unwrap(), 0);
+    glUniform1i(this->oit.shader.get_uniform_location("revealage_tex").unwrap(), 1);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glDisable(GL_BLEND);
+
     // Debug draw on top of screen
     glBindFramebuffer(GL_READ_FRAMEBUFFER, this->gbuffer.fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
     glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
     if (debug_rendering) {
-        mcc::gl::Debug::flush(vp, 1 / 144.0f);
+        mcc::gl::Debug::flush(vp, dt);
     }
 
     glBindFramebuffer(GL_READ_FRAMEBUFFER, this->gbuffer.fbo);
@@ -541,8 +799,6 @@ void mcc::gl::DeferredRenderer::render(float dt, const ui::Camera& camera, const
     glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width / 2, this->height / 2, GL_COLOR_BUFFER_BIT, GL_NEAREST);
     glReadBuffer(GL_COLOR_ATTACHMENT1);
     glBlitFramebuffer(0, 0, this->width, this->height, this->width / 2, 0, this->width, this->height / 2, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-    glReadBuffer(GL_COLOR_ATTACHMENT2);
-    glBlitFramebuffer(0, 0, this->width, this->height, 0, this->height / 2, this->width / 2, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, this->ssao.fbo);
     glReadBuffer(GL_COLOR_ATTACHMENT0);
     glBlitFramebuffer(0, 0, this->width, this->height, this->width / 2, this->height / 2, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
@@ -21,29 +21,45 @@ namespace mcc::gl {
         DeferredRenderer& operator=(DeferredRenderer&& rhs);
         ~DeferredRenderer();
 
-        static Result<DeferredRenderer, std::string> create(int width, int height);
+        // SSAO takes ssao_samples samples per pixel, at the resolution of the window divided by ssao_scale. It is then
+        // blurred and upsampled with depth and normal aware filters, so that occlusion doesn't bleed across edges.
+        static Result<DeferredRenderer, std::string> create(int width, int height, int ssao_samples = 32, int ssao_scale = 2);
 
         void resize(int width, int height);
+        // draw_opaque writes to the GBuffer: albedo and ambient occlusion (location 0) and the octahedral encoded normal
+        // (location 1), as done by get_opaque_fragment_shader(). Positions are reconstructed from the depth buffer.
+        // draw_transparent is lit by its own shader and writes premultiplied color times weight (location 0)
+        // and alpha (location 1). It is composited over the lit scene, in any order.
         void render(float dt, const ui::Camera& camera, const std::function<void()>& draw_opaque, const std::function<void()>& draw_transparent);
 
         inline void set_debug_rendering(bool debug_rendering) { this->debug_rendering = debug_rendering; }
         inline void set_wireframe(bool wireframe) { this->wireframe = wireframe; }
         inline void set_sky_color(const glm::vec3& sky_color) { this->sky_color = sky_color; }
+        inline const glm::vec3& get_sky_color() const { return this->sky_color; }
+        // Enables or disables the SSAO and SSAO blur passes. The ambient occlusion stored on the albedo alpha channel is always applied.
+        inline void set_ssao(bool ssao) { this->ssao_enabled = ssao; }
+
+        // Returns the source of a fragment shader which writes opaque surfaces to the GBuffer.
+        // Inputs: frag_albedo, frag_normal (in view space) and frag_ao.
+        static const char* get_opaque_fragment_shader();
 
     private:
         int width, height;
         bool wireframe;
         bool debug_rendering;
+        bool ssao_enabled;
         glm::vec3 sky_color;
 
         Shader ss_shader;
 
+        // 12 bytes per pixel: RGBA8 albedo, RG16 normal and 24 bit depth
         struct {
             unsigned int fbo;
-            unsigned int albedo, position, normal, depth;
+            unsigned int albedo, normal, depth;
         } gbuffer;
 
         struct {
+            int width, height;
             unsigned int fbo;
             unsigned int color_buffer;
             unsigned int noise;
@@ -51,12 +67,20 @@ namespace mcc::gl {
             Shader shader;
         } ssao;
 
+        // Separable bilateral blur, horizontal into its color buffer and then vertical back into the SSAO color buffer
         struct {
             unsigned int fbo;
             unsigned int color_buffer;
             Shader shader;
         } ssao_blur;
 
+        // Weighted blended order independent transparency
+        struct {
+            unsigned int fbo;
+            unsigned int accum, revealage; // The depth buffer is shared with the GBuffer
+            Shader shader;
+        } oit;
+
         struct {
             VertexBuffer vb;
             VertexArray va;
@@ -7,17 +7,7 @@ using namespace mcc::gl;
 
 Result<IndexBuffer, std::string> IndexBuffer::create(size_t size, const void* data, Usage usage) {
     GLuint vbo;
-    GLenum gl_usage;
-
-    if (usage == Usage::Static) {
-        gl_usage = GL_STATIC_DRAW;
-    } else if (usage == Usage::Dynamic) {
-        gl_usage = GL_DYNAMIC_DRAW;
-    } else if (usage == Usage::Stream) {
-        gl_usage = GL_STREAM_DRAW;
-    } else {
-        std::abort(); // Unreachable code
-    }
+    GLenum gl_usage = to_gl_usage(usage);
 
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo);
@@ -37,10 +27,6 @@ IndexBuffer::IndexBuffer(unsigned int ibo) :
 }
 
 IndexBuffer::IndexBuffer(IndexBuffer&& rhs) {
-    if (this->ibo != 0) {
-        glDeleteBuffers(1, &this->ibo);
-    }
-
     this->ibo = rhs.ibo;
     rhs.ibo = 0;
 }
@@ -98,3 +84,34 @@ Result<void, std::string> IndexBuffer::update(size_t offset, size_t size, const
 void IndexBuffer::bind() const {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
 }
+
+Result<void, std::string> IndexBuffer::allocate(size_t size, const void* data, Usage usage) {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(size), data, to_gl_usage(usage));
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<void, std::string>::error(
+            "IndexBuffer::allocate() failed:\n"
+            "glGetError() returned '" + std::to_string(err) + "'"
+        );
+    }
+
+    return Result<void, std::string>::success();
+}
+
+Result<void, std::string> IndexBuffer::copy(const IndexBuffer& src, size_t src_offset, size_t offset, size_t size) {
+    glBindBuffer(GL_COPY_READ_BUFFER, src.ibo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, this->ibo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(src_offset), GLintptr(offset), GLsizeiptr(size));
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<void, std::string>::error(
+            "IndexBuffer::copy() failed:\n"
+            "glGetError() returned '" + std::to_string(err) + "'"
+        );
+    }
+
+    return Result<void, std::string>::success();
+}
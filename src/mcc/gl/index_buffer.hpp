@@ -16,6 +16,11 @@ namespace mcc::gl {
         static Result<IndexBuffer, std::string> create(size_t size, const void* data, Usage usage);
 
         Result<void, std::string> update(size_t offset, size_t size, const void* data);
+        // Replaces the buffer storage, keeping the same buffer object. The old storage is orphaned, so this doesn't
+        // wait for draws which are still using it. If data is nullptr, the new contents are undefined.
+        Result<void, std::string> allocate(size_t size, const void* data, Usage usage);
+        // Copies size bytes from another buffer, on the GPU.
+        Result<void, std::string> copy(const IndexBuffer& src, size_t src_offset, size_t offset, size_t size);
         Result<void*, std::string> map();
         void unmap();
         void bind() const;
@@ -0,0 +1,82 @@
+#include <mcc/gl/indirect_buffer.hpp>
+
+#include <GL/glew.h>
+
+using namespace mcc;
+using namespace mcc::gl;
+
+Result<IndirectBuffer, std::string> IndirectBuffer::create(size_t size, const void* data, Usage usage) {
+    GLuint ibo;
+
+    glGenBuffers(1, &ibo);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ibo);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, size, data, to_gl_usage(usage));
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<IndirectBuffer, std::string>::error("IndirectBuffer::create() failed:\nglGetError() returned " + std::to_string(err));
+    }
+
+    return Result<IndirectBuffer, std::string>::success(std::move(IndirectBuffer(ibo)));
+}
+
+IndirectBuffer::IndirectBuffer(unsigned int ibo) :
+    ibo(ibo) {
+    // Empty
+}
+
+IndirectBuffer::IndirectBuffer(IndirectBuffer&& rhs) {
+    this->ibo = rhs.ibo;
+    rhs.ibo = 0;
+}
+
+IndirectBuffer& IndirectBuffer::operator=(IndirectBuffer&& rhs) {
+    if (this->ibo != 0) {
+        glDeleteBuffers(1, &this->ibo);
+    }
+
+    this->ibo = rhs.ibo;
+    rhs.ibo = 0;
+
+    return *this;
+}
+
+IndirectBuffer::~IndirectBuffer() {
+    if (this->ibo != 0) {
+        glDeleteBuffers(1, &this->ibo);
+    }
+}
+
+Result<void, std::string> IndirectBuffer::update(size_t offset, size_t size, const void* data) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->ibo);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, GLintptr(offset), GLsizeiptr(size), data);
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<void, std::string>::error(
+            "IndirectBuffer::update() failed:\n"
+            "glGetError() returned '" + std::to_string(err) + "'"
+        );
+    }
+
+    return Result<void, std::string>::success();
+}
+
+Result<void, std::string> IndirectBuffer::allocate(size_t size, const void* data, Usage usage) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->ibo);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, GLsizeiptr(size), data, to_gl_usage(usage));
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<void, std::string>::error(
+            "IndirectBuffer::allocate() failed:\n"
+            "glGetError() returned '" + std::to_string(err) + "'"
+        );
+    }
+
+    return Result<void, std::string>::success();
+}
+
+void IndirectBuffer::bind() const {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->ibo);
+}
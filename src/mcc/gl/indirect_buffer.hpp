@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include <mcc/result.hpp>
+#include <mcc/gl/usage.hpp>
+
+namespace mcc::gl {
+    // Layout of the commands read by glMultiDrawElementsIndirect()
+    struct DrawElementsCommand {
+        unsigned int count;
+        unsigned int instance_count;
+        unsigned int first_index;
+        int base_vertex;
+        unsigned int base_instance;
+    };
+
+    class IndirectBuffer final {
+    public:
+        inline IndirectBuffer() : ibo(0) {}
+        IndirectBuffer(IndirectBuffer&& rhs);
+        IndirectBuffer& operator=(IndirectBuffer&& rhs);
+        ~IndirectBuffer();
+
+        static Result<IndirectBuffer, std::string> create(size_t size, const void* data, Usage usage);
+
+        Result<void, std::string> update(size_t offset, size_t size, const void* data);
+        // Replaces the buffer storage, keeping the same buffer object. The old storage is orphaned.
+        Result<void, std::string> allocate(size_t size, const void* data, Usage usage);
+        void bind() const;
+
+    private:
+        IndirectBuffer(unsigned int ibo);
+
+        unsigned int ibo;
+    };
+}
@@ -0,0 +1,274 @@
+#include <mcc/gl/light.hpp>
+
+#include <cstdint>
+#include <utility>
+
+using namespace mcc;
+using namespace mcc::gl;
+
+namespace {
+    enum Channel {
+        Sky,
+        Block,
+    };
+
+    // Directions are indexed as the borders, axis * 2 + side, so direction 2 is down (-Y)
+    const glm::ivec3 directions[6] = {
+        { -1, 0, 0 }, { 1, 0, 0 },
+        { 0, -1, 0 }, { 0, 1, 0 },
+        { 0, 0, -1 }, { 0, 0, 1 },
+    };
+
+    // Positions on the queues are packed as x | y << 8 | z << 16
+    inline uint32_t pack_position(glm::ivec3 p) {
+        return uint32_t(p.x) | (uint32_t(p.y) << 8) | (uint32_t(p.z) << 16);
+    }
+
+    inline glm::ivec3 unpack_position(uint32_t p) {
+        return { int(p & 0xFF), int((p >> 8) & 0xFF), int(p >> 16) };
+    }
+
+    // Level of the light which reaches the next voxel in a direction
+    inline int attenuate(int level, Channel channel, int direction) {
+        if (channel == Sky && direction == 2 && level == max_light_level) {
+            return level;
+        }
+        return level > 0 ? level - 1 : 0;
+    }
+
+    // Flood fill of a single light channel
+    struct Flood {
+        Flood(Matrix& matrix, Channel channel) : matrix(matrix), channel(channel) {
+            // Empty
+        }
+
+        inline bool is_inside(glm::ivec3 p) const {
+            return p.x >= 0 && p.y >= 0 && p.z >= 0 && p.x < this->matrix.size.x && p.y < this->matrix.size.y && p.z < this->matrix.size.z;
+        }
+
+        inline bool is_opaque(size_t index) const {
+            return this->matrix.palette[this->matrix.voxels[index]].color.a == 255;
+        }
+
+        inline int get_emission(size_t index) const {
+            return this->channel == Block ? int(this->matrix.palette[this->matrix.voxels[index]].emission) : 0;
+        }
+
+        inline int get(size_t index) const {
+            auto light = this->matrix.light[index];
+            return this->channel == Sky ? get_sky_light(light) : get_block_light(light);
+        }
+
+        inline void set(size_t index, int level) {
+            auto& light = this->matrix.light[index];
+            light = this->channel == Sky ? pack_light(level, get_block_light(light)) : pack_light(get_sky_light(light), level);
+        }
+
+        // Raises the voxels on the faces of the matrix to the light coming through its border layers
+        void seed_borders() {
+            auto& sz = this->matrix.size;
+            for (int border = 0; border < 6; ++border) {
+                auto& layer = this->matrix.light_borders[border];
+                if (layer.empty()) {
+                    continue;
+                }
+
+                int d = border / 2;
+                int u = (d + 1) % 3;
+                int v = (d + 2) % 3;
+                glm::ivec3 p;
+                p[d] = border % 2 ? sz[d] - 1 : 0;
+                for (p[v] = 0; p[v] < int(sz[v]); ++p[v]) {
+                    for (p[u] = 0; p[u] < int(sz[u]); ++p[u]) {
+                        auto index = this->matrix.get_index(p.x, p.y, p.z);
+                        if (this->is_opaque(index)) {
+                            continue;
+                        }
+
+                        // The light travels away from the border
+                        auto light = layer[p[v] * sz[u] + p[u]];
+                        int level = attenuate(this->channel == Sky ? get_sky_light(light) : get_block_light(light), this->channel, border ^ 1);
+                        if (level > this->get(index)) {
+                            this->set(index, level);
+                            this->queue.push_back(pack_position(p));
+                        }
+                    }
+                }
+            }
+        }
+
+        // Spreads the light of the queued voxels until it fades out
+        void flood() {
+            for (size_t head = 0; head < this->queue.size(); ++head) {
+                auto p = unpack_position(this->queue[head]);
+                int level = this->get(this->matrix.get_index(p.x, p.y, p.z));
+                if (level <= 1) {
+                    continue;
+                }
+
+                for (int dir = 0; dir < 6; ++dir) {
+                    auto q = p + directions[dir];
+                    if (!this->is_inside(q)) {
+                        continue;
+                    }
+
+                    auto index = this->matrix.get_index(q.x, q.y, q.z);
+                    int next = attenuate(level, this->channel, dir);
+                    if (!this->is_opaque(index) && this->get(index) < next) {
+                        this->set(index, next);
+                        this->queue.push_back(pack_position(q));
+                    }
+                }
+            }
+            this->queue.clear();
+        }
+
+        // Darkens the voxels which were lit by the removed voxels, which must have already been darkened.
+        // The brighter voxels found on the way are queued, so that flood() fills the darkened region back in.
+        void unflood() {
+            for (size_t head = 0; head < this->removed.size(); ++head) {
+                auto p = unpack_position(this->removed[head].first);
+                int level = this->removed[head].second;
+
+                for (int dir = 0; dir < 6; ++dir) {
+                    auto q = p + directions[dir];
+                    if (!this->is_inside(q)) {
+                        continue;
+                    }
+
+                    auto index = this->matrix.get_index(q.x, q.y, q.z);
+                    int neighbour = this->get(index);
+                    if (neighbour == 0) {
+                        continue;
+                    }
+
+                    if (neighbour < level || (neighbour == level && attenuate(level, this->channel, dir) == level)) {
+                        this->remove(q, index, neighbour);
+                    } else {
+                        this->queue.push_back(pack_position(q));
+                    }
+                }
+            }
+            this->removed.clear();
+        }
+
+        // Darkens a voxel which had the given level, down to its own emission
+        void remove(glm::ivec3 p, size_t index, int level) {
+            int emission = this->get_emission(index);
+            if (emission >= level) {
+                this->queue.push_back(pack_position(p));
+                return;
+            }
+
+            this->set(index, emission);
+            this->removed.push_back({ pack_position(p), level });
+            if (emission > 0) {
+                this->queue.push_back(pack_position(p));
+            }
+        }
+
+        Matrix& matrix;
+        Channel channel;
+        std::vector<uint32_t> queue;
+        std::vector<std::pair<uint32_t, int>> removed; // Removed voxels and their previous levels
+    };
+}
+
+void mcc::gl::propagate_light(Matrix& matrix) {
+    auto& sz = matrix.size;
+    matrix.light.assign(matrix.voxels.size(), 0);
+
+    for (auto channel : { Sky, Block }) {
+        Flood flood(matrix, channel);
+        if (channel == Block) {
+            for (int x = 0; x < sz.x; ++x) {
+                for (int y = 0; y < sz.y; ++y) {
+                    for (int z = 0; z < sz.z; ++z) {
+                        auto index = matrix.get_index(x, y, z);
+                        int emission = flood.get_emission(index);
+                        if (emission > 0) {
+                            flood.set(index, emission);
+                            flood.queue.push_back(pack_position({ x, y, z }));
+                        }
+                    }
+                }
+            }
+        }
+
+        flood.seed_borders();
+        flood.flood();
+    }
+}
+
+bool mcc::gl::set_light_border(Matrix& matrix, int border, const std::vector<unsigned char>& light) {
+    auto& sz = matrix.size;
+
+    std::vector<unsigned char> faces[6];
+    for (int i = 0; i < 6; ++i) {
+        get_face_light(matrix, i, faces[i]);
+    }
+
+    auto old = std::move(matrix.light_borders[border]);
+    matrix.light_borders[border] = light;
+
+    int d = border / 2;
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+
+    for (auto channel : { Sky, Block }) {
+        Flood flood(matrix, channel);
+        auto level_of = [&](const std::vector<unsigned char>& layer, int n) {
+            if (layer.empty()) {
+                return 0;
+            }
+            return attenuate(channel == Sky ? get_sky_light(layer[n]) : get_block_light(layer[n]), channel, border ^ 1);
+        };
+
+        // Remove the light of the voxels which were lit by the old layer and are now getting less
+        glm::ivec3 p;
+        p[d] = border % 2 ? sz[d] - 1 : 0;
+        for (p[v] = 0; p[v] < int(sz[v]); ++p[v]) {
+            for (p[u] = 0; p[u] < int(sz[u]); ++p[u]) {
+                int n = p[v] * sz[u] + p[u];
+                auto index = matrix.get_index(p.x, p.y, p.z);
+                int before = level_of(old, n);
+                if (before > 0 && level_of(light, n) < before && flood.get(index) == before && !flood.is_opaque(index)) {
+                    flood.remove(p, index, before);
+                }
+            }
+        }
+
+        flood.unflood();
+        flood.seed_borders();
+        flood.flood();
+    }
+
+    std::vector<unsigned char> face;
+    for (int i = 0; i < 6; ++i) {
+        get_face_light(matrix, i, face);
+        if (face != faces[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void mcc::gl::get_face_light(const Matrix& matrix, int border, std::vector<unsigned char>& light) {
+    auto& sz = matrix.size;
+    int d = border / 2;
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+
+    light.assign(size_t(sz[u]) * sz[v], 0);
+    if (matrix.light.empty()) {
+        return;
+    }
+
+    glm::ivec3 p;
+    p[d] = border % 2 ? sz[d] - 1 : 0;
+    for (p[v] = 0; p[v] < int(sz[v]); ++p[v]) {
+        for (p[u] = 0; p[u] < int(sz[u]); ++p[u]) {
+            light[p[v] * sz[u] + p[u]] = matrix.light[matrix.get_index(p.x, p.y, p.z)];
+        }
+    }
+}
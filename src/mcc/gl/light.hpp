@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include <mcc/gl/voxel.hpp>
+
+namespace mcc::gl {
+    /*
+        Voxel light, propagated on the CPU with a breadth first flood fill, as in Minecraft.
+        Each voxel has two 4 bit channels: sky light, which enters the matrix through its border layers, and block light,
+        emitted by the materials with a non-zero emission. Light loses one level per voxel crossed, except for full sky
+        light going down, which doesn't fade, so open shafts are lit all the way down. Opaque voxels block light, but
+        emissive voxels keep their own emission.
+    */
+    constexpr int max_light_level = 15;
+
+    inline unsigned char pack_light(int sky, int block) {
+        return (unsigned char)((sky << 4) | block);
+    }
+
+    inline int get_sky_light(unsigned char light) {
+        return light >> 4;
+    }
+
+    inline int get_block_light(unsigned char light) {
+        return light & 0xF;
+    }
+
+    // Computes the light of every voxel of a matrix from scratch, from its emissive materials and its light borders.
+    void propagate_light(Matrix& matrix);
+
+    // Replaces the light border at index border (see Matrix::borders) and updates the light incrementally: the light which
+    // came through the old layer is removed and the new layer is flooded in. The matrix must have been lit before.
+    // Returns true if the light of any voxel on the faces of the matrix changed, so that the neighbours must be updated.
+    bool set_light_border(Matrix& matrix, int border, const std::vector<unsigned char>& light);
+
+    // Gets the light of the voxels on a face of the matrix, laid out as the light border of the neighbour on that side.
+    void get_face_light(const Matrix& matrix, int border, std::vector<unsigned char>& light);
+}
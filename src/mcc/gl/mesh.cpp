@@ -1,37 +1,63 @@
 #include <mcc/gl/mesh.hpp>
 
-#include <functional>
-#include <stack>
-#include <chrono>
-
 #include <GL/glew.h>
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
 using namespace mcc;
 using namespace mcc::gl;
 
+VertexArray Mesh::format;
+
 Mesh::Mesh(Mesh&& rhs) {
-    this->va = std::move(rhs.va);
     this->vb = std::move(rhs.vb);
     this->ib = std::move(rhs.ib);
     this->opaque_count = rhs.opaque_count;
     this->transparent_count = rhs.transparent_count;
     this->transparent_offset = rhs.transparent_offset;
+    std::copy(std::begin(rhs.opaque_ranges), std::end(rhs.opaque_ranges), std::begin(this->opaque_ranges));
+    this->min = rhs.min;
+    this->max = rhs.max;
+    this->vb_capacity = rhs.vb_capacity;
+    this->ib_capacity = rhs.ib_capacity;
     rhs.opaque_count = 0;
     rhs.transparent_count = 0;
+    rhs.vb_capacity = 0;
+    rhs.ib_capacity = 0;
 }
 
 void Mesh::draw_opaque() const {
-    if (this->opaque_count > 0 && this->va_ready) {
-        this->va.bind();
-        this->ib.bind();
+    if (this->opaque_count > 0 && this->vb_capacity > 0) {
+        this->bind();
         glDrawElements(GL_TRIANGLES, this->opaque_count, GL_UNSIGNED_INT, nullptr);
     }
 }
 
+void Mesh::draw_opaque(const glm::vec3& camera_pos) const {
+    if (this->opaque_count > 0 && this->vb_capacity > 0) {
+        IndexRange ranges[3];
+        int count = get_visible_ranges(this->opaque_ranges, this->min, this->max, camera_pos, ranges);
+        if (count == 0) {
+            return;
+        }
+
+        this->bind();
+        for (int i = 0; i < count; ++i) {
+            glDrawElements(
+                GL_TRIANGLES,
+                GLsizei(ranges[i].end - ranges[i].begin),
+                GL_UNSIGNED_INT,
+                (const void*)(ranges[i].begin * sizeof(unsigned int))
+            );
+        }
+    }
+}
+
 void Mesh::draw_transparent() const {
-    if (this->transparent_count > 0 && this->va_ready) {
-        this->va.bind();
-        this->ib.bind();
+    if (this->transparent_count > 0 && this->vb_capacity > 0) {
+        this->bind();
         glDrawElements(
             GL_TRIANGLES,
             this->transparent_count,
@@ -41,366 +67,115 @@ void Mesh::draw_transparent() const {
     }
 }
 
-void mcc::gl::Mesh::generate_va() {
-    if (!this->va_ready) {
-        if (this->opaque_count > 0 || this->transparent_count > 0) {
-            this->va = gl::VertexArray::create({
-                gl::Attribute(
-                    this->vb,
-                    sizeof(Vertex), offsetof(Vertex, Vertex::pos),
-                    3, gl::Attribute::Type::F32,
-                    0
-                ),
-                gl::Attribute(
-                    this->vb,
-                    sizeof(Vertex), offsetof(Vertex, Vertex::normal),
-                    3, gl::Attribute::Type::F32,
-                    1
-                ),
-                gl::Attribute(
-                    this->vb,
-                    sizeof(Vertex), offsetof(Vertex, Vertex::color),
-                    4, gl::Attribute::Type::NU8,
-                    2
-                )
-            }).unwrap();
-        }
-
-        this->va_ready = true;
-    }
-}
-
-void Mesh::update(const Octree& octree, float root_sz, int lod, bool generate_borders, bool gen_va) {
-    auto begin = std::chrono::steady_clock::now();
-    
-    std::vector<Vertex> opaque_verts, transparent_verts;
-    std::vector<unsigned int> opaque_indices, transparent_indices;
-    std::stack<unsigned int> parents;
-
-    auto get_mat = [&](unsigned int vox_index) -> const Material& {
-        return octree.palette[octree.voxels[vox_index].material];
-    };
-
-    auto pos_to_index = [](glm::ivec3 pos) {
-        return pos.x * 4 + pos.y * 2 + pos.z;
-    };
-
-    auto get_rel_pos = [&](unsigned int parent, unsigned int index) {
-        return glm::ivec3(
-            (index - octree.voxels[parent].child) / 4,
-            ((index - octree.voxels[parent].child) % 4) / 2,
-            (index - octree.voxels[parent].child) % 2
-        );
-    };
-
-    // Gets the neighbour that is larger or equal to a voxel in a direction
-    std::function<unsigned int(unsigned int, glm::ivec3)> get_neighbour_be = [&](unsigned int index, glm::ivec3 dir) -> unsigned int {
-        // If root (octree border)
-        if (parents.empty()) {
-            return index;
-        }
-
-        int parent = parents.top();
-
-        // Neighbour has the same parent
-        auto rel_pos = get_rel_pos(parent, index);
-        auto neighbour_pos = rel_pos + dir;
-        if (neighbour_pos.x >= 0 && neighbour_pos.x <= 1 &&
-            neighbour_pos.y >= 0 && neighbour_pos.y <= 1 &&
-            neighbour_pos.z >= 0 && neighbour_pos.z <= 1) {
-            return octree.voxels[parent].child + pos_to_index(neighbour_pos);
-        }
-        
-        parents.pop();
-        unsigned int parent_neighbour = get_neighbour_be(parent, dir);
-        parents.push(parent);
-
-        // Octree border
-        if (parent_neighbour == parent) {
-            return index;
-        }
-        // If parent neighbour is leaf
-        else if (octree.voxels[parent_neighbour].child == 0) {
-            return parent_neighbour;
-        }
-
-        return octree.voxels[parent_neighbour].child + pos_to_index(glm::abs(neighbour_pos % 2));
-    };
-
-    std::function<void(unsigned int, glm::vec3, float, int)> build = [&](unsigned int index, glm::vec3 pos, float sz, int lod) {
-        if (octree.voxels[index].child != 0 && lod != 0) {
-            // Subdivide
-            parents.push(index);
-            float w = sz / 2.0f;
-            for (int a = 0; a <= 1; ++a) {
-                for (int b = 0; b <= 1; ++b) {
-                    for (int c = 0; c <= 1; ++c) {
-                        build(
-                            octree.voxels[index].child + 4 * a + 2 * b + c,
-                            pos + glm::vec3(a, b, c) * (float)w,
-                            w,
-                            lod - 1
-                        );
-                    }
-                }
-            }
-            parents.pop();
-        }
-        else if (get_mat(index).color.a != 0) {
-            auto& mat = get_mat(index);
-            auto& verts = mat.color.a == 255 ? opaque_verts : transparent_verts;
-            auto& indices = mat.color.a == 255 ? opaque_indices : transparent_indices;
-
-            // For each axis
-            for (int axis = 0; axis < 3; ++axis) {
-                for (int side = 0; side <= 1; ++side) {
-                    glm::ivec3 q;
-                    q = { 0, 0, 0 };
-                    glm::vec3 t, u, v;
-                    t = u = v = { 0.0f, 0.0f, 0.0f };
-                    q[(axis + 0) % 3] = 1;
-                    t[(axis + 0) % 3] = sz;
-                    u[(axis + 1) % 3] = sz;
-                    v[(axis + 2) % 3] = sz;
-
-                    // Check neighbour
-                    auto neighbour = get_neighbour_be(index, side ? q : -q);
-                    bool visible = (get_mat(neighbour).color.a != 255 &&
-                                   octree.voxels[neighbour].material != octree.voxels[index].material) ||
-                                   octree.voxels[neighbour].child != 0 ||
-                                   (neighbour == index && generate_borders);
-
-                    if (visible) {
-                        auto vi = verts.size();
-                        verts.resize(vi + 4, { { 0.0f, 0.0f, 0.0f }, side ? q : -q, mat.color });
-                        verts[vi + 0].pos = pos + t * (float)side;
-                        verts[vi + 1].pos = pos + t * (float)side + u;
-                        verts[vi + 2].pos = pos + t * (float)side + u + v;
-                        verts[vi + 3].pos = pos + t * (float)side + v;
-
-                        auto ii = indices.size();
-                        indices.resize(ii + 6);
-                        if (side) {
-                            indices[ii + 0] = vi + 0;
-                            indices[ii + 1] = vi + 1;
-                            indices[ii + 2] = vi + 2;
-                            indices[ii + 3] = vi + 2;
-                            indices[ii + 4] = vi + 3;
-                            indices[ii + 5] = vi + 0;
-                        }
-                        else {
-                            indices[ii + 0] = vi + 0;
-                            indices[ii + 1] = vi + 2;
-                            indices[ii + 2] = vi + 1;
-                            indices[ii + 3] = vi + 3;
-                            indices[ii + 4] = vi + 2;
-                            indices[ii + 5] = vi + 0;                      
-                        }
-                    }
-                }
-            }
-        }
+Result<VertexArray, std::string> mcc::gl::Mesh::create_format(bool offsets) {
+    std::vector<gl::AttributeFormat> attributes = {
+        gl::AttributeFormat(0, offsetof(Vertex, Vertex::pos), 3, gl::Attribute::Type::F32, 0),
+        gl::AttributeFormat(0, offsetof(Vertex, Vertex::normal), 3, gl::Attribute::Type::F32, 1),
+        gl::AttributeFormat(0, offsetof(Vertex, Vertex::color), 4, gl::Attribute::Type::NU8, 2),
+        gl::AttributeFormat(0, offsetof(Vertex, Vertex::ao), 1, gl::Attribute::Type::NU8, 3),
+        gl::AttributeFormat(0, offsetof(Vertex, Vertex::light), 2, gl::Attribute::Type::U8, 5),
     };
 
-    build(0, glm::vec3(0.0f, 0.0f, 0.0f), root_sz, lod);
-
-    for (auto& i : transparent_indices) {
-        i += opaque_verts.size();
+    if (offsets) {
+        attributes.push_back(gl::AttributeFormat(1, 0, 3, gl::Attribute::Type::F32, 4, 1));
     }
 
-    opaque_verts.insert(opaque_verts.end(), transparent_verts.begin(), transparent_verts.end());
-    
-    auto end = std::chrono::steady_clock::now();
-    auto t = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-    //std::cout << "Octree meshing time: " << t << "us" << std::endl;
-    //std::cout << opaque_verts.size() << " vertices, " << (opaque_indices.size() + transparent_indices.size()) << " indices" << std::endl;
-
-    this->update(opaque_verts, opaque_indices, transparent_indices, gen_va);
+    return gl::VertexArray::create_format(attributes);
 }
 
-void Mesh::update(const Matrix& matrix, float vx_sz, bool generate_borders, bool gen_va) {
-    auto begin = std::chrono::steady_clock::now();
-    
-    std::vector<Vertex> opaque_verts, transparent_verts;
-    std::vector<unsigned int> opaque_indices, transparent_indices;
-    std::vector<unsigned char> mask;
-
-    auto& sz = matrix.size;
-
-    auto get_mat = [&] (unsigned int vox_index) -> const Material& {
-        return matrix.palette[matrix.voxels[vox_index]];
-    };
-
-    // For both back and front faces
-    bool back_face = true;
-    do {
-        back_face = !back_face;
-
-        // For each axis
-        for (int d = 0; d < 3; ++d) {
-            int u = (d + 1) % 3;
-            int v = (d + 2) % 3;
-
-            glm::ivec3 x = { 0, 0, 0 }, q = { 0, 0, 0 };
-            q[d] = 1;
-            mask.resize(sz[u] * sz[v]);
-
-            for (x[d] = -1; x[d] < int(sz[d]);) {
-                int n = 0;              
-
-                // Create mask
-                if (generate_borders) {
-                    for (x[v] = 0; x[v] < int(sz[v]); ++x[v]) {
-                        for (x[u] = 0; x[u] < int(sz[u]); ++x[u]) {
-                            if (x[d] < 0) {
-                                mask[n++] = back_face ?
-                                            matrix.voxels[(x.x + q.x) * sz.y * sz.z + (x.y + q.y) * sz.z + (x.z + q.z)] :
-                                            0;
-                            } else if (x[d] == int(sz[d]) - 1) {
-                                mask[n++] = back_face ? 
-                                            0 :
-                                            matrix.voxels[x.x * sz.y * sz.z + x.y * sz.z + x.z];
-                            } else if (get_mat(x.x * sz.y * sz.z + x.y * sz.z + x.z).color.a != 255 ||
-                                       get_mat((x.x + q.x) * sz.y * sz.z + (x.y + q.y) * sz.z + (x.z + q.z)).color.a != 255) {
-                                mask[n++] = back_face ?
-                                            matrix.voxels[(x.x + q.x) * sz.y * sz.z + (x.y + q.y) * sz.z + (x.z + q.z)] :
-                                            matrix.voxels[x.x * sz.y * sz.z + x.y * sz.z + x.z];
-                            } else {
-                                mask[n++] = 0;
-                            }
-                        }
-                    }
-                } else {
-                    for (x[v] = 0; x[v] < int(sz[v]); ++x[v]) {
-                        for (x[u] = 0; x[u] < int(sz[u]); ++x[u]) {
-                            if (x[d] >= 0 && x[d] < int(sz[d]) - 1 &&
-                                get_mat(x.x * sz.y * sz.z + x.y * sz.z + x.z).color.a != 255 ||
-                                get_mat((x.x + q.x) * sz.y * sz.z + (x.y + q.y) * sz.z + (x.z + q.z)).color.a != 255) {
-                                mask[n++] = back_face ?
-                                            matrix.voxels[(x.x + q.x) * sz.y * sz.z + (x.y + q.y) * sz.z + (x.z + q.z)] :
-                                            matrix.voxels[x.x * sz.y * sz.z + x.y * sz.z + x.z];
-                            } else {
-                                mask[n++] = 0;
-                            }
-                        }
-                    }
-                }               
-                
-                ++x[d];
-                n = 0;
-
-                // Generate mesh from mask
-                for (int j = 0; j < int(sz[v]); ++j) {
-                    for (int i = 0; i < int(sz[u]);) {
-                        if (mask[n] != 0) {
-                            int w, h;
-                            for (w = 1; i + w < int(sz[u]) && mask[n + w] == mask[n]; ++w);
-                            bool done = false;
-                            for (h = 1; j + h < int(sz[v]); ++h) {
-                                for (int k = 0; k < w; ++k) {
-                                    if (mask[n + k + h * sz[u]] == 0 || mask[n + k + h * sz[u]] != mask[n]) {
-                                        done = true;
-                                        break;
-                                    }
-                                }
-
-                                if (done) {
-                                    break;
-                                }
-                            }
-
-                            if (mask[n] != 0) {
-                                auto& verts = matrix.palette[mask[n]].color.a == 255 ? opaque_verts : transparent_verts;
-                                auto& indices = matrix.palette[mask[n]].color.a == 255 ? opaque_indices : transparent_indices;
-
-                                x[u] = i;
-                                x[v] = j;
-
-                                glm::ivec3 du = { 0, 0, 0 }, dv = { 0, 0, 0 };
-                                du[u] = w;
-                                dv[v] = h;
-                                
-                                auto vi = verts.size();
-                                verts.resize(vi + 4, { { 0.0f, 0.0f, 0.0f }, back_face ? -q : q, matrix.palette[mask[n]].color });
-                                verts[vi + 0].pos = glm::vec3(x) * vx_sz;
-                                verts[vi + 1].pos = glm::vec3(x + du) * vx_sz;
-                                verts[vi + 2].pos = glm::vec3(x + du + dv) * vx_sz;
-                                verts[vi + 3].pos = glm::vec3(x + dv) * vx_sz;
+void mcc::gl::Mesh::init() {
+    Mesh::format = Mesh::create_format(false).unwrap();
+}
 
-                                auto ii = indices.size();
-                                indices.resize(ii + 6);
-                                if (back_face) {
-                                    indices[ii + 0] = int(vi) + 0;
-                                    indices[ii + 1] = int(vi) + 2;
-                                    indices[ii + 2] = int(vi) + 1;
-                                    indices[ii + 3] = int(vi) + 3;
-                                    indices[ii + 4] = int(vi) + 2;
-                                    indices[ii + 5] = int(vi) + 0;                              
-                                } else {
-                                    indices[ii + 0] = int(vi) + 0;
-                                    indices[ii + 1] = int(vi) + 1;
-                                    indices[ii + 2] = int(vi) + 2;
-                                    indices[ii + 3] = int(vi) + 2;
-                                    indices[ii + 4] = int(vi) + 3;
-                                    indices[ii + 5] = int(vi) + 0;
-                                }                          
-                            }
+void mcc::gl::Mesh::terminate() {
+    Mesh::format = VertexArray();
+}
 
-                            for (int l = 0; l < h; ++l) {
-                                for (int k = 0; k < w; ++k) {
-                                    mask[n + k + l * sz[u]] = 0;
-                                }
-                            }
+const VertexArray& mcc::gl::Mesh::get_format() {
+    return Mesh::format;
+}
 
-                            i += w;
-                            n += w;
-                        } else {
-                            ++i;
-                            ++n;
-                        }
-                    }
-                }
-            }
-        }
-    } while(back_face != true);
+void Mesh::bind() const {
+    auto& format = Mesh::get_format();
+    format.bind();
+    format.bind_buffer(0, this->vb, 0, sizeof(Vertex));
+    this->ib.bind();
+}
 
-    for (auto& i : transparent_indices) {
-        i += opaque_verts.size();
-    }
+void Mesh::update(const Octree& octree, float root_sz, int lod, bool generate_borders) {
+    MeshData data;
+    mesh_octree(octree, root_sz, lod, generate_borders, data);
+    this->update(data);
+}
 
-    opaque_verts.insert(opaque_verts.end(), transparent_verts.begin(), transparent_verts.end());
-    
-    auto end = std::chrono::steady_clock::now();
-    auto t = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-    //std::cout << "Matrix meshing time: " << t << "us" << std::endl;
-    //std::cout << opaque_verts.size() << " vertices, " << (opaque_indices.size() + transparent_indices.size()) << " indices" << std::endl;
+void Mesh::update(const Matrix& matrix, float vx_sz, bool generate_borders, bool bake_ao, ThreadPool* pool) {
+    MeshData data;
+    mesh_matrix(matrix, vx_sz, generate_borders, bake_ao, data, pool);
+    this->update(data);
+}
 
-    this->update(opaque_verts, opaque_indices, transparent_indices, gen_va);
+void mcc::gl::Mesh::update(const MeshData& data) {
+    this->update(data.vertices, data.opaque_indices, data.transparent_indices);
+    std::copy(std::begin(data.opaque_ranges), std::end(data.opaque_ranges), std::begin(this->opaque_ranges));
+    this->min = data.min;
+    this->max = data.max;
 }
 
 void mcc::gl::Mesh::update(
     const std::vector<Vertex>& vertices,
     const std::vector<unsigned int>& opaque_indices,
-    const std::vector<unsigned int>& transparent_indices,
-    bool gen_va
+    const std::vector<unsigned int>& transparent_indices
 ) {
-    this->opaque_count = opaque_indices.size();
-    this->transparent_count = transparent_indices.size();
-    this->transparent_offset = transparent_indices.size();
+    this->opaque_count = int(opaque_indices.size());
+    this->transparent_count = int(transparent_indices.size());
+    this->transparent_offset = int(opaque_indices.size());
 
-    if (this->opaque_count > 0 || this->transparent_count > 0) {
-        // Create index buffer
-        auto indices = opaque_indices;
-        indices.insert(indices.end(), opaque_indices.begin(), opaque_indices.end());
-        this->ib = gl::IndexBuffer::create(indices.size() * sizeof(unsigned int), indices.data(), gl::Usage::Static).unwrap();
+    // A single range with infinite bounds is never skipped
+    for (int i = 0; i <= face_direction_count; ++i) {
+        this->opaque_ranges[i] = i == 0 ? 0 : (unsigned int)opaque_indices.size();
+    }
+    this->min = glm::vec3(-INFINITY);
+    this->max = glm::vec3(INFINITY);
 
-        // Create vertex buffer
-        this->vb = gl::VertexBuffer::create(vertices.size() * sizeof(Vertex), vertices.data(), gl::Usage::Static).unwrap();
+    if (this->opaque_count == 0 && this->transparent_count == 0) {
+        return; // Keep the buffers, they may be reused by the next update
+    }
 
-        // Create vertex array
-        this->va_ready = false;
-        if (gen_va) {
-            this->generate_va();
+    // Returns the new capacity of a buffer, or 0 if the current one is large enough
+    auto grow = [](size_t capacity, size_t size) -> size_t {
+        if (size <= capacity) {
+            return 0;
         }
+        return std::max(size, capacity + capacity / 2);
+    };
+
+    // Update vertex buffer
+    size_t vb_size = vertices.size() * sizeof(Vertex);
+    size_t vb_capacity = grow(this->vb_capacity, vb_size);
+    if (this->vb_capacity == 0) {
+        this->vb = gl::VertexBuffer::create(vb_capacity, nullptr, gl::Usage::Dynamic).unwrap();
+        this->vb_capacity = vb_capacity;
+    } else if (vb_capacity != 0) {
+        this->vb.allocate(vb_capacity, nullptr, gl::Usage::Dynamic).unwrap();
+        this->vb_capacity = vb_capacity;
+    }
+    this->vb.update(0, vb_size, vertices.data()).unwrap();
+
+    // Update index buffer, the transparent indices are stored after the opaque ones
+    size_t opaque_size = opaque_indices.size() * sizeof(unsigned int);
+    size_t transparent_size = transparent_indices.size() * sizeof(unsigned int);
+    size_t ib_capacity = grow(this->ib_capacity, opaque_size + transparent_size);
+    if (this->ib_capacity == 0) {
+        this->ib = gl::IndexBuffer::create(ib_capacity, nullptr, gl::Usage::Dynamic).unwrap();
+        this->ib_capacity = ib_capacity;
+    } else if (ib_capacity != 0) {
+        this->ib.allocate(ib_capacity, nullptr, gl::Usage::Dynamic).unwrap();
+        this->ib_capacity = ib_capacity;
+    }
+    if (opaque_size > 0) {
+        this->ib.update(0, opaque_size, opaque_indices.data()).unwrap();
+    }
+    if (transparent_size > 0) {
+        this->ib.update(opaque_size, transparent_size, transparent_indices.data()).unwrap();
     }
 }
@@ -7,13 +7,9 @@
 #include <mcc/gl/vertex_buffer.hpp>
 #include <mcc/gl/index_buffer.hpp>
 #include <mcc/gl/voxel.hpp>
+#include <mcc/gl/mesher.hpp>
 
 namespace mcc::gl {
-    struct Vertex {
-        glm::vec3 pos, normal;
-        glm::u8vec4 color;
-    };
-
     class Mesh final {
     public:
         Mesh() = default;
@@ -22,25 +18,49 @@ namespace mcc::gl {
         ~Mesh() = default;
 
         void draw_opaque() const;
+        // Skips the face directions which face away from the camera. The position is on the mesh's space.
+        void draw_opaque(const glm::vec3& camera_pos) const;
         void draw_transparent() const;
 
-        void update(const Octree& octree, float root_sz, int lod = -1, bool generate_borders = true, bool gen_va = true);
-        void update(const Matrix& matrix, float vx_sz, bool generate_borders = true, bool gen_va = true);
+        void update(const Octree& octree, float root_sz, int lod = -1, bool generate_borders = true);
+        void update(
+            const Matrix& matrix,
+            float vx_sz,
+            bool generate_borders = true,
+            bool bake_ao = false,
+            ThreadPool* pool = nullptr
+        );
+        void update(const MeshData& data);
+        // Uploads new geometry. The buffers are reused when they are large enough, and grow geometrically otherwise.
+        // The opaque faces aren't grouped by direction, so draw_opaque() never skips them.
         void update(
             const std::vector<Vertex>& vertices,
             const std::vector<unsigned int>& opaque_indices,
-            const std::vector<unsigned int>& transparent_indices,
-            bool gen_va = true
+            const std::vector<unsigned int>& transparent_indices
         );
 
-        void generate_va();
+        // Creates a format-only vertex array which reads Vertex structs from binding point 0.
+        // If offsets is true, a per instance vec3 is read from binding point 1 into location 4.
+        static Result<VertexArray, std::string> create_format(bool offsets);
+        // Creates and destroys the vertex array shared by every mesh. Must be called while the GL context is current,
+        // before drawing any mesh and before the context is destroyed, respectively.
+        static void init();
+        static void terminate();
+        // Returns the vertex array shared by every mesh.
+        static const VertexArray& get_format();
 
     private:
-        gl::VertexArray va;
+        static VertexArray format;
+
+        // Binds the shared vertex array, with this mesh's buffers
+        void bind() const;
+
         gl::VertexBuffer vb;
         gl::IndexBuffer ib; 
         
-        bool va_ready = false;
-        int opaque_count, transparent_count, transparent_offset;
+        int opaque_count = 0, transparent_count = 0, transparent_offset = 0;
+        unsigned int opaque_ranges[face_direction_count + 1] = {};
+        glm::vec3 min = { 0.0f, 0.0f, 0.0f }, max = { 0.0f, 0.0f, 0.0f };
+        size_t vb_capacity = 0, ib_capacity = 0; // Buffer sizes in bytes
     };
 }
\ No newline at end of file
@@ -0,0 +1,419 @@
+#include <mcc/gl/mesh_arena.hpp>
+#include <mcc/gl/mesh.hpp>
+
+#include <GL/glew.h>
+
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+
+using namespace mcc;
+using namespace mcc::gl;
+
+mcc::gl::MeshArena::MeshArena(size_t page_vertices, size_t page_indices)
+    : page_vertices(page_vertices), page_indices(page_indices) {
+    // Empty
+}
+
+bool mcc::gl::MeshArena::reserve(FreeList& list, size_t size, size_t& offset) {
+    for (auto it = list.begin(); it != list.end(); ++it) {
+        if (it->second >= size) {
+            offset = it->first;
+            size_t remaining = it->second - size;
+            list.erase(it);
+            if (remaining > 0) {
+                list.emplace(offset + size, remaining);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void mcc::gl::MeshArena::release(FreeList& list, size_t offset, size_t size) {
+    auto it = list.emplace(offset, size).first;
+
+    // Merge with the next block
+    auto next = std::next(it);
+    if (next != list.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        list.erase(next);
+    }
+
+    // Merge with the previous block
+    if (it != list.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            list.erase(it);
+        }
+    }
+}
+
+Result<int, std::string> mcc::gl::MeshArena::create_page(size_t vertex_capacity, size_t index_capacity) {
+    // The batch buffers and the vertex format are shared by every page
+    if (this->batch_capacity == 0) {
+        auto format = Mesh::create_format(true);
+        if (format.is_error()) {
+            return Result<int, std::string>::error("mcc::gl::MeshArena::create_page() failed:\n" + format.get_error());
+        }
+        auto offsets = VertexBuffer::create(1024 * sizeof(glm::vec3), nullptr, Usage::Stream);
+        if (offsets.is_error()) {
+            return Result<int, std::string>::error("mcc::gl::MeshArena::create_page() failed:\n" + offsets.get_error());
+        }
+        auto commands = IndirectBuffer::create(1024 * sizeof(DrawElementsCommand), nullptr, Usage::Stream);
+        if (commands.is_error()) {
+            return Result<int, std::string>::error("mcc::gl::MeshArena::create_page() failed:\n" + commands.get_error());
+        }
+        this->offsets = std::move(offsets).unwrap();
+        this->commands = std::move(commands).unwrap();
+        this->format = std::move(format).unwrap();
+        this->batch_capacity = 1024;
+    }
+
+    auto page = std::make_unique<Page>();
+
+    auto vb = VertexBuffer::create(vertex_capacity * sizeof(Vertex), nullptr, Usage::Dynamic);
+    if (vb.is_error()) {
+        return Result<int, std::string>::error("mcc::gl::MeshArena::create_page() failed:\n" + vb.get_error());
+    }
+    page->vb = std::move(vb).unwrap();
+
+    auto ib = IndexBuffer::create(index_capacity * sizeof(unsigned int), nullptr, Usage::Dynamic);
+    if (ib.is_error()) {
+        return Result<int, std::string>::error("mcc::gl::MeshArena::create_page() failed:\n" + ib.get_error());
+    }
+    page->ib = std::move(ib).unwrap();
+
+    page->vertex_capacity = vertex_capacity;
+    page->index_capacity = index_capacity;
+    page->free_vertices.emplace(0, vertex_capacity);
+    page->free_indices.emplace(0, index_capacity);
+    page->allocation_count = 0;
+
+    // Reuse released page indices
+    for (int i = 0; i < int(this->pages.size()); ++i) {
+        if (this->pages[i] == nullptr) {
+            this->pages[i] = std::move(page);
+            return Result<int, std::string>::success(std::move(i));
+        }
+    }
+
+    this->pages.push_back(std::move(page));
+    return Result<int, std::string>::success(int(this->pages.size()) - 1);
+}
+
+Result<MeshArena::Handle, std::string> mcc::gl::MeshArena::allocate(const MeshData& data) {
+    size_t vertex_count = data.vertices.size();
+    size_t index_count = data.opaque_indices.size() + data.transparent_indices.size();
+    if (vertex_count == 0 || index_count == 0) {
+        return Result<Handle, std::string>::success(Handle(Invalid));
+    }
+
+    // Find a page with enough space for both the vertices and the indices
+    int page_index = -1;
+    size_t vertex_offset = 0, index_offset = 0;
+    for (int i = 0; i < int(this->pages.size()) && page_index == -1; ++i) {
+        auto& page = this->pages[i];
+        if (page == nullptr) {
+            continue;
+        }
+
+        if (reserve(page->free_vertices, vertex_count, vertex_offset)) {
+            if (reserve(page->free_indices, index_count, index_offset)) {
+                page_index = i;
+            } else {
+                release(page->free_vertices, vertex_offset, vertex_count);
+            }
+        }
+    }
+
+    if (page_index == -1) {
+        auto result = this->create_page(std::max(vertex_count, this->page_vertices), std::max(index_count, this->page_indices));
+        if (result.is_error()) {
+            std::stringstream ss;
+            ss << "mcc::gl::MeshArena::allocate() failed:" << std::endl;
+            ss << "Couldn't create page:" << std::endl;
+            ss << result.get_error();
+            return Result<Handle, std::string>::error(ss.str());
+        }
+        page_index = result.unwrap();
+
+        auto& page = this->pages[page_index];
+        reserve(page->free_vertices, vertex_count, vertex_offset);
+        reserve(page->free_indices, index_count, index_offset);
+    }
+
+    // Upload the mesh
+    auto& page = this->pages[page_index];
+    auto opaque_size = data.opaque_indices.size() * sizeof(unsigned int);
+    auto transparent_size = data.transparent_indices.size() * sizeof(unsigned int);
+    page->vb.update(vertex_offset * sizeof(Vertex), vertex_count * sizeof(Vertex), data.vertices.data()).unwrap();
+    if (opaque_size > 0) {
+        page->ib.update(index_offset * sizeof(unsigned int), opaque_size, data.opaque_indices.data()).unwrap();
+    }
+    if (transparent_size > 0) {
+        page->ib.update(index_offset * sizeof(unsigned int) + opaque_size, transparent_size, data.transparent_indices.data()).unwrap();
+    }
+    page->allocation_count += 1;
+
+    // Store the slice on a free slot
+    Slot slot;
+    slot.slice.page = page_index;
+    slot.slice.base_vertex = (unsigned int)vertex_offset;
+    slot.slice.vertex_count = (unsigned int)vertex_count;
+    slot.slice.first_index = (unsigned int)index_offset;
+    slot.slice.opaque_count = (unsigned int)data.opaque_indices.size();
+    slot.slice.transparent_count = (unsigned int)data.transparent_indices.size();
+    std::copy(std::begin(data.opaque_ranges), std::end(data.opaque_ranges), std::begin(slot.slice.opaque_ranges));
+    slot.slice.min = data.min;
+    slot.slice.max = data.max;
+    slot.live = true;
+
+    Handle handle;
+    if (this->free_slots.empty()) {
+        this->slots.push_back(slot);
+        handle = Handle(this->slots.size());
+    } else {
+        handle = this->free_slots.back();
+        this->free_slots.pop_back();
+        this->slots[handle - 1] = slot;
+    }
+
+    return Result<Handle, std::string>::success(std::move(handle));
+}
+
+void mcc::gl::MeshArena::free(Handle handle) {
+    if (handle == Invalid) {
+        return;
+    }
+
+    // Freeing a handle twice would release its ranges twice, corrupting the free lists
+    auto& slot = this->slots[handle - 1];
+    if (!slot.live) {
+        return;
+    }
+
+    auto& page = this->pages[slot.slice.page];
+    release(page->free_vertices, slot.slice.base_vertex, slot.slice.vertex_count);
+    release(page->free_indices, slot.slice.first_index, slot.slice.opaque_count + slot.slice.transparent_count);
+    page->allocation_count -= 1;
+
+    slot.live = false;
+    this->free_slots.push_back(handle);
+}
+
+void mcc::gl::MeshArena::bind(int page) const {
+    this->format.bind();
+    this->format.bind_buffer(0, this->pages[page]->vb, 0, sizeof(Vertex));
+    this->format.bind_buffer(1, this->offsets, 0, sizeof(glm::vec3));
+    this->pages[page]->ib.bind();
+}
+
+void mcc::gl::MeshArena::draw_opaque(const std::vector<Draw>& draws) {
+    this->draw_batch(draws, false, nullptr);
+}
+
+void mcc::gl::MeshArena::draw_opaque(const std::vector<Draw>& draws, const glm::vec3& camera_pos) {
+    this->draw_batch(draws, false, &camera_pos);
+}
+
+void mcc::gl::MeshArena::draw_transparent(const std::vector<Draw>& draws) {
+    this->draw_batch(draws, true, nullptr);
+}
+
+void mcc::gl::MeshArena::draw_batch(const std::vector<Draw>& draws, bool transparent, const glm::vec3* camera_pos) {
+    if (draws.empty()) {
+        return;
+    }
+
+    // Group the draws by page, keeping their order within each page. The instance of each command selects its offset.
+    this->draw_order.clear();
+    for (size_t i = 0; i < draws.size(); ++i) {
+        if (draws[i].handle == Invalid) {
+            continue;
+        }
+
+        auto& slice = this->get(draws[i].handle);
+        if ((transparent ? slice.transparent_count : slice.opaque_count) != 0) {
+            this->draw_order.emplace_back(slice.page, i);
+        }
+    }
+    std::sort(this->draw_order.begin(), this->draw_order.end());
+
+    this->offset_data.clear();
+    this->command_data.clear();
+    std::vector<std::pair<int, size_t>> page_ends; // Page and end of its commands
+
+    for (size_t d = 0; d < this->draw_order.size();) {
+        int p = this->draw_order[d].first;
+        for (; d < this->draw_order.size() && this->draw_order[d].first == p; ++d) {
+            auto& draw = draws[this->draw_order[d].second];
+            auto& slice = this->get(draw.handle);
+
+            // A command per visible run of face directions, all of them sharing the same offset
+            IndexRange ranges[3];
+            int range_count = 1;
+            if (transparent) {
+                ranges[0] = { slice.opaque_count, slice.opaque_count + slice.transparent_count };
+            } else if (camera_pos == nullptr) {
+                ranges[0] = { 0, slice.opaque_count };
+            } else {
+                range_count = get_visible_ranges(slice.opaque_ranges, slice.min, slice.max, *camera_pos - draw.offset, ranges);
+                if (range_count == 0) {
+                    continue;
+                }
+            }
+
+            for (int i = 0; i < range_count; ++i) {
+                DrawElementsCommand command;
+                command.count = ranges[i].end - ranges[i].begin;
+                command.instance_count = 1;
+                command.first_index = slice.first_index + ranges[i].begin;
+                command.base_vertex = int(slice.base_vertex);
+                command.base_instance = (unsigned int)this->offset_data.size();
+                this->command_data.push_back(command);
+            }
+            this->offset_data.push_back(draw.offset);
+        }
+
+        if (page_ends.empty() ? !this->command_data.empty() : page_ends.back().second != this->command_data.size()) {
+            page_ends.emplace_back(p, this->command_data.size());
+        }
+    }
+
+    if (this->command_data.empty()) {
+        return;
+    }
+
+    // Orphan the previous batch, so that uploading doesn't wait for the draws still reading it
+    if (this->command_data.size() > this->batch_capacity) {
+        this->batch_capacity = std::max(this->command_data.size(), this->batch_capacity + this->batch_capacity / 2);
+    }
+    this->offsets.allocate(this->batch_capacity * sizeof(glm::vec3), nullptr, Usage::Stream).unwrap();
+    this->offsets.update(0, this->offset_data.size() * sizeof(glm::vec3), this->offset_data.data()).unwrap();
+    this->commands.allocate(this->batch_capacity * sizeof(DrawElementsCommand), nullptr, Usage::Stream).unwrap();
+    this->commands.update(0, this->command_data.size() * sizeof(DrawElementsCommand), this->command_data.data()).unwrap();
+
+    size_t begin = 0;
+    for (auto& page_end : page_ends) {
+        this->bind(page_end.first);
+        this->commands.bind();
+        glMultiDrawElementsIndirect(
+            GL_TRIANGLES,
+            GL_UNSIGNED_INT,
+            (const void*)(begin * sizeof(DrawElementsCommand)),
+            GLsizei(page_end.second - begin),
+            0
+        );
+        begin = page_end.second;
+    }
+}
+
+Result<void, std::string> mcc::gl::MeshArena::defragment() {
+    for (int p = 0; p < int(this->pages.size()); ++p) {
+        auto& page = this->pages[p];
+        if (page == nullptr) {
+            continue;
+        }
+
+        if (page->allocation_count == 0) {
+            page = nullptr;
+            continue;
+        }
+
+        // Skip pages which are already compact
+        if (page->free_vertices.size() <= 1 && page->free_indices.size() <= 1 &&
+            (page->free_vertices.empty() || page->free_vertices.begin()->first + page->free_vertices.begin()->second == page->vertex_capacity) &&
+            (page->free_indices.empty() || page->free_indices.begin()->first + page->free_indices.begin()->second == page->index_capacity)) {
+            continue;
+        }
+
+        // Collect the slices on this page, in the order they are stored
+        std::vector<Slice*> slices;
+        for (auto& slot : this->slots) {
+            if (slot.live && slot.slice.page == p) {
+                slices.push_back(&slot.slice);
+            }
+        }
+        std::sort(slices.begin(), slices.end(), [](const Slice* lhs, const Slice* rhs) {
+            return lhs->base_vertex < rhs->base_vertex;
+        });
+
+        // Copy them to new buffers, packed together. The old buffers are deleted when replaced below.
+        auto vb = VertexBuffer::create(page->vertex_capacity * sizeof(Vertex), nullptr, Usage::Dynamic);
+        auto ib = IndexBuffer::create(page->index_capacity * sizeof(unsigned int), nullptr, Usage::Dynamic);
+        if (vb.is_error() || ib.is_error()) {
+            std::stringstream ss;
+            ss << "mcc::gl::MeshArena::defragment() failed:" << std::endl;
+            ss << "Couldn't create page buffers:" << std::endl;
+            ss << (vb.is_error() ? vb.get_error() : ib.get_error());
+            return Result<void, std::string>::error(ss.str());
+        }
+        auto new_vb = std::move(vb).unwrap();
+        auto new_ib = std::move(ib).unwrap();
+
+        size_t vertex_offset = 0, index_offset = 0;
+        for (auto slice : slices) {
+            size_t index_count = slice->opaque_count + slice->transparent_count;
+            auto vr = new_vb.copy(page->vb, slice->base_vertex * sizeof(Vertex), vertex_offset * sizeof(Vertex), slice->vertex_count * sizeof(Vertex));
+            auto ir = new_ib.copy(page->ib, slice->first_index * sizeof(unsigned int), index_offset * sizeof(unsigned int), index_count * sizeof(unsigned int));
+            if (vr.is_error() || ir.is_error()) {
+                std::stringstream ss;
+                ss << "mcc::gl::MeshArena::defragment() failed:" << std::endl;
+                ss << "Couldn't copy slice:" << std::endl;
+                ss << (vr.is_error() ? vr.get_error() : ir.get_error());
+                return Result<void, std::string>::error(ss.str());
+            }
+
+            slice->base_vertex = (unsigned int)vertex_offset;
+            slice->first_index = (unsigned int)index_offset;
+            vertex_offset += slice->vertex_count;
+            index_offset += index_count;
+        }
+
+        page->vb = std::move(new_vb);
+        page->ib = std::move(new_ib);
+
+        page->free_vertices.clear();
+        page->free_indices.clear();
+        if (vertex_offset < page->vertex_capacity) {
+            page->free_vertices.emplace(vertex_offset, page->vertex_capacity - vertex_offset);
+        }
+        if (index_offset < page->index_capacity) {
+            page->free_indices.emplace(index_offset, page->index_capacity - index_offset);
+        }
+    }
+
+    return Result<void, std::string>::success();
+}
+
+MeshArena::Stats mcc::gl::MeshArena::get_stats() const {
+    Stats stats = {};
+
+    for (auto& page : this->pages) {
+        if (page == nullptr) {
+            continue;
+        }
+
+        stats.page_count += 1;
+        stats.allocation_count += page->allocation_count;
+        stats.vertex_capacity += page->vertex_capacity;
+        stats.index_capacity += page->index_capacity;
+        stats.vertex_used += page->vertex_capacity;
+        stats.index_used += page->index_capacity;
+
+        for (auto& block : page->free_vertices) {
+            stats.vertex_used -= block.second;
+            stats.largest_free_block = std::max(stats.largest_free_block, block.second);
+            stats.free_block_count += 1;
+        }
+
+        for (auto& block : page->free_indices) {
+            stats.index_used -= block.second;
+        }
+    }
+
+    return stats;
+}
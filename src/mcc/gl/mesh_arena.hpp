@@ -0,0 +1,125 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <mcc/result.hpp>
+#include <mcc/gl/vertex_array.hpp>
+#include <mcc/gl/vertex_buffer.hpp>
+#include <mcc/gl/index_buffer.hpp>
+#include <mcc/gl/indirect_buffer.hpp>
+#include <mcc/gl/mesher.hpp>
+
+namespace mcc::gl {
+    /*
+        Stores many small meshes on a few large vertex and index buffers (pages), so that they can be drawn without
+        switching buffers. Each mesh is a slice of a page, allocated with a first-fit free list.
+        Must only be used from the thread which owns the OpenGL context.
+    */
+    class MeshArena final {
+    public:
+        using Handle = unsigned int;
+        static constexpr Handle Invalid = 0;
+
+        // A mesh stored on the arena. Indices are relative to base_vertex, and the transparent ones follow the opaque ones.
+        struct Slice {
+            int page;
+            unsigned int base_vertex, vertex_count;
+            unsigned int first_index, opaque_count, transparent_count;
+            unsigned int opaque_ranges[face_direction_count + 1]; // Relative to first_index, see MeshData
+            glm::vec3 min, max;
+        };
+
+        // A mesh drawn as part of a batch, translated by offset. The offset is read by shaders from location 4.
+        struct Draw {
+            Handle handle;
+            glm::vec3 offset;
+        };
+
+        struct Stats {
+            size_t page_count;
+            size_t allocation_count;
+            size_t vertex_capacity, vertex_used; // In vertices
+            size_t index_capacity, index_used; // In indices
+            size_t free_block_count;
+            size_t largest_free_block; // In vertices
+
+            // Fraction of the free vertex space which isn't on the largest free block (0 = no fragmentation)
+            inline float fragmentation() const {
+                size_t free = this->vertex_capacity - this->vertex_used;
+                return free == 0 ? 0.0f : 1.0f - float(this->largest_free_block) / float(free);
+            }
+        };
+
+        // Meshes larger than a page get a page of their own.
+        MeshArena(size_t page_vertices = 1 << 20, size_t page_indices = 3 << 19);
+        MeshArena(const MeshArena&) = delete;
+        MeshArena(MeshArena&&) = delete;
+        ~MeshArena() = default;
+
+        // Uploads a mesh to the arena. Empty meshes return Invalid.
+        Result<Handle, std::string> allocate(const MeshData& data);
+        // Releases a mesh slice. Freeing Invalid or an already freed handle does nothing.
+        void free(Handle handle);
+
+        inline const Slice& get(Handle handle) const { return this->slots[handle - 1].slice; }
+
+        // Draws many meshes with a single glMultiDrawElementsIndirect() call per page.
+        void draw_opaque(const std::vector<Draw>& draws);
+        // Skips the face directions of each mesh which face away from the camera.
+        void draw_opaque(const std::vector<Draw>& draws, const glm::vec3& camera_pos);
+        void draw_transparent(const std::vector<Draw>& draws);
+
+        // Binds the shared vertex array, with the vertex and index buffers of a page.
+        void bind(int page) const;
+        inline int get_page_count() const { return int(this->pages.size()); }
+
+        // Compacts the slices of every page to its start, so that all of its free space is on a single block.
+        // Empty pages are released. The handles stay valid, but their slices move.
+        Result<void, std::string> defragment();
+
+        Stats get_stats() const;
+
+    private:
+        // Maps the offsets of the free blocks to their sizes
+        using FreeList = std::map<size_t, size_t>;
+
+        struct Page {
+            VertexBuffer vb;
+            IndexBuffer ib;
+            size_t vertex_capacity, index_capacity;
+            FreeList free_vertices, free_indices;
+            size_t allocation_count;
+        };
+
+        struct Slot {
+            Slice slice;
+            bool live;
+        };
+
+        static bool reserve(FreeList& list, size_t size, size_t& offset);
+        static void release(FreeList& list, size_t offset, size_t size);
+
+        Result<int, std::string> create_page(size_t vertex_capacity, size_t index_capacity);
+        // If camera_pos isn't null, the opaque faces facing away from it are skipped.
+        void draw_batch(const std::vector<Draw>& draws, bool transparent, const glm::vec3* camera_pos);
+
+        size_t page_vertices, page_indices;
+        std::vector<std::unique_ptr<Page>> pages; // Released pages are left as nullptr, so page indices stay valid
+        std::vector<Slot> slots;
+        std::vector<Handle> free_slots;
+
+        // Vertex format of every page, reading the per draw offsets as instanced attributes
+        VertexArray format;
+
+        // Per draw offsets and commands of the batches, rewritten every draw
+        VertexBuffer offsets;
+        IndirectBuffer commands;
+        size_t batch_capacity = 0; // In commands
+        std::vector<glm::vec3> offset_data;
+        std::vector<DrawElementsCommand> command_data;
+        std::vector<std::pair<int, size_t>> draw_order; // Page and index of each draw, sorted by page
+    };
+}
@@ -0,0 +1,881 @@
+#include <mcc/gl/mesher.hpp>
+#include <mcc/gl/light.hpp>
+
+#include <functional>
+#include <stack>
+#include <atomic>
+#include <algorithm>
+
+// SSE2 is always available on x86-64, AVX2 must be enabled when compiling (MCC_AVX2 option)
+#if defined(__AVX2__)
+#define MCC_MESHER_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MCC_MESHER_SSE2
+#endif
+
+#if defined(MCC_MESHER_AVX2)
+#include <immintrin.h>
+#elif defined(MCC_MESHER_SSE2)
+#include <emmintrin.h>
+#endif
+
+using namespace mcc;
+using namespace mcc::gl;
+
+namespace {
+    int get_direction(const glm::vec3& normal) {
+        for (int d = 0; d < 3; ++d) {
+            if (normal[d] != 0.0f) {
+                return normal[d] > 0.0f ? d : 3 + d;
+            }
+        }
+        return 0;
+    }
+
+    void compute_bounds(MeshData& data) {
+        if (data.vertices.empty()) {
+            data.min = data.max = { 0.0f, 0.0f, 0.0f };
+            return;
+        }
+
+        data.min = data.max = data.vertices[0].pos;
+        for (auto& vertex : data.vertices) {
+            data.min = glm::min(data.min, vertex.pos);
+            data.max = glm::max(data.max, vertex.pos);
+        }
+    }
+
+    // Sorts the opaque quads by direction, keeping their order within each direction
+    void group_by_direction(MeshData& data) {
+        unsigned int counts[face_direction_count] = {};
+        for (size_t i = 0; i < data.opaque_indices.size(); i += 6) {
+            counts[get_direction(data.vertices[data.opaque_indices[i]].normal)] += 6;
+        }
+
+        unsigned int offsets[face_direction_count];
+        data.opaque_ranges[0] = 0;
+        for (int i = 0; i < face_direction_count; ++i) {
+            offsets[i] = data.opaque_ranges[i];
+            data.opaque_ranges[i + 1] = data.opaque_ranges[i] + counts[i];
+        }
+
+        std::vector<unsigned int> indices(data.opaque_indices.size());
+        for (size_t i = 0; i < data.opaque_indices.size(); i += 6) {
+            auto& offset = offsets[get_direction(data.vertices[data.opaque_indices[i]].normal)];
+            std::copy(data.opaque_indices.begin() + i, data.opaque_indices.begin() + i + 6, indices.begin() + offset);
+            offset += 6;
+        }
+        data.opaque_indices = std::move(indices);
+    }
+}
+
+int mcc::gl::get_visible_ranges(
+    const unsigned int opaque_ranges[face_direction_count + 1],
+    const glm::vec3& min,
+    const glm::vec3& max,
+    const glm::vec3& point,
+    IndexRange ranges[3]
+) {
+    int count = 0;
+    bool open = false;
+    for (int i = 0; i < face_direction_count; ++i) {
+        int d = i % 3;
+        bool visible = i < 3 ? point[d] > min[d] : point[d] < max[d];
+        if (!visible) {
+            open = false;
+        } else if (opaque_ranges[i] != opaque_ranges[i + 1]) {
+            if (open) {
+                ranges[count - 1].end = opaque_ranges[i + 1];
+            } else {
+                ranges[count++] = { opaque_ranges[i], opaque_ranges[i + 1] };
+                open = true;
+            }
+        }
+    }
+    return count;
+}
+
+void mcc::gl::mesh_octree(const Octree& octree, float root_sz, int lod, bool generate_borders, MeshData& data) {
+    auto& opaque_verts = data.vertices;
+    auto& opaque_indices = data.opaque_indices;
+    auto& transparent_indices = data.transparent_indices;
+    std::vector<Vertex> transparent_verts;
+    opaque_verts.clear();
+    opaque_indices.clear();
+    transparent_indices.clear();
+    std::stack<unsigned int> parents;
+
+    auto get_mat = [&](unsigned int vox_index) -> const Material& {
+        return octree.palette[octree.voxels[vox_index].material];
+    };
+
+    auto pos_to_index = [](glm::ivec3 pos) {
+        return pos.x * 4 + pos.y * 2 + pos.z;
+    };
+
+    auto get_rel_pos = [&](unsigned int parent, unsigned int index) {
+        return glm::ivec3(
+            (index - octree.voxels[parent].child) / 4,
+            ((index - octree.voxels[parent].child) % 4) / 2,
+            (index - octree.voxels[parent].child) % 2
+        );
+    };
+
+    // Gets the neighbour that is larger or equal to a voxel in a direction
+    std::function<unsigned int(unsigned int, glm::ivec3)> get_neighbour_be = [&](unsigned int index, glm::ivec3 dir) -> unsigned int {
+        // If root (octree border)
+        if (parents.empty()) {
+            return index;
+        }
+
+        int parent = parents.top();
+
+        // Neighbour has the same parent
+        auto rel_pos = get_rel_pos(parent, index);
+        auto neighbour_pos = rel_pos + dir;
+        if (neighbour_pos.x >= 0 && neighbour_pos.x <= 1 &&
+            neighbour_pos.y >= 0 && neighbour_pos.y <= 1 &&
+            neighbour_pos.z >= 0 && neighbour_pos.z <= 1) {
+            return octree.voxels[parent].child + pos_to_index(neighbour_pos);
+        }
+        
+        parents.pop();
+        unsigned int parent_neighbour = get_neighbour_be(parent, dir);
+        parents.push(parent);
+
+        // Octree border
+        if (parent_neighbour == parent) {
+            return index;
+        }
+        // If parent neighbour is leaf
+        else if (octree.voxels[parent_neighbour].child == 0) {
+            return parent_neighbour;
+        }
+
+        return octree.voxels[parent_neighbour].child + pos_to_index(glm::abs(neighbour_pos % 2));
+    };
+
+    std::function<void(unsigned int, glm::vec3, float, int)> build = [&](unsigned int index, glm::vec3 pos, float sz, int lod) {
+        if (octree.voxels[index].child != 0 && lod != 0) {
+            // Subdivide
+            parents.push(index);
+            float w = sz / 2.0f;
+            for (int a = 0; a <= 1; ++a) {
+                for (int b = 0; b <= 1; ++b) {
+                    for (int c = 0; c <= 1; ++c) {
+                        build(
+                            octree.voxels[index].child + 4 * a + 2 * b + c,
+                            pos + glm::vec3(a, b, c) * (float)w,
+                            w,
+                            lod - 1
+                        );
+                    }
+                }
+            }
+            parents.pop();
+        }
+        else if (get_mat(index).color.a != 0) {
+            auto& mat = get_mat(index);
+            auto& verts = mat.color.a == 255 ? opaque_verts : transparent_verts;
+            auto& indices = mat.color.a == 255 ? opaque_indices : transparent_indices;
+
+            // For each axis
+            for (int axis = 0; axis < 3; ++axis) {
+                for (int side = 0; side <= 1; ++side) {
+                    glm::ivec3 q;
+                    q = { 0, 0, 0 };
+                    glm::vec3 t, u, v;
+                    t = u = v = { 0.0f, 0.0f, 0.0f };
+                    q[(axis + 0) % 3] = 1;
+                    t[(axis + 0) % 3] = sz;
+                    u[(axis + 1) % 3] = sz;
+                    v[(axis + 2) % 3] = sz;
+
+                    // Check neighbour
+                    auto neighbour = get_neighbour_be(index, side ? q : -q);
+                    bool visible = (get_mat(neighbour).color.a != 255 &&
+                                   octree.voxels[neighbour].material != octree.voxels[index].material) ||
+                                   octree.voxels[neighbour].child != 0 ||
+                                   (neighbour == index && generate_borders);
+
+                    if (visible) {
+                        auto vi = verts.size();
+                        verts.resize(vi + 4, { { 0.0f, 0.0f, 0.0f }, side ? q : -q, mat.color });
+                        verts[vi + 0].pos = pos + t * (float)side;
+                        verts[vi + 1].pos = pos + t * (float)side + u;
+                        verts[vi + 2].pos = pos + t * (float)side + u + v;
+                        verts[vi + 3].pos = pos + t * (float)side + v;
+
+                        auto ii = indices.size();
+                        indices.resize(ii + 6);
+                        if (side) {
+                            indices[ii + 0] = vi + 0;
+                            indices[ii + 1] = vi + 1;
+                            indices[ii + 2] = vi + 2;
+                            indices[ii + 3] = vi + 2;
+                            indices[ii + 4] = vi + 3;
+                            indices[ii + 5] = vi + 0;
+                        }
+                        else {
+                            indices[ii + 0] = vi + 0;
+                            indices[ii + 1] = vi + 2;
+                            indices[ii + 2] = vi + 1;
+                            indices[ii + 3] = vi + 3;
+                            indices[ii + 4] = vi + 2;
+                            indices[ii + 5] = vi + 0;                      
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    build(0, glm::vec3(0.0f, 0.0f, 0.0f), root_sz, lod);
+
+    for (auto& i : transparent_indices) {
+        i += opaque_verts.size();
+    }
+
+    opaque_verts.insert(opaque_verts.end(), transparent_verts.begin(), transparent_verts.end());
+
+    group_by_direction(data);
+    compute_bounds(data);
+}
+
+namespace {
+    std::atomic<bool> simd_enabled = true;
+
+    // Builds the visibility mask of a slice from the layers behind (a) and in front (b) of it.
+    // A face is visible unless both voxels are opaque, and takes the material of the voxel it belongs to.
+    // The opacities must be either 0x00 or 0xFF.
+    void build_mask_scalar(
+        const unsigned char* a,
+        const unsigned char* b,
+        const unsigned char* opacity_a,
+        const unsigned char* opacity_b,
+        bool back_face,
+        unsigned char* mask,
+        int count
+    ) {
+        auto src = back_face ? b : a;
+        for (int i = 0; i < count; ++i) {
+            mask[i] = (opacity_a[i] & opacity_b[i]) ? 0 : src[i];
+        }
+    }
+
+#ifdef MCC_MESHER_SSE2
+    void build_mask_sse2(
+        const unsigned char* a,
+        const unsigned char* b,
+        const unsigned char* opacity_a,
+        const unsigned char* opacity_b,
+        bool back_face,
+        unsigned char* mask,
+        int count
+    ) {
+        auto src = back_face ? b : a;
+        int i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m128i oa = _mm_loadu_si128((const __m128i*)(opacity_a + i));
+            __m128i ob = _mm_loadu_si128((const __m128i*)(opacity_b + i));
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(mask + i), _mm_andnot_si128(_mm_and_si128(oa, ob), s));
+        }
+        build_mask_scalar(a + i, b + i, opacity_a + i, opacity_b + i, back_face, mask + i, count - i);
+    }
+#endif
+
+#ifdef MCC_MESHER_AVX2
+    void build_mask_avx2(
+        const unsigned char* a,
+        const unsigned char* b,
+        const unsigned char* opacity_a,
+        const unsigned char* opacity_b,
+        bool back_face,
+        unsigned char* mask,
+        int count
+    ) {
+        auto src = back_face ? b : a;
+        int i = 0;
+        for (; i + 32 <= count; i += 32) {
+            __m256i oa = _mm256_loadu_si256((const __m256i*)(opacity_a + i));
+            __m256i ob = _mm256_loadu_si256((const __m256i*)(opacity_b + i));
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            _mm256_storeu_si256((__m256i*)(mask + i), _mm256_andnot_si256(_mm256_and_si256(oa, ob), s));
+        }
+        build_mask_sse2(a + i, b + i, opacity_a + i, opacity_b + i, back_face, mask + i, count - i);
+    }
+#endif
+
+    // Picks the widest mask kernel available
+    void build_mask(
+        const unsigned char* a,
+        const unsigned char* b,
+        const unsigned char* opacity_a,
+        const unsigned char* opacity_b,
+        bool back_face,
+        unsigned char* mask,
+        int count
+    ) {
+        if (simd_enabled) {
+#if defined(MCC_MESHER_AVX2)
+            build_mask_avx2(a, b, opacity_a, opacity_b, back_face, mask, count);
+            return;
+#elif defined(MCC_MESHER_SSE2)
+            build_mask_sse2(a, b, opacity_a, opacity_b, back_face, mask, count);
+            return;
+#endif
+        }
+
+        build_mask_scalar(a, b, opacity_a, opacity_b, back_face, mask, count);
+    }
+
+    // Geometry generated by a range of slices of a voxel matrix. Indices are relative to the part's own vertices.
+    // If quads is set, packed quads are generated instead of vertices and indices.
+    struct MatrixPart {
+        bool quads = false;
+        std::vector<Vertex> opaque_verts, transparent_verts;
+        std::vector<unsigned int> opaque_indices, transparent_indices;
+        std::vector<Quad> opaque_quads, transparent_quads;
+    };
+
+    // Greedy meshes the faces facing a single direction in the slices [begin, end) of an axis.
+    // Slice i holds the faces between the layers i and i + 1, so the slices -1 and size - 1 hold the borders. The results are appended to part.
+    void mesh_matrix_slices(
+        const Matrix& matrix,
+        float vx_sz,
+        bool generate_borders,
+        bool bake_ao,
+        bool back_face,
+        int d,
+        int begin,
+        int end,
+        MatrixPart& part
+    ) {
+        auto& opaque_verts = part.opaque_verts;
+        auto& opaque_indices = part.opaque_indices;
+        auto& transparent_verts = part.transparent_verts;
+        auto& transparent_indices = part.transparent_indices;
+        std::vector<unsigned char> mask;
+        std::vector<unsigned char> ao_mask; // Ambient occlusion levels (0 - 3) of the four face corners, 2 bits each
+        std::vector<unsigned char> light_mask; // Light of the voxel in front of each face, packed by pack_light()
+
+        auto& sz = matrix.size;
+
+        auto get_mat = [&] (unsigned int vox_index) -> const Material& {
+            return matrix.palette[matrix.voxels[vox_index]];
+        };
+
+        // Checks if a voxel is opaque. Positions outside of the matrix are looked up on the borders, if known.
+        auto is_opaque = [&](glm::ivec3 p) -> bool {
+            int outside = -1;
+            for (int e = 0; e < 3; ++e) {
+                if (p[e] < 0 || p[e] >= int(sz[e])) {
+                    if (outside != -1 || p[e] < -1 || p[e] > int(sz[e])) {
+                        return false; // Edges and corners aren't stored on the borders
+                    }
+                    outside = e;
+                }
+            }
+
+            if (outside == -1) {
+                return get_mat((unsigned int)matrix.get_index(p.x, p.y, p.z)).color.a == 255;
+            }
+
+            auto& border = matrix.borders[outside * 2 + (p[outside] < 0 ? 0 : 1)];
+            if (border.empty()) {
+                return false;
+            }
+
+            int u = (outside + 1) % 3;
+            int v = (outside + 2) % 3;
+            return matrix.palette[border[p[v] * sz[u] + p[u]]].color.a == 255;
+        };
+
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+
+        glm::ivec3 x = { 0, 0, 0 }, q = { 0, 0, 0 };
+        q[d] = 1;
+        mask.resize(sz[u] * sz[v]);
+        ao_mask.resize(sz[u] * sz[v], 0xFF);
+        light_mask.resize(sz[u] * sz[v], pack_light(max_light_level, 0));
+
+        // Materials and opacities of the layers behind (a) and in front (b) of the current slice, in mask order
+        std::vector<unsigned char> layer_a(mask.size()), layer_b(mask.size());
+        std::vector<unsigned char> opacity_a(mask.size()), opacity_b(mask.size());
+
+        unsigned char opaque[256];
+        for (int i = 0; i < 256; ++i) {
+            opaque[i] = matrix.palette[i].color.a == 255 ? 0xFF : 0x00;
+        }
+
+        // Gathers a layer of voxels perpendicular to the axis d. Layers outside of the matrix are read from the borders.
+        auto load_layer = [&](int layer, unsigned char* voxels, unsigned char* opacity) {
+            int count = int(sz[u]) * int(sz[v]);
+
+            if (layer < 0 || layer >= int(sz[d])) {
+                auto& border = matrix.borders[d * 2 + (layer < 0 ? 0 : 1)];
+                if (border.empty()) {
+                    std::fill(voxels, voxels + count, 0);
+                    std::fill(opacity, opacity + count, 0);
+                    return;
+                }
+                std::copy(border.begin(), border.end(), voxels);
+            } else if (matrix.layout == Matrix::Layout::Morton) {
+                // Walk the rows along u by incrementing their Morton codes, instead of encoding every voxel
+                uint32_t row = morton_spread(layer, morton_masks[d]);
+                for (int j = 0, n = 0; j < int(sz[v]); ++j) {
+                    uint32_t code = row;
+                    for (int i = 0; i < int(sz[u]); ++i, ++n) {
+                        voxels[n] = matrix.voxels[code];
+                        code = morton_increment(code, morton_masks[u]);
+                    }
+                    row = morton_increment(row, morton_masks[v]);
+                }
+            } else {
+                glm::ivec3 stride = { sz.y * sz.z, sz.z, 1 };
+                const unsigned char* src = matrix.voxels.data() + layer * stride[d];
+                for (int j = 0, n = 0; j < int(sz[v]); ++j) {
+                    auto row = src + j * stride[v];
+                    if (stride[u] == 1) {
+                        std::copy(row, row + sz[u], voxels + n);
+                        n += sz[u];
+                    } else {
+                        for (int i = 0; i < int(sz[u]); ++i, ++n) {
+                            voxels[n] = row[i * stride[u]];
+                        }
+                    }
+                }
+            }
+
+            for (int i = 0; i < count; ++i) {
+                opacity[i] = opaque[voxels[i]];
+            }
+        };
+
+        // Gathers the light of a layer, as load_layer() does with the voxels
+        bool bake_light = !matrix.light.empty();
+        auto load_light = [&](int layer, unsigned char* light) {
+            if (layer < 0 || layer >= int(sz[d])) {
+                auto& border = matrix.light_borders[d * 2 + (layer < 0 ? 0 : 1)];
+                if (border.empty()) {
+                    std::fill(light, light + int(sz[u]) * int(sz[v]), 0);
+                } else {
+                    std::copy(border.begin(), border.end(), light);
+                }
+                return;
+            }
+
+            glm::ivec3 p;
+            p[d] = layer;
+            for (p[v] = 0; p[v] < int(sz[v]); ++p[v]) {
+                for (p[u] = 0; p[u] < int(sz[u]); ++p[u]) {
+                    *light++ = matrix.light[matrix.get_index(p.x, p.y, p.z)];
+                }
+            }
+        };
+
+        load_layer(begin, layer_a.data(), opacity_a.data());
+
+        for (x[d] = begin; x[d] < end;) {
+            int n = 0;
+
+            // Load the layer in front of the slice. The layer behind it was loaded on the previous iteration.
+            load_layer(x[d] + 1, layer_b.data(), opacity_b.data());
+
+            // Create mask
+            bool lower = x[d] < 0;
+            bool upper = x[d] == int(sz[d]) - 1;
+            if ((lower || upper) && !generate_borders) {
+                std::fill(mask.begin(), mask.end(), 0);
+            } else if ((lower && !back_face) || (upper && back_face)) {
+                // These faces belong to the neighbouring voxels
+                std::fill(mask.begin(), mask.end(), 0);
+            } else {
+                build_mask(layer_a.data(), layer_b.data(), opacity_a.data(), opacity_b.data(), back_face, mask.data(), int(mask.size()));
+            }
+
+            // Faces take the light of the voxel in front of them
+            if (bake_light) {
+                load_light(back_face ? x[d] : x[d] + 1, light_mask.data());
+            }
+
+            // Compute the ambient occlusion of the corners of each face, from the voxels in front of it
+            if (bake_ao) {
+                const glm::ivec2 corners[4] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+                glm::ivec3 y = x, du = { 0, 0, 0 }, dv = { 0, 0, 0 };
+                y[d] = back_face ? x[d] : x[d] + 1;
+                du[u] = 1;
+                dv[v] = 1;
+
+                // Positions on the air layer are looked up on the gathered opacities
+                auto& air = back_face ? opacity_a : opacity_b;
+                auto air_opaque = [&](glm::ivec3 p) {
+                    if (p[u] >= 0 && p[u] < int(sz[u]) && p[v] >= 0 && p[v] < int(sz[v])) {
+                        return air[p[v] * sz[u] + p[u]] != 0;
+                    }
+                    return is_opaque(p);
+                };
+
+                n = 0;
+                for (y[v] = 0; y[v] < int(sz[v]); ++y[v]) {
+                    for (y[u] = 0; y[u] < int(sz[u]); ++y[u], ++n) {
+                        if (mask[n] == 0) {
+                            continue;
+                        }
+
+                        ao_mask[n] = 0;
+                        for (int c = 0; c < 4; ++c) {
+                            bool side_u = air_opaque(y + du * corners[c].x);
+                            bool side_v = air_opaque(y + dv * corners[c].y);
+                            bool corner = air_opaque(y + du * corners[c].x + dv * corners[c].y);
+                            int level = (side_u && side_v) ? 0 : 3 - int(side_u) - int(side_v) - int(corner);
+                            ao_mask[n] |= level << (c * 2);
+                        }
+                    }
+                }
+            }
+
+            std::swap(layer_a, layer_b);
+            std::swap(opacity_a, opacity_b);
+            
+            ++x[d];
+            n = 0;
+
+            // Generate mesh from mask
+            for (int j = 0; j < int(sz[v]); ++j) {
+                for (int i = 0; i < int(sz[u]);) {
+                    if (mask[n] != 0) {
+                        int w, h;
+                        for (w = 1; i + w < int(sz[u]) && mask[n + w] == mask[n] && ao_mask[n + w] == ao_mask[n] &&
+                                    light_mask[n + w] == light_mask[n]; ++w);
+                        bool done = false;
+                        for (h = 1; j + h < int(sz[v]); ++h) {
+                            for (int k = 0; k < w; ++k) {
+                                if (mask[n + k + h * sz[u]] == 0 || mask[n + k + h * sz[u]] != mask[n] ||
+                                    ao_mask[n + k + h * sz[u]] != ao_mask[n] || light_mask[n + k + h * sz[u]] != light_mask[n]) {
+                                    done = true;
+                                    break;
+                                }
+                            }
+
+                            if (done) {
+                                break;
+                            }
+                        }
+
+                        if (mask[n] != 0 && part.quads) {
+                            x[u] = i;
+                            x[v] = j;
+
+                            // Same diagonal choice as the vertices below
+                            int ao[4];
+                            for (int c = 0; c < 4; ++c) {
+                                ao[c] = (ao_mask[n] >> (c * 2)) & 3;
+                            }
+                            bool flip = ao[0] + ao[2] < ao[1] + ao[3];
+
+                            auto& color = matrix.palette[mask[n]].color;
+                            Quad quad;
+                            quad.x = unsigned(x.x) | (unsigned(x.y) << 8) | (unsigned(x.z) << 16) | (unsigned(w) << 24);
+                            quad.y = unsigned(h) | (unsigned(back_face * 3 + d) << 8) | (unsigned(flip) << 11) | (unsigned(ao_mask[n]) << 16);
+                            quad.z = unsigned(color.r) | (unsigned(color.g) << 8) | (unsigned(color.b) << 16) | (unsigned(color.a) << 24);
+                            (color.a == 255 ? part.opaque_quads : part.transparent_quads).push_back(quad);
+                        } else if (mask[n] != 0) {
+                            auto& verts = matrix.palette[mask[n]].color.a == 255 ? opaque_verts : transparent_verts;
+                            auto& indices = matrix.palette[mask[n]].color.a == 255 ? opaque_indices : transparent_indices;
+
+                            x[u] = i;
+                            x[v] = j;
+
+                            glm::ivec3 du = { 0, 0, 0 }, dv = { 0, 0, 0 };
+                            du[u] = w;
+                            dv[v] = h;
+                            
+                            auto vi = verts.size();
+                            verts.resize(vi + 4, { { 0.0f, 0.0f, 0.0f }, back_face ? -q : q, matrix.palette[mask[n]].color });
+                            verts[vi + 0].pos = glm::vec3(x) * vx_sz;
+                            verts[vi + 1].pos = glm::vec3(x + du) * vx_sz;
+                            verts[vi + 2].pos = glm::vec3(x + du + dv) * vx_sz;
+                            verts[vi + 3].pos = glm::vec3(x + dv) * vx_sz;
+                            for (int c = 0; c < 4; ++c) {
+                                verts[vi + c].ao = ((ao_mask[n] >> (c * 2)) & 3) * 85;
+                                verts[vi + c].light = glm::u8vec2(get_sky_light(light_mask[n]), get_block_light(light_mask[n]));
+                            }
+
+                            // Split the quad along the other diagonal when it makes the occlusion interpolate symmetrically
+                            bool flip = verts[vi + 0].ao + verts[vi + 2].ao < verts[vi + 1].ao + verts[vi + 3].ao;
+
+                            auto ii = indices.size();
+                            indices.resize(ii + 6);
+                            if (flip && back_face) {
+                                indices[ii + 0] = int(vi) + 1;
+                                indices[ii + 1] = int(vi) + 3;
+                                indices[ii + 2] = int(vi) + 2;
+                                indices[ii + 3] = int(vi) + 3;
+                                indices[ii + 4] = int(vi) + 1;
+                                indices[ii + 5] = int(vi) + 0;
+                            } else if (flip) {
+                                indices[ii + 0] = int(vi) + 1;
+                                indices[ii + 1] = int(vi) + 2;
+                                indices[ii + 2] = int(vi) + 3;
+                                indices[ii + 3] = int(vi) + 3;
+                                indices[ii + 4] = int(vi) + 0;
+                                indices[ii + 5] = int(vi) + 1;
+                            } else if (back_face) {
+                                indices[ii + 0] = int(vi) + 0;
+                                indices[ii + 1] = int(vi) + 2;
+                                indices[ii + 2] = int(vi) + 1;
+                                indices[ii + 3] = int(vi) + 3;
+                                indices[ii + 4] = int(vi) + 2;
+                                indices[ii + 5] = int(vi) + 0;                              
+                            } else {
+                                indices[ii + 0] = int(vi) + 0;
+                                indices[ii + 1] = int(vi) + 1;
+                                indices[ii + 2] = int(vi) + 2;
+                                indices[ii + 3] = int(vi) + 2;
+                                indices[ii + 4] = int(vi) + 3;
+                                indices[ii + 5] = int(vi) + 0;
+                            }                          
+                        }
+
+                        for (int l = 0; l < h; ++l) {
+                            for (int k = 0; k < w; ++k) {
+                                mask[n + k + l * sz[u]] = 0;
+                            }
+                        }
+
+                        i += w;
+                        n += w;
+                    } else {
+                        ++i;
+                        ++n;
+                    }
+                }
+            }
+        }
+    }
+}
+
+namespace {
+    // A range of slices of a single face direction
+    struct SliceTask {
+        bool back_face;
+        int d, begin, end;
+    };
+
+    // Splits each direction into independent slice ranges, in the same order as a serial sweep,
+    // so that concatenating the parts gives exactly the same mesh.
+    std::vector<SliceTask> split_slices(const Matrix& matrix) {
+        // Number of slices meshed by each task. Smaller ranges balance better but copy more.
+        const int slices_per_task = 8;
+
+        auto& sz = matrix.size;
+        std::vector<SliceTask> tasks;
+        for (int back_face = 0; back_face <= 1; ++back_face) {
+            for (int d = 0; d < 3; ++d) {
+                for (int begin = -1; begin < int(sz[d]); begin += slices_per_task) {
+                    tasks.push_back({ back_face != 0, d, begin, glm::min(begin + slices_per_task, int(sz[d])) });
+                }
+            }
+        }
+        return tasks;
+    }
+}
+
+void mcc::gl::set_mesher_simd(bool enabled) {
+    simd_enabled = enabled;
+}
+
+void mcc::gl::mesh_matrix(const Matrix& matrix, float vx_sz, bool generate_borders, bool bake_ao, MeshData& data, ThreadPool* pool) {
+    auto& sz = matrix.size;
+    data.vertices.clear();
+    data.opaque_indices.clear();
+    data.transparent_indices.clear();
+
+    // The sweep order is the face direction order, so the opaque faces come out already grouped
+    data.opaque_ranges[0] = 0;
+
+    if (pool == nullptr) {
+        MatrixPart part;
+        for (int back_face = 0; back_face <= 1; ++back_face) {
+            for (int d = 0; d < 3; ++d) {
+                mesh_matrix_slices(matrix, vx_sz, generate_borders, bake_ao, back_face, d, -1, int(sz[d]), part);
+                data.opaque_ranges[back_face * 3 + d + 1] = (unsigned int)part.opaque_indices.size();
+            }
+        }
+
+        data.vertices = std::move(part.opaque_verts);
+        data.opaque_indices = std::move(part.opaque_indices);
+        data.transparent_indices = std::move(part.transparent_indices);
+        for (auto& i : data.transparent_indices) {
+            i += data.vertices.size();
+        }
+        data.vertices.insert(data.vertices.end(), part.transparent_verts.begin(), part.transparent_verts.end());
+        compute_bounds(data);
+        return;
+    }
+
+    auto tasks = split_slices(matrix);
+    std::vector<MatrixPart> parts(tasks.size());
+    pool->parallel_for(int(tasks.size()), [&](int i) {
+        auto& task = tasks[i];
+        mesh_matrix_slices(matrix, vx_sz, generate_borders, bake_ao, task.back_face, task.d, task.begin, task.end, parts[i]);
+    });
+
+    // Concatenate the parts, opaque vertices first
+    size_t vert_count = 0, opaque_index_count = 0, transparent_index_count = 0;
+    for (auto& part : parts) {
+        vert_count += part.opaque_verts.size() + part.transparent_verts.size();
+        opaque_index_count += part.opaque_indices.size();
+        transparent_index_count += part.transparent_indices.size();
+    }
+
+    data.vertices.reserve(vert_count);
+    data.opaque_indices.reserve(opaque_index_count);
+    data.transparent_indices.reserve(transparent_index_count);
+
+    for (size_t p = 0; p < parts.size(); ++p) {
+        auto& part = parts[p];
+        auto base = (unsigned int)data.vertices.size();
+        data.vertices.insert(data.vertices.end(), part.opaque_verts.begin(), part.opaque_verts.end());
+        for (auto i : part.opaque_indices) {
+            data.opaque_indices.push_back(base + i);
+        }
+        data.opaque_ranges[tasks[p].back_face * 3 + tasks[p].d + 1] = (unsigned int)data.opaque_indices.size();
+    }
+
+    for (auto& part : parts) {
+        auto base = (unsigned int)data.vertices.size();
+        data.vertices.insert(data.vertices.end(), part.transparent_verts.begin(), part.transparent_verts.end());
+        for (auto i : part.transparent_indices) {
+            data.transparent_indices.push_back(base + i);
+        }
+    }
+
+    compute_bounds(data);
+}
+
+void mcc::gl::mesh_brick_map(const BrickMap& map, float vx_sz, bool bake_ao, MeshData& data, ThreadPool* pool) {
+    const int region_size = 128; // In voxels, must be a multiple of the brick size
+    const int region_bricks = region_size / BrickMap::brick_size;
+
+    data.vertices.clear();
+    data.opaque_indices.clear();
+    data.transparent_indices.clear();
+
+    // Mesh each region which has non-empty bricks, reading its neighbours from the borders so that the seams are culled
+    std::vector<MeshData> regions;
+    Matrix matrix;
+    glm::ivec3 r;
+    for (r.x = 0; r.x < int(map.size.x); r.x += region_size) {
+        for (r.y = 0; r.y < int(map.size.y); r.y += region_size) {
+            for (r.z = 0; r.z < int(map.size.z); r.z += region_size) {
+                glm::ivec3 b = r / BrickMap::brick_size;
+                glm::ivec3 b_end = glm::min(b + region_bricks, glm::ivec3(map.brick_count));
+                bool empty = true;
+                for (int x = b.x; x < b_end.x && empty; ++x) {
+                    for (int y = b.y; y < b_end.y && empty; ++y) {
+                        for (int z = b.z; z < b_end.z && empty; ++z) {
+                            empty = map.table[(size_t(x) * map.brick_count.y + y) * map.brick_count.z + z] == 0;
+                        }
+                    }
+                }
+                if (empty) {
+                    continue;
+                }
+
+                auto size = glm::u8vec3(glm::min(glm::ivec3(region_size), glm::ivec3(map.size) - r));
+                map.extract(r, size, matrix);
+                regions.emplace_back();
+                auto& region = regions.back();
+                mesh_matrix(matrix, vx_sz, true, bake_ao, region, pool);
+
+                auto offset = glm::vec3(r) * vx_sz;
+                for (auto& vertex : region.vertices) {
+                    vertex.pos += offset;
+                }
+            }
+        }
+    }
+
+    // Concatenate the regions, opaque vertices first. Each quad has 4 vertices and 6 indices.
+    std::vector<size_t> opaque_vert_counts(regions.size());
+    for (size_t i = 0; i < regions.size(); ++i) {
+        opaque_vert_counts[i] = regions[i].vertices.size() - regions[i].transparent_indices.size() / 6 * 4;
+    }
+
+    for (size_t i = 0; i < regions.size(); ++i) {
+        auto& region = regions[i];
+        auto base = (unsigned int)data.vertices.size();
+        data.vertices.insert(data.vertices.end(), region.vertices.begin(), region.vertices.begin() + opaque_vert_counts[i]);
+        for (auto index : region.opaque_indices) {
+            data.opaque_indices.push_back(base + index);
+        }
+    }
+
+    for (size_t i = 0; i < regions.size(); ++i) {
+        auto& region = regions[i];
+        auto base = (unsigned int)data.vertices.size() - (unsigned int)opaque_vert_counts[i];
+        data.vertices.insert(data.vertices.end(), region.vertices.begin() + opaque_vert_counts[i], region.vertices.end());
+        for (auto index : region.transparent_indices) {
+            data.transparent_indices.push_back(base + index);
+        }
+    }
+
+    group_by_direction(data);
+    compute_bounds(data);
+}
+
+void mcc::gl::mesh_matrix_quads(const Matrix& matrix, bool generate_borders, bool bake_ao, QuadData& data, ThreadPool* pool) {
+    data.quads.clear();
+
+    auto tasks = split_slices(matrix);
+    std::vector<MatrixPart> parts(tasks.size());
+    auto mesh_task = [&](int i) {
+        auto& task = tasks[i];
+        parts[i].quads = true;
+        mesh_matrix_slices(matrix, 1.0f, generate_borders, bake_ao, task.back_face, task.d, task.begin, task.end, parts[i]);
+    };
+
+    if (pool == nullptr) {
+        for (int i = 0; i < int(tasks.size()); ++i) {
+            mesh_task(i);
+        }
+    } else {
+        pool->parallel_for(int(tasks.size()), mesh_task);
+    }
+
+    // Concatenate the parts, opaque quads first
+    size_t quad_count = 0;
+    for (auto& part : parts) {
+        quad_count += part.opaque_quads.size() + part.transparent_quads.size();
+    }
+    data.quads.reserve(quad_count);
+
+    data.opaque_ranges[0] = 0;
+    for (size_t p = 0; p < parts.size(); ++p) {
+        data.quads.insert(data.quads.end(), parts[p].opaque_quads.begin(), parts[p].opaque_quads.end());
+        data.opaque_ranges[tasks[p].back_face * 3 + tasks[p].d + 1] = (unsigned int)data.quads.size();
+    }
+    for (auto& part : parts) {
+        data.quads.insert(data.quads.end(), part.transparent_quads.begin(), part.transparent_quads.end());
+    }
+
+    // Compute the bounds from the quad corners
+    data.min = data.max = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < data.quads.size(); ++i) {
+        auto& quad = data.quads[i];
+        glm::vec3 origin = { float(quad.x & 0xFF), float((quad.x >> 8) & 0xFF), float((quad.x >> 16) & 0xFF) };
+        int d = ((quad.y >> 8) & 7) % 3;
+        glm::vec3 corner = origin;
+        corner[(d + 1) % 3] += float(quad.x >> 24);
+        corner[(d + 2) % 3] += float(quad.y & 0xFF);
+
+        data.min = i == 0 ? origin : glm::min(data.min, origin);
+        data.max = i == 0 ? corner : glm::max(data.max, corner);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <mcc/gl/voxel.hpp>
+#include <mcc/thread_pool.hpp>
+
+namespace mcc::gl {
+    struct Vertex {
+        glm::vec3 pos, normal;
+        glm::u8vec4 color;
+        unsigned char ao = 255; // Baked ambient occlusion (255 = not occluded)
+        glm::u8vec2 light = { 15, 0 }; // Baked sky and block light levels (0 - 15) of the voxel in front of the face
+    };
+
+    // Number of face directions. The opaque faces of a mesh are grouped by direction, in the order +X, +Y, +Z, -X, -Y, -Z.
+    constexpr int face_direction_count = 6;
+
+    // Mesh geometry generated on the CPU, ready to be uploaded to a gl::Mesh.
+    // The transparent vertices are stored after the opaque ones, on the same vertex vector.
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> opaque_indices;
+        std::vector<unsigned int> transparent_indices;
+
+        // The opaque indices of direction i are in [opaque_ranges[i], opaque_ranges[i + 1]).
+        unsigned int opaque_ranges[face_direction_count + 1] = {};
+        // Bounds of the vertex positions
+        glm::vec3 min = { 0.0f, 0.0f, 0.0f }, max = { 0.0f, 0.0f, 0.0f };
+    };
+
+    // A greedy quad packed in 12 bytes, expanded into two triangles by the vertex shader (see gl::QuadMesh).
+    // x: origin x, y and z (8 bits each, in voxels) and width (8 bits)
+    // y: height (8 bits), face direction (3 bits), diagonal flip (1 bit), 4 bits unused, ambient occlusion (2 bits per corner)
+    // z: RGBA color
+    // The width goes along the axis (d + 1) % 3 and the height along (d + 2) % 3, where d is the face's axis.
+    struct Quad {
+        unsigned int x, y, z;
+    };
+
+    // Quads generated on the CPU, ready to be uploaded to a gl::QuadMesh.
+    // The opaque quads come first, grouped by direction, followed by the transparent ones.
+    struct QuadData {
+        std::vector<Quad> quads;
+
+        // The opaque quads of direction i are in [opaque_ranges[i], opaque_ranges[i + 1]).
+        // The transparent quads start at opaque_ranges[face_direction_count].
+        unsigned int opaque_ranges[face_direction_count + 1] = {};
+        // Bounds of the quads, in voxels
+        glm::vec3 min = { 0.0f, 0.0f, 0.0f }, max = { 0.0f, 0.0f, 0.0f };
+    };
+
+    struct IndexRange {
+        unsigned int begin, end;
+    };
+
+    // Gets the opaque index ranges of a mesh whose faces may be facing a point, merging adjacent directions.
+    // The faces of a direction all face away from the point when it is behind the bounds on that direction's axis.
+    // At most three directions are skipped, so there are at most three ranges. Returns the number of ranges.
+    int get_visible_ranges(
+        const unsigned int opaque_ranges[face_direction_count + 1],
+        const glm::vec3& min,
+        const glm::vec3& max,
+        const glm::vec3& point,
+        IndexRange ranges[3]
+    );
+
+    // Generates a mesh with a quad per visible octree leaf face, down to the level of detail lod (-1 = full detail).
+    // These functions don't need an OpenGL context.
+    void mesh_octree(const Octree& octree, float root_sz, int lod, bool generate_borders, MeshData& data);
+    // Generates a greedy mesh from a voxel matrix. If the matrix's light was computed (see gl/light.hpp), it is baked into the
+    // vertices, and faces with different light levels aren't merged.
+    // If a thread pool is passed, the slices are meshed in parallel. The output doesn't depend on the thread count.
+    void mesh_matrix(const Matrix& matrix, float vx_sz, bool generate_borders, bool bake_ao, MeshData& data, ThreadPool* pool = nullptr);
+    // Generates a greedy mesh from a brick map of any size, meshing it in regions of up to 128x128x128 voxels.
+    // The faces between regions are culled, but the ambient occlusion at the seams ignores the diagonal neighbours.
+    void mesh_brick_map(const BrickMap& map, float vx_sz, bool bake_ao, MeshData& data, ThreadPool* pool = nullptr);
+    // Generates the same greedy mesh as mesh_matrix(), as packed quads instead of vertices and indices.
+    // The quads have no room for the baked light, which is left out.
+    void mesh_matrix_quads(const Matrix& matrix, bool generate_borders, bool bake_ao, QuadData& data, ThreadPool* pool = nullptr);
+
+    // Enables or disables the SIMD kernels used by mesh_matrix() (enabled by default).
+    // Both paths generate the same meshes, the scalar one is kept as a fallback and a reference.
+    void set_mesher_simd(bool enabled);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// BMI2 is available on every CPU with AVX2 support (MCC_AVX2 option)
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define MCC_MORTON_BMI2
+#include <immintrin.h>
+#endif
+
+namespace mcc::gl {
+    /*
+        3D Morton (Z-order) codes of up to 10 bits per axis. Bit i of x, y and z goes to bits 3 * i + 2, 3 * i + 1 and 3 * i,
+        so the 8 children of an octree cell are consecutive, ordered as the children of an octree node (x * 4 + y * 2 + z).
+    */
+    constexpr uint32_t morton_mask_x = 0x24924924u;
+    constexpr uint32_t morton_mask_y = 0x12492492u;
+    constexpr uint32_t morton_mask_z = 0x09249249u;
+    constexpr uint32_t morton_masks[3] = { morton_mask_x, morton_mask_y, morton_mask_z };
+
+    // Spreads the bits of a 10 bit value over a mask
+    inline uint32_t morton_spread(uint32_t v, uint32_t mask) {
+#ifdef MCC_MORTON_BMI2
+        return _pdep_u32(v, mask);
+#else
+        v &= 0x3FFu;
+        v = (v | (v << 16)) & 0x030000FFu;
+        v = (v | (v << 8)) & 0x0300F00Fu;
+        v = (v | (v << 4)) & 0x030C30C3u;
+        v = (v | (v << 2)) & 0x09249249u;
+        return mask == morton_mask_z ? v : (mask == morton_mask_y ? v << 1 : v << 2);
+#endif
+    }
+
+    // Gathers the bits of a Morton code under a mask
+    inline uint32_t morton_compact(uint32_t code, uint32_t mask) {
+#ifdef MCC_MORTON_BMI2
+        return _pext_u32(code, mask);
+#else
+        uint32_t v = (mask == morton_mask_z ? code : (mask == morton_mask_y ? code >> 1 : code >> 2)) & 0x09249249u;
+        v = (v | (v >> 2)) & 0x030C30C3u;
+        v = (v | (v >> 4)) & 0x0300F00Fu;
+        v = (v | (v >> 8)) & 0x030000FFu;
+        v = (v | (v >> 16)) & 0x000003FFu;
+        return v;
+#endif
+    }
+
+    inline uint32_t morton_encode(uint32_t x, uint32_t y, uint32_t z) {
+        return morton_spread(x, morton_mask_x) | morton_spread(y, morton_mask_y) | morton_spread(z, morton_mask_z);
+    }
+
+    inline void morton_decode(uint32_t code, uint32_t& x, uint32_t& y, uint32_t& z) {
+        x = morton_compact(code, morton_mask_x);
+        y = morton_compact(code, morton_mask_y);
+        z = morton_compact(code, morton_mask_z);
+    }
+
+    // Increments the coordinate of a Morton code under a mask, keeping the other coordinates.
+    // Used to walk along an axis without decoding and encoding each step.
+    inline uint32_t morton_increment(uint32_t code, uint32_t mask) {
+        return (((code | ~mask) + 1) & mask) | (code & ~mask);
+    }
+}
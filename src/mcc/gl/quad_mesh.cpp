@@ -0,0 +1,145 @@
+#include <mcc/gl/quad_mesh.hpp>
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <iterator>
+
+using namespace mcc;
+using namespace mcc::gl;
+
+VertexArray QuadMesh::vertex_array;
+
+QuadMesh::QuadMesh(QuadMesh&& rhs) {
+    this->quads = std::move(rhs.quads);
+    this->capacity = rhs.capacity;
+    this->quad_count = rhs.quad_count;
+    std::copy(std::begin(rhs.opaque_ranges), std::end(rhs.opaque_ranges), std::begin(this->opaque_ranges));
+    this->min = rhs.min;
+    this->max = rhs.max;
+    this->vx_sz = rhs.vx_sz;
+    rhs.capacity = 0;
+    rhs.quad_count = 0;
+}
+
+void QuadMesh::draw_opaque() const {
+    auto count = this->opaque_ranges[face_direction_count];
+    if (count > 0) {
+        QuadMesh::vertex_array.bind();
+        this->quads.bind(QuadMesh::texture_unit);
+        glDrawArrays(GL_TRIANGLES, 0, GLsizei(count * 6));
+    }
+}
+
+void QuadMesh::draw_opaque(const glm::vec3& camera_pos) const {
+    if (this->opaque_ranges[face_direction_count] > 0) {
+        IndexRange ranges[3];
+        int count = get_visible_ranges(this->opaque_ranges, this->min, this->max, camera_pos / this->vx_sz, ranges);
+        if (count == 0) {
+            return;
+        }
+
+        QuadMesh::vertex_array.bind();
+        this->quads.bind(QuadMesh::texture_unit);
+        for (int i = 0; i < count; ++i) {
+            glDrawArrays(GL_TRIANGLES, GLint(ranges[i].begin * 6), GLsizei((ranges[i].end - ranges[i].begin) * 6));
+        }
+    }
+}
+
+void QuadMesh::draw_transparent() const {
+    auto first = this->opaque_ranges[face_direction_count];
+    if (this->quad_count > first) {
+        QuadMesh::vertex_array.bind();
+        this->quads.bind(QuadMesh::texture_unit);
+        glDrawArrays(GL_TRIANGLES, GLint(first * 6), GLsizei((this->quad_count - first) * 6));
+    }
+}
+
+void QuadMesh::update(const Matrix& matrix, float vx_sz, bool generate_borders, bool bake_ao, ThreadPool* pool) {
+    QuadData data;
+    mesh_matrix_quads(matrix, generate_borders, bake_ao, data, pool);
+    this->update(data, vx_sz);
+}
+
+void QuadMesh::update(const QuadData& data, float vx_sz) {
+    this->quad_count = (unsigned int)data.quads.size();
+    std::copy(std::begin(data.opaque_ranges), std::end(data.opaque_ranges), std::begin(this->opaque_ranges));
+    this->min = data.min;
+    this->max = data.max;
+    this->vx_sz = vx_sz;
+
+    if (this->quad_count == 0) {
+        return; // Keep the buffer, it may be reused by the next update
+    }
+
+    size_t size = data.quads.size() * sizeof(Quad);
+    if (this->capacity == 0) {
+        this->quads = TextureBuffer::create(size, nullptr, Usage::Dynamic, TextureBuffer::Format::RGB32UI).unwrap();
+        this->capacity = size;
+    } else if (size > this->capacity) {
+        this->capacity = std::max(size, this->capacity + this->capacity / 2);
+        this->quads.allocate(this->capacity, nullptr, Usage::Dynamic).unwrap();
+    }
+    this->quads.update(0, size, data.quads.data()).unwrap();
+}
+
+void QuadMesh::init() {
+    QuadMesh::vertex_array = VertexArray::create(std::vector<Attribute>()).unwrap();
+}
+
+void QuadMesh::terminate() {
+    QuadMesh::vertex_array = VertexArray();
+}
+
+const char* QuadMesh::get_vertex_shader() {
+    return R"(
+        #version 330 core
+
+        uniform usamplerBuffer quads;
+        uniform float voxel_size;
+        uniform mat4 model;
+        uniform mat4 view;
+        uniform mat4 projection;
+
+        out vec3 frag_albedo;
+        out vec4 frag_color;
+        out vec3 frag_pos;
+        out vec3 frag_normal;
+        out float frag_ao;
+
+        // Quad corner of each vertex, indexed by flip * 2 + back face (same triangles as the indexed meshes)
+        const int corners[24] = int[24](
+            0, 1, 2, 2, 3, 0,
+            0, 2, 1, 3, 2, 0,
+            1, 2, 3, 3, 0, 1,
+            1, 3, 2, 3, 1, 0
+        );
+        const vec2 corner_offsets[4] = vec2[4](vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(1.0f, 1.0f), vec2(0.0f, 1.0f));
+
+        void main() {
+            uvec3 quad = texelFetch(quads, gl_VertexID / 6).xyz;
+            uint direction = (quad.y >> 8) & 7u;
+            int d = int(direction % 3u);
+            int back_face = direction >= 3u ? 1 : 0;
+            int flip = int((quad.y >> 11) & 1u);
+            int corner = corners[(flip * 2 + back_face) * 6 + gl_VertexID % 6];
+
+            vec3 pos = vec3(quad.x & 0xFFu, (quad.x >> 8) & 0xFFu, (quad.x >> 16) & 0xFFu);
+            vec2 offset = corner_offsets[corner] * vec2(quad.x >> 24, quad.y & 0xFFu);
+            pos[(d + 1) % 3] += offset.x;
+            pos[(d + 2) % 3] += offset.y;
+
+            vec3 normal = vec3(0.0f);
+            normal[d] = back_face == 1 ? -1.0f : 1.0f;
+
+            vec4 view_pos = view * model * vec4(pos * voxel_size, 1.0f);
+            frag_pos = view_pos.xyz;
+            gl_Position = projection * view_pos;
+            frag_color = vec4((uvec4(quad.z) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu) / 255.0f;
+            frag_albedo = frag_color.rgb;
+            frag_ao = float((quad.y >> (16 + corner * 2)) & 3u) / 3.0f;
+            frag_normal = transpose(inverse(mat3(view * model))) * normal;
+        }
+    )";
+}
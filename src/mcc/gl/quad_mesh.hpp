@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <glm/glm.hpp>
+
+#include <mcc/gl/vertex_array.hpp>
+#include <mcc/gl/texture_buffer.hpp>
+#include <mcc/gl/voxel.hpp>
+#include <mcc/gl/mesher.hpp>
+
+namespace mcc::gl {
+    /*
+        Greedy mesh stored as packed quads (see gl::Quad), without vertex or index buffers.
+        Each quad is drawn as six vertices, which get_vertex_shader() pulls from a buffer texture using gl_VertexID.
+        A quad takes 12 bytes, instead of the 4 vertices and 6 indices (136 bytes) of a gl::Mesh quad.
+    */
+    class QuadMesh final {
+    public:
+        // Texture unit the quads are bound to when drawing
+        static constexpr unsigned int texture_unit = 0;
+
+        QuadMesh() = default;
+        QuadMesh(const QuadMesh&) = delete;
+        QuadMesh(QuadMesh&& rhs);
+        ~QuadMesh() = default;
+
+        // The shader must be bound before drawing, with its voxel_size uniform set to get_voxel_size().
+        void draw_opaque() const;
+        // Skips the face directions which face away from the camera. The position is on the mesh's space.
+        void draw_opaque(const glm::vec3& camera_pos) const;
+        void draw_transparent() const;
+
+        void update(const Matrix& matrix, float vx_sz, bool generate_borders = true, bool bake_ao = false, ThreadPool* pool = nullptr);
+        // Uploads new quads. The buffer is reused when it is large enough, and grows geometrically otherwise.
+        void update(const QuadData& data, float vx_sz);
+
+        inline float get_voxel_size() const { return this->vx_sz; }
+        inline size_t get_quad_count() const { return this->quad_count; }
+
+        // Returns the source of a vertex shader which expands the quads. Uniforms: usamplerBuffer quads, float voxel_size,
+        // mat4 model, view and projection. Outputs: frag_albedo, frag_color, frag_pos, frag_normal and frag_ao, in view space.
+        static const char* get_vertex_shader();
+
+        // Creates and destroys the vertex array shared by every quad mesh. Must be called while the GL context is
+        // current, before drawing any quad mesh and before the context is destroyed, respectively.
+        static void init();
+        static void terminate();
+
+    private:
+        // Has no attributes, but drawing requires a bound vertex array
+        static VertexArray vertex_array;
+
+        gl::TextureBuffer quads;
+
+        size_t capacity = 0; // Buffer size in bytes
+        unsigned int quad_count = 0;
+        unsigned int opaque_ranges[face_direction_count + 1] = {};
+        glm::vec3 min = { 0.0f, 0.0f, 0.0f }, max = { 0.0f, 0.0f, 0.0f }; // In voxels
+        float vx_sz = 1.0f;
+    };
+}
@@ -0,0 +1,233 @@
+#include <mcc/gl/raycast.hpp>
+
+#include <cmath>
+
+using namespace mcc;
+using namespace mcc::gl;
+
+namespace {
+    // Distance along a ray to the plane at a voxel boundary of an axis, where inv is the inverse of the ray's direction.
+    // Both traversals compute these the same way, so that they visit the same voxels.
+    inline float crossing(const Ray& ray, const glm::vec3& inv, int axis, int boundary) {
+        return (float(boundary) - ray.origin[axis]) * inv[axis];
+    }
+
+    // Finds the voxel where a ray enters a box of the given size at distance t.
+    // The point is clamped to the box, so that rounding errors never place it outside.
+    glm::ivec3 entry_voxel(const Ray& ray, float t, int axis, const glm::ivec3& size, glm::ivec3& normal) {
+        auto voxel = glm::ivec3(glm::floor(ray.origin + ray.direction * t));
+        voxel = glm::clamp(voxel, glm::ivec3(0), size - 1);
+        normal = { 0, 0, 0 };
+        if (axis >= 0) {
+            bool positive = ray.direction[axis] > 0.0f;
+            voxel[axis] = positive ? 0 : size[axis] - 1;
+            normal[axis] = positive ? -1 : 1;
+        }
+        return voxel;
+    }
+}
+
+bool mcc::gl::clip_ray(const Ray& ray, const glm::vec3& min, const glm::vec3& max, float& near, float& far, int& axis) {
+    near = 0.0f;
+    far = ray.max_distance;
+    axis = -1;
+
+    for (int i = 0; i < 3; ++i) {
+        if (ray.direction[i] == 0.0f) {
+            if (ray.origin[i] < min[i] || ray.origin[i] >= max[i]) {
+                return false;
+            }
+            continue;
+        }
+
+        float t0 = (min[i] - ray.origin[i]) / ray.direction[i];
+        float t1 = (max[i] - ray.origin[i]) / ray.direction[i];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+
+        if (t0 > near) {
+            near = t0;
+            axis = i;
+        }
+        far = glm::min(far, t1);
+    }
+
+    return near <= far;
+}
+
+bool mcc::gl::raycast(const Matrix& matrix, const Ray& ray, RayHit& hit) {
+    hit = RayHit();
+
+    auto size = glm::ivec3(matrix.size);
+    float near, far;
+    int axis;
+    if (size.x == 0 || size.y == 0 || size.z == 0 ||
+        !clip_ray(ray, glm::vec3(0.0f), glm::vec3(size), near, far, axis)) {
+        return false;
+    }
+
+    glm::ivec3 normal;
+    auto voxel = entry_voxel(ray, near, axis, size, normal);
+    auto inv = 1.0f / ray.direction;
+
+    // Amanatides and Woo's traversal, with the distances to the next voxel boundary on each axis.
+    // The distances are computed from the boundaries instead of accumulated, so that the octree traversal matches them.
+    glm::ivec3 step;
+    glm::vec3 t_max;
+    for (int i = 0; i < 3; ++i) {
+        step[i] = ray.direction[i] > 0.0f ? 1 : (ray.direction[i] < 0.0f ? -1 : 0);
+        t_max[i] = step[i] == 0 ? INFINITY : crossing(ray, inv, i, voxel[i] + (step[i] > 0 ? 1 : 0));
+    }
+
+    float t = near;
+    for (;;) {
+        hit.steps += 1;
+        auto material = matrix.voxels[matrix.get_index(voxel.x, voxel.y, voxel.z)];
+        if (material != 0) {
+            hit.distance = t;
+            hit.voxel = voxel;
+            hit.normal = normal;
+            hit.material = material;
+            return true;
+        }
+
+        // Ties are broken towards the last axis
+        int a = t_max.x < t_max.y ? (t_max.x < t_max.z ? 0 : 2) : (t_max.y < t_max.z ? 1 : 2);
+        t = t_max[a];
+        voxel[a] += step[a];
+        if (t > far || voxel[a] < 0 || voxel[a] >= size[a]) {
+            return false;
+        }
+
+        t_max[a] = crossing(ray, inv, a, voxel[a] + (step[a] > 0 ? 1 : 0));
+        normal = { 0, 0, 0 };
+        normal[a] = -step[a];
+    }
+}
+
+bool mcc::gl::raycast(const Octree& octree, int radius, const Ray& ray, RayHit& hit) {
+    hit = RayHit();
+
+    float near, far;
+    int axis;
+    if (octree.voxels.empty() || !clip_ray(ray, glm::vec3(0.0f), glm::vec3(float(radius)), near, far, axis)) {
+        return false;
+    }
+
+    int depth = 0;
+    while ((1 << depth) < radius) {
+        depth += 1;
+    }
+
+    glm::ivec3 normal;
+    auto voxel = entry_voxel(ray, near, axis, glm::ivec3(radius), normal);
+    auto inv = 1.0f / ray.direction;
+
+    // Nodes from the root to the current node. The node at level i covers radius >> i voxels on each axis.
+    unsigned int path[32];
+    path[0] = 0;
+    int level = 0;
+
+    float t = near;
+    for (;;) {
+        // Descend to the leaf which contains the current voxel
+        while (octree.voxels[path[level]].child != 0) {
+            int shift = depth - level - 1;
+            int child = ((voxel.x >> shift) & 1) * 4 + ((voxel.y >> shift) & 1) * 2 + ((voxel.z >> shift) & 1);
+            path[level + 1] = octree.voxels[path[level]].child + child;
+            level += 1;
+        }
+
+        hit.steps += 1;
+        auto& node = octree.voxels[path[level]];
+        if (node.material != 0) {
+            hit.distance = t;
+            hit.voxel = voxel;
+            hit.normal = normal;
+            hit.material = node.material;
+            return true;
+        }
+
+        // Find the face through which the ray leaves the node, breaking ties as the matrix traversal does
+        int size = radius >> level;
+        auto node_min = voxel & glm::ivec3(~(size - 1));
+        int a = -1;
+        float exit = INFINITY;
+        for (int i = 0; i < 3; ++i) {
+            if (ray.direction[i] != 0.0f) {
+                float t_i = crossing(ray, inv, i, ray.direction[i] > 0.0f ? node_min[i] + size : node_min[i]);
+                if (t_i <= exit) {
+                    exit = t_i;
+                    a = i;
+                }
+            }
+        }
+
+        t = glm::max(exit, t);
+        if (a == -1 || t > far) {
+            return false;
+        }
+
+        // The next voxel is on the other side of that face. On the other axes, it is the last voxel of the node
+        // which the matrix traversal would have entered before crossing the face.
+        int step = ray.direction[a] > 0.0f ? 1 : -1;
+        auto next = glm::clamp(glm::ivec3(glm::floor(ray.origin + ray.direction * t)), node_min, node_min + size - 1);
+        for (int i = 0; i < 3; ++i) {
+            if (i == a || ray.direction[i] == 0.0f) {
+                next[i] = voxel[i];
+                continue;
+            }
+
+            auto crossed = [&](int boundary) {
+                float t_b = crossing(ray, inv, i, boundary);
+                return t_b < exit || (t_b == exit && i > a);
+            };
+
+            if (ray.direction[i] > 0.0f) {
+                while (next[i] + 1 < node_min[i] + size && crossed(next[i] + 1)) {
+                    next[i] += 1;
+                }
+                while (next[i] > node_min[i] && !crossed(next[i])) {
+                    next[i] -= 1;
+                }
+            } else {
+                while (next[i] > node_min[i] && crossed(next[i])) {
+                    next[i] -= 1;
+                }
+                while (next[i] + 1 < node_min[i] + size && !crossed(next[i] + 1)) {
+                    next[i] += 1;
+                }
+            }
+        }
+
+        next[a] = step > 0 ? node_min[a] + size : node_min[a] - 1;
+        if (next[a] < 0 || next[a] >= radius) {
+            return false;
+        }
+
+        normal = { 0, 0, 0 };
+        normal[a] = -step;
+
+        // Go back up to the deepest node which contains both voxels
+        int diff = (next.x ^ voxel.x) | (next.y ^ voxel.y) | (next.z ^ voxel.z);
+        int highest = 0;
+        while ((diff >> (highest + 1)) != 0) {
+            highest += 1;
+        }
+        level = glm::min(level, depth - highest - 1);
+        voxel = next;
+    }
+}
+
+void mcc::gl::raycast(const Matrix& matrix, const std::vector<Ray>& rays, std::vector<RayHit>& hits, ThreadPool* pool) {
+    raycast_batch(rays, hits, pool, [&](const Ray& ray, RayHit& hit) {
+        raycast(matrix, ray, hit);
+    });
+}
+
+void mcc::gl::raycast(const Octree& octree, int radius, const std::vector<Ray>& rays, std::vector<RayHit>& hits, ThreadPool* pool) {
+    raycast_batch(rays, hits, pool, [&](const Ray& ray, RayHit& hit) {
+        raycast(octree, radius, ray, hit);
+    });
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <mcc/gl/voxel.hpp>
+#include <mcc/thread_pool.hpp>
+
+namespace mcc::gl {
+    struct Ray {
+        glm::vec3 origin;
+        glm::vec3 direction; // Must be normalized
+        float max_distance;
+    };
+
+    struct RayHit {
+        float distance = 0.0f;         // Along the ray, to the face which was hit
+        glm::ivec3 voxel = { 0, 0, 0 };  // Voxel which was hit
+        glm::ivec3 normal = { 0, 0, 0 }; // Normal of the face which was hit, zero if the ray starts inside the voxel
+        unsigned char material = 0;    // 0 = nothing was hit
+        unsigned int steps = 0;        // Number of cells visited, for profiling
+    };
+
+    // Casts a ray through the voxel space of a matrix, where voxel (x, y, z) spans [x, x + 1) on each axis.
+    // Returns true if a non-empty voxel is hit within the ray's max distance.
+    bool raycast(const Matrix& matrix, const Ray& ray, RayHit& hit);
+    // Casts a ray through an octree built by matrix_to_octree(), on the same voxel space. The root spans [0, radius) on each
+    // axis, where radius is a power of two. Uniform nodes are crossed in a single step, and the voxel reported is the one
+    // of the hit node under the hit point.
+    bool raycast(const Octree& octree, int radius, const Ray& ray, RayHit& hit);
+
+    // Batched versions, where the misses are left with material 0. If a thread pool is passed, the rays are split between
+    // its threads. These functions only read the voxels, so they may run concurrently with other readers.
+    void raycast(const Matrix& matrix, const std::vector<Ray>& rays, std::vector<RayHit>& hits, ThreadPool* pool = nullptr);
+    void raycast(const Octree& octree, int radius, const std::vector<Ray>& rays, std::vector<RayHit>& hits, ThreadPool* pool = nullptr);
+
+    // Calls cast(ray, hit) for every ray and its hit, splitting the rays in tasks between the threads of a pool, if passed.
+    template <typename F>
+    void raycast_batch(const std::vector<Ray>& rays, std::vector<RayHit>& hits, ThreadPool* pool, F&& cast) {
+        const size_t rays_per_task = 256;
+
+        hits.resize(rays.size());
+        ThreadPool::parallel_for_range(pool, rays.size(), rays_per_task, [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; ++j) {
+                cast(rays[j], hits[j]);
+            }
+        });
+    }
+
+    // Clips a ray against an axis aligned box, returning false if it doesn't cross the box within [0, max_distance].
+    // On success, near and far are the clipped distances and axis is the axis of the entered face (-1 if the ray starts inside).
+    bool clip_ray(const Ray& ray, const glm::vec3& min, const glm::vec3& max, float& near, float& far, int& axis);
+}
@@ -0,0 +1,116 @@
+#include <mcc/gl/texture_buffer.hpp>
+
+#include <GL/glew.h>
+
+using namespace mcc;
+using namespace mcc::gl;
+
+static GLenum to_gl_format(TextureBuffer::Format format) {
+    if (format == TextureBuffer::Format::R32UI) {
+        return GL_R32UI;
+    } else if (format == TextureBuffer::Format::RG32UI) {
+        return GL_RG32UI;
+    } else if (format == TextureBuffer::Format::RGB32UI) {
+        return GL_RGB32UI;
+    } else if (format == TextureBuffer::Format::RGBA32UI) {
+        return GL_RGBA32UI;
+    } else {
+        std::abort(); // Unreachable code
+    }
+}
+
+Result<TextureBuffer, std::string> TextureBuffer::create(size_t size, const void* data, Usage usage, Format format) {
+    GLuint tbo, texture;
+
+    glGenBuffers(1, &tbo);
+    glBindBuffer(GL_TEXTURE_BUFFER, tbo);
+    glBufferData(GL_TEXTURE_BUFFER, size, data, to_gl_usage(usage));
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, to_gl_format(format), tbo);
+
+    auto err = glGetError();
+    if (err != 0) {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &tbo);
+        return Result<TextureBuffer, std::string>::error("TextureBuffer::create() failed:\nglGetError() returned " + std::to_string(err));
+    }
+
+    return Result<TextureBuffer, std::string>::success(std::move(TextureBuffer(tbo, texture)));
+}
+
+TextureBuffer::TextureBuffer(unsigned int tbo, unsigned int texture) :
+    tbo(tbo), texture(texture) {
+    // Empty
+}
+
+TextureBuffer::TextureBuffer(TextureBuffer&& rhs) {
+    this->tbo = rhs.tbo;
+    this->texture = rhs.texture;
+    rhs.tbo = 0;
+    rhs.texture = 0;
+}
+
+TextureBuffer& TextureBuffer::operator=(TextureBuffer&& rhs) {
+    if (this->texture != 0) {
+        glDeleteTextures(1, &this->texture);
+    }
+
+    if (this->tbo != 0) {
+        glDeleteBuffers(1, &this->tbo);
+    }
+
+    this->tbo = rhs.tbo;
+    this->texture = rhs.texture;
+    rhs.tbo = 0;
+    rhs.texture = 0;
+
+    return *this;
+}
+
+TextureBuffer::~TextureBuffer() {
+    if (this->texture != 0) {
+        glDeleteTextures(1, &this->texture);
+    }
+
+    if (this->tbo != 0) {
+        glDeleteBuffers(1, &this->tbo);
+    }
+}
+
+Result<void, std::string> TextureBuffer::update(size_t offset, size_t size, const void* data) {
+    glBindBuffer(GL_TEXTURE_BUFFER, this->tbo);
+    glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(offset), GLsizeiptr(size), data);
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<void, std::string>::error(
+            "TextureBuffer::update() failed:\n"
+            "glGetError() returned '" + std::to_string(err) + "'"
+        );
+    }
+
+    return Result<void, std::string>::success();
+}
+
+Result<void, std::string> TextureBuffer::allocate(size_t size, const void* data, Usage usage) {
+    // The buffer texture references the buffer object, not its storage, so it sees the new storage
+    glBindBuffer(GL_TEXTURE_BUFFER, this->tbo);
+    glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(size), data, to_gl_usage(usage));
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<void, std::string>::error(
+            "TextureBuffer::allocate() failed:\n"
+            "glGetError() returned '" + std::to_string(err) + "'"
+        );
+    }
+
+    return Result<void, std::string>::success();
+}
+
+void TextureBuffer::bind(unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include <mcc/result.hpp>
+#include <mcc/gl/usage.hpp>
+
+namespace mcc::gl {
+    // Buffer object read by shaders through a buffer texture (samplerBuffer), with texelFetch().
+    class TextureBuffer final {
+    public:
+        // Texel formats, with 1 to 4 unsigned 32 bit integers per texel (read with an usamplerBuffer).
+        enum class Format {
+            R32UI,
+            RG32UI,
+            RGB32UI,
+            RGBA32UI,
+        };
+
+        inline TextureBuffer() : tbo(0), texture(0) {}
+        TextureBuffer(TextureBuffer&& rhs);
+        TextureBuffer& operator=(TextureBuffer&& rhs);
+        ~TextureBuffer();
+
+        static Result<TextureBuffer, std::string> create(size_t size, const void* data, Usage usage, Format format);
+
+        Result<void, std::string> update(size_t offset, size_t size, const void* data);
+        // Replaces the buffer storage, keeping the same buffer and texture objects. The old storage is orphaned.
+        Result<void, std::string> allocate(size_t size, const void* data, Usage usage);
+        // Binds the buffer texture to a texture unit.
+        void bind(unsigned int unit) const;
+
+    private:
+        TextureBuffer(unsigned int tbo, unsigned int texture);
+
+        unsigned int tbo, texture;
+    };
+}
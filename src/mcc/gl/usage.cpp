@@ -0,0 +1,17 @@
+#include <mcc/gl/usage.hpp>
+
+#include <GL/glew.h>
+
+#include <cstdlib>
+
+unsigned int mcc::gl::to_gl_usage(Usage usage) {
+    if (usage == Usage::Static) {
+        return GL_STATIC_DRAW;
+    } else if (usage == Usage::Dynamic) {
+        return GL_DYNAMIC_DRAW;
+    } else if (usage == Usage::Stream) {
+        return GL_STREAM_DRAW;
+    } else {
+        std::abort(); // Unreachable code
+    }
+}
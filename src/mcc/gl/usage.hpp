@@ -6,4 +6,7 @@ namespace mcc::gl {
         Dynamic,
         Stream
     };
+
+    // Converts a buffer usage to the matching OpenGL usage hint (a GLenum)
+    unsigned int to_gl_usage(Usage usage);
 }
\ No newline at end of file
@@ -5,7 +5,73 @@
 using namespace mcc;
 using namespace mcc::gl;
 
+static void to_gl_type(Attribute::Type type, GLenum& gl_type, GLboolean& gl_normalized) {
+    switch (type) {
+        case Attribute::Type::U8: {
+            gl_type = GL_UNSIGNED_BYTE;
+            gl_normalized = GL_FALSE;
+            break;
+        }
+
+        case Attribute::Type::I8: {
+            gl_type = GL_BYTE;
+            gl_normalized = GL_FALSE;
+            break;
+        }
+
+        case Attribute::Type::NU8: {
+            gl_type = GL_UNSIGNED_BYTE;
+            gl_normalized = GL_TRUE;
+            break;
+        }
+
+        case Attribute::Type::NI8: {
+            gl_type = GL_BYTE;
+            gl_normalized = GL_TRUE;
+            break;
+        }
+
+        case Attribute::Type::U32: {
+            gl_type = GL_UNSIGNED_INT;
+            gl_normalized = GL_FALSE;
+            break;
+        }
+
+        case Attribute::Type::I32: {
+            gl_type = GL_INT;
+            gl_normalized = GL_FALSE;
+            break;
+        }
+
+        case Attribute::Type::NU32: {
+            gl_type = GL_UNSIGNED_INT;
+            gl_normalized = GL_TRUE;
+            break;
+        }
+
+        case Attribute::Type::NI32: {
+            gl_type = GL_INT;
+            gl_normalized = GL_TRUE;
+            break;
+        }
+
+        case Attribute::Type::F32: {
+            gl_type = GL_FLOAT;
+            gl_normalized = GL_FALSE;
+            break;
+        }
+
+        default: {
+            std::abort(); // Unreachable code
+        }
+    }
+}
+
 Result<VertexArray, std::string> VertexArray::create(std::initializer_list<Attribute> attributes) {
+    return VertexArray::create(std::vector<Attribute>(attributes));
+}
+
+Result<VertexArray, std::string> VertexArray::create(const std::vector<Attribute>& attributes) {
     GLuint vao;
     
     glGenVertexArrays(1, &vao);
@@ -14,67 +80,8 @@ Result<VertexArray, std::string> VertexArray::create(std::initializer_list<Attri
     for (auto& attribute : attributes) {
         GLenum gl_type;
         GLboolean gl_normalized;
+        to_gl_type(attribute.type, gl_type, gl_normalized);
 
-        switch (attribute.type) {
-            case Attribute::Type::U8: {
-                gl_type = GL_UNSIGNED_BYTE;
-                gl_normalized = GL_FALSE;
-                break;
-            }
-
-            case Attribute::Type::I8: {
-                gl_type = GL_BYTE;
-                gl_normalized = GL_FALSE;
-                break;
-            }
-
-            case Attribute::Type::NU8: {
-                gl_type = GL_UNSIGNED_BYTE;
-                gl_normalized = GL_TRUE;
-                break;
-            }
-
-            case Attribute::Type::NI8: {
-                gl_type = GL_BYTE;
-                gl_normalized = GL_TRUE;
-                break;
-            }
-
-            case Attribute::Type::U32: {
-                gl_type = GL_UNSIGNED_INT;
-                gl_normalized = GL_FALSE;
-                break;
-            }
-
-            case Attribute::Type::I32: {
-                gl_type = GL_INT;
-                gl_normalized = GL_FALSE;
-                break;
-            }
-
-            case Attribute::Type::NU32: {
-                gl_type = GL_UNSIGNED_INT;
-                gl_normalized = GL_TRUE;
-                break;
-            }
-
-            case Attribute::Type::NI32: {
-                gl_type = GL_INT;
-                gl_normalized = GL_TRUE;
-                break;
-            }
-
-            case Attribute::Type::F32: {
-                gl_type = GL_FLOAT;
-                gl_normalized = GL_FALSE;
-                break;
-            }
-
-            default: {
-                std::abort(); // Unreachable code
-            }
-        }
-        
         glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer.vbo);
         glVertexAttribPointer(
             attribute.shader_location,
@@ -86,6 +93,9 @@ Result<VertexArray, std::string> VertexArray::create(std::initializer_list<Attri
         );
 
         glEnableVertexAttribArray(attribute.shader_location);
+        if (attribute.divisor != 0) {
+            glVertexAttribDivisor(attribute.shader_location, attribute.divisor);
+        }
     }
 
     
@@ -97,6 +107,33 @@ Result<VertexArray, std::string> VertexArray::create(std::initializer_list<Attri
     return Result<VertexArray, std::string>::success(std::move(VertexArray(vao)));
 }
 
+Result<VertexArray, std::string> VertexArray::create_format(const std::vector<AttributeFormat>& attributes) {
+    GLuint vao;
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    for (auto& attribute : attributes) {
+        GLenum gl_type;
+        GLboolean gl_normalized;
+        to_gl_type(attribute.type, gl_type, gl_normalized);
+
+        glVertexAttribFormat(attribute.shader_location, attribute.size, gl_type, gl_normalized, GLuint(attribute.offset));
+        glVertexAttribBinding(attribute.shader_location, attribute.binding);
+        glEnableVertexAttribArray(attribute.shader_location);
+        if (attribute.divisor != 0) {
+            glVertexBindingDivisor(attribute.binding, attribute.divisor);
+        }
+    }
+
+    auto err = glGetError();
+    if (err != 0) {
+        return Result<VertexArray, std::string>::error("VertexArray::create_format() failed:\nglGetError() returned " + std::to_string(err));
+    }
+
+    return Result<VertexArray, std::string>::success(std::move(VertexArray(vao)));
+}
+
 VertexArray::VertexArray(unsigned int vao) :
     vao(vao) {
     // Empty
@@ -136,3 +173,7 @@ void VertexArray::bind() const {
 #endif
     glBindVertexArray(this->vao);
 }
+
+void VertexArray::bind_buffer(unsigned int binding, const VertexBuffer& buffer, size_t offset, size_t stride) const {
+    glBindVertexBuffer(binding, buffer.vbo, GLintptr(offset), GLsizei(stride));
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <mcc/result.hpp>
 #include <mcc/gl/vertex_buffer.hpp>
@@ -22,8 +23,9 @@ namespace mcc::gl {
             F32,        
         };
 
-        inline Attribute(const VertexBuffer& buffer, size_t stride, size_t offset, int size, Type type, unsigned int shader_location) : 
-            buffer(buffer), stride(stride), offset(offset), size(size), type(type), shader_location(shader_location) {
+        // If divisor isn't 0, the attribute advances once every divisor instances instead of once per vertex.
+        inline Attribute(const VertexBuffer& buffer, size_t stride, size_t offset, int size, Type type, unsigned int shader_location, unsigned int divisor = 0) : 
+            buffer(buffer), stride(stride), offset(offset), size(size), type(type), shader_location(shader_location), divisor(divisor) {
             // Empty
         }
 
@@ -41,6 +43,32 @@ namespace mcc::gl {
         Type type;
         
         unsigned int shader_location;
+        unsigned int divisor;
+    };
+
+    // Attribute of a format-only vertex array. Instead of a buffer, it reads from a binding point, where any buffer
+    // with a matching layout can be bound.
+    class AttributeFormat {
+    public:
+        // If divisor isn't 0, the attributes of the binding point advance once every divisor instances.
+        inline AttributeFormat(unsigned int binding, size_t offset, int size, Attribute::Type type, unsigned int shader_location, unsigned int divisor = 0) :
+            binding(binding), offset(offset), size(size), type(type), shader_location(shader_location), divisor(divisor) {
+            // Empty
+        }
+
+        ~AttributeFormat() = default;
+
+    private:
+        friend class VertexArray;
+
+        unsigned int binding;
+        size_t offset;
+
+        int size;
+        Attribute::Type type;
+
+        unsigned int shader_location;
+        unsigned int divisor;
     };
 
     class VertexArray final {
@@ -51,8 +79,13 @@ namespace mcc::gl {
         ~VertexArray();
 
         static Result<VertexArray, std::string> create(std::initializer_list<Attribute> attributes);
+        static Result<VertexArray, std::string> create(const std::vector<Attribute>& attributes);
+        // Creates a vertex array which only stores a vertex format, so that it can be shared by many buffers.
+        static Result<VertexArray, std::string> create_format(const std::vector<AttributeFormat>& attributes);
         
         void bind() const;
+        // Binds a buffer to a binding point of a format-only vertex array. The vertex array must be bound.
+        void bind_buffer(unsigned int binding, const VertexBuffer& buffer, size_t offset, size_t stride) const;
 
     private:
         friend class VertexArray;
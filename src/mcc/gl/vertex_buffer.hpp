@@ -17,6 +17,11 @@ namespace mcc::gl {
 
         void bind();
         Result<void, std::string> update(size_t offset, size_t size, const void* data);
+        // Replaces the buffer storage, keeping the same buffer object. The old storage is orphaned, so this doesn't
+        // wait for draws which are still using it. If data is nullptr, the new contents are undefined.
+        Result<void, std::string> allocate(size_t size, const void* data, Usage usage);
+        // Copies size bytes from another buffer, on the GPU.
+        Result<void, std::string> copy(const VertexBuffer& src, size_t src_offset, size_t offset, size_t size);
         Result<void*, std::string> map();
         void unmap();
 
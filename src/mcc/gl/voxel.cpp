@@ -1,97 +1,455 @@
 #include <mcc/gl/voxel.hpp>
-#include <functional>
-#include <iostream>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 
 using namespace mcc;
 using namespace mcc::gl;
 
-Octree mcc::gl::matrix_to_octree(const Matrix& matrix) {
-    Octree octree;
-    memcpy(octree.palette, matrix.palette, sizeof(octree.palette));
+namespace {
+    const uint64_t ones = 0x0101010101010101ull;
 
-    auto& sz = matrix.size;
-    int radius = 1;
-    while (radius < glm::max(sz.x, glm::max(sz.y, sz.z))) {
-        radius *= 2;
+    uint64_t load_block(const unsigned char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
     }
 
-    // Returns the material of a region. If not all voxels share the same material, -1 is returned.
-    std::function<int(int, int, int, int)> get_mat = [&](int x, int y, int z, int width) -> int {
-        if (width == 1) {
-            if (x < 0 || x >= sz.x || y < 0 || y >= sz.y || z < 0 || z >= sz.z) {
-                return 0;
+    // Number of bytes of a block which are equal to a value
+    int count_equal(uint64_t block, unsigned char value) {
+        uint64_t t = block ^ (ones * value);
+        uint64_t zero = ~(((t & (ones * 0x7F)) + ones * 0x7F) | t | (ones * 0x7F)); // 0x80 on each zero byte
+        return int(((zero >> 7) * ones) >> 56);
+    }
+
+    // Most common material of 8 children. Ties are broken by the first child with that material, as in octree order.
+    unsigned char block_mode(uint64_t block) {
+        int max_count = 0;
+        unsigned char mode = 0;
+        for (int i = 0; i < 8 && max_count <= 4; ++i) {
+            auto mat = (unsigned char)(block >> (i * 8));
+            int count = count_equal(block, mat);
+            if (count > max_count) {
+                max_count = count;
+                mode = mat;
             }
-            return matrix.voxels[x * sz.y * sz.z + y * sz.z + z];
-        }
-        else {
-            int mat = -2;
-            int w = width / 2;
-            for (int a = 0; a <= 1; ++a) {
-                for (int b = 0; b <= 1; ++b) {
-                    for (int c = 0; c <= 1; ++c) {
-                        auto m = get_mat(x + a * w, y + b * w, z + c * w, w);
-                        if (mat == -2) {
-                            mat = m;
-                        }
-                        else if (mat != m) {
-                            mat = -1;
-                        }
+        }
+        return mode;
+    }
+
+    // Reduces a 2x2x2 block of cells into their parent, testing the 8 children at once. Returns false if it isn't uniform.
+    bool reduce_block(const unsigned char* materials, const unsigned char* uniform, unsigned char& material) {
+        uint64_t block = load_block(materials);
+        auto first = (unsigned char)block;
+        if (load_block(uniform) == ones && block == ones * first) {
+            material = first;
+            return true;
+        }
+        material = block_mode(block);
+        return false;
+    }
+
+    // Material and uniformity (1 if all voxels of the cell share its material) of every cell of an octree, level by level.
+    // The cells of a non-uniform region store the most common material of their children.
+    // Levels from sparse_level up only store the cells with non-empty bricks below them, sorted by their Morton codes on
+    // codes[level]. The cells missing from them are uniform and empty. The levels below are stored densely, with the
+    // children of the cell at index i at indices i * 8 to i * 8 + 7. Below a sparse level, they are only stored for the
+    // non-empty bricks, slot by slot, in Morton order within each brick.
+    struct Levels {
+        int depth, sparse_level;
+        std::vector<std::vector<unsigned char>> materials, uniform;
+        std::vector<std::vector<uint32_t>> codes;
+        std::vector<unsigned int> slots; // Brick slot of each cell of sparse_level
+        size_t node_count;
+
+        // Reduces a dense level into the level above it
+        void reduce(int level) {
+            auto& child_materials = this->materials[level - 1];
+            auto& child_uniform = this->uniform[level - 1];
+            size_t count = child_materials.size() / 8;
+            this->materials[level].resize(count);
+            this->uniform[level].resize(count);
+
+            for (size_t i = 0; i < count; ++i) {
+                bool uniform = reduce_block(&child_materials[i * 8], &child_uniform[i * 8], this->materials[level][i]);
+                this->uniform[level][i] = uniform ? 1 : 0;
+                if (!uniform) {
+                    this->node_count += 8;
+                }
+            }
+        }
+
+        // Reduces a sparse level into the level above it, filling in the missing children as uniform empty cells
+        void reduce_sparse(int level) {
+            auto& child_codes = this->codes[level - 1];
+            auto& child_materials = this->materials[level - 1];
+            auto& child_uniform = this->uniform[level - 1];
+
+            for (size_t i = 0; i < child_codes.size();) {
+                auto parent = child_codes[i] >> 3;
+                unsigned char block_materials[8] = {}, block_uniform[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+                for (; i < child_codes.size() && (child_codes[i] >> 3) == parent; ++i) {
+                    block_materials[child_codes[i] & 7] = child_materials[i];
+                    block_uniform[child_codes[i] & 7] = child_uniform[i];
+                }
+
+                unsigned char material;
+                bool uniform = reduce_block(block_materials, block_uniform, material);
+                this->codes[level].push_back(parent);
+                this->materials[level].push_back(material);
+                this->uniform[level].push_back(uniform ? 1 : 0);
+                if (!uniform) {
+                    this->node_count += 8;
+                }
+            }
+        }
+
+        // Emits the nodes from the root, allocating the children of each node before visiting them in order
+        Octree emit() const {
+            // Index of the cell on its level, or -1 for the cells missing from a sparse level
+            struct Visit {
+                unsigned int node;
+                int level;
+                int64_t index;
+            };
+
+            Octree octree;
+            octree.voxels.resize(this->node_count);
+            int64_t root = this->depth < this->sparse_level || !this->codes[this->depth].empty() ? 0 : -1;
+            std::vector<Visit> stack = { { 0, this->depth, root } };
+            unsigned int next = 1;
+
+            while (!stack.empty()) {
+                auto visit = stack.back();
+                stack.pop_back();
+
+                auto& voxel = octree.voxels[visit.node];
+                if (visit.index < 0 || this->uniform[visit.level][size_t(visit.index)]) {
+                    voxel.material = visit.index < 0 ? 0 : this->materials[visit.level][size_t(visit.index)];
+                    voxel.child = 0;
+                    continue;
+                }
+                voxel.material = this->materials[visit.level][size_t(visit.index)];
+
+                voxel.child = next;
+                next += 8;
+                int64_t children[8];
+                if (visit.level > this->sparse_level) {
+                    // The children are consecutive on the level below, as the codes are sorted
+                    auto& child_codes = this->codes[visit.level - 1];
+                    auto first = this->codes[visit.level][size_t(visit.index)] << 3;
+                    auto it = std::lower_bound(child_codes.begin(), child_codes.end(), first);
+                    for (int i = 0; i < 8; ++i) {
+                        bool found = it != child_codes.end() && *it == first + uint32_t(i);
+                        children[i] = found ? int64_t(it - child_codes.begin()) : -1;
+                        it += found ? 1 : 0;
+                    }
+                } else {
+                    auto base = visit.level == this->sparse_level ? int64_t(this->slots[size_t(visit.index)]) : visit.index;
+                    for (int i = 0; i < 8; ++i) {
+                        children[i] = base * 8 + i;
                     }
                 }
+
+                for (int i = 7; i >= 0; --i) {
+                    stack.push_back({ voxel.child + i, visit.level - 1, children[i] });
+                }
             }
-            return mat;
+
+            return octree;
         }
     };
-    
-    std::function<void(int, int, int, int, int)> build = [&](int index, int x, int y, int z, int width) {
-        auto mat = get_mat(x, y, z, width);
-        if (mat == -1) {
-            // Subdivide
-            int vi = octree.voxels.size();
-            octree.voxels.resize(vi + 8);
-
-            int w = width / 2;
-            for (int a = 0; a <= 1; ++a) {
-                for (int b = 0; b <= 1; ++b) {
-                    for (int c = 0; c <= 1; ++c) {
-                        build(vi + a * 4 + b * 2 + c, x + a * w, y + b * w, z + c * w, w);
-                    }
+
+    int octree_depth(glm::uvec3 size, int& radius) {
+        int depth = 0;
+        radius = 1;
+        while (radius < int(glm::max(size.x, glm::max(size.y, size.z)))) {
+            radius *= 2;
+            depth += 1;
+        }
+        return depth;
+    }
+}
+
+Octree mcc::gl::matrix_to_octree(const Matrix& matrix) {
+    auto& sz = matrix.size;
+    int radius;
+    Levels levels;
+    levels.depth = octree_depth(glm::uvec3(sz), radius);
+    levels.sparse_level = levels.depth + 1;
+    levels.materials.resize(levels.depth + 1);
+    levels.uniform.resize(levels.depth + 1);
+    levels.node_count = 1;
+
+    // The voxels outside of the matrix are empty. A matrix in Morton order is already laid out as the first level.
+    if (matrix.layout == Matrix::Layout::Morton) {
+        levels.materials[0] = matrix.voxels;
+        levels.materials[0].resize(size_t(radius) * radius * radius, 0);
+    } else {
+        levels.materials[0].resize(size_t(radius) * radius * radius, 0);
+        for (int x = 0, i = 0; x < sz.x; ++x) {
+            for (int y = 0; y < sz.y; ++y) {
+                for (int z = 0; z < sz.z; ++z, ++i) {
+                    levels.materials[0][morton_encode(x, y, z)] = matrix.voxels[i];
                 }
             }
+        }
+    }
+    levels.uniform[0].resize(levels.materials[0].size(), 1);
+
+    for (int level = 1; level <= levels.depth; ++level) {
+        levels.reduce(level);
+    }
+
+    auto octree = levels.emit();
+    memcpy(octree.palette, matrix.palette, sizeof(octree.palette));
+    return octree;
+}
+
+Octree mcc::gl::brick_map_to_octree(const BrickMap& map) {
+    const int brick_depth = 3; // log2(BrickMap::brick_size)
 
-            int max_count = 0;
-            int mode_mat = 0;
+    int radius;
+    Levels levels;
+    levels.depth = octree_depth(map.size, radius);
+    levels.materials.resize(levels.depth + 1);
+    levels.uniform.resize(levels.depth + 1);
+    levels.codes.resize(levels.depth + 1);
+    levels.node_count = 1;
 
-            for (int i = vi; i < vi + 8; ++i) {
-                int count = 0;
+    if (levels.depth < brick_depth) {
+        // Smaller than a brick, so there are no whole bricks to reduce
+        levels.sparse_level = levels.depth + 1;
+        levels.materials[0].resize(size_t(radius) * radius * radius, 0);
+        levels.uniform[0].resize(levels.materials[0].size(), 1);
+        for (int x = 0; x < int(map.size.x); ++x) {
+            for (int y = 0; y < int(map.size.y); ++y) {
+                for (int z = 0; z < int(map.size.z); ++z) {
+                    levels.materials[0][morton_encode(x, y, z)] = map.get(x, y, z);
+                }
+            }
+        }
 
-                for (int j = vi; j < vi + 8; ++j) {
-                    if (octree.voxels[i].material == octree.voxels[j].material) {
-                        count += 1;
+        for (int level = 1; level <= levels.depth; ++level) {
+            levels.reduce(level);
+        }
+    } else {
+        // The levels inside the bricks are reduced slot by slot, as the slots are laid out in Morton order too
+        levels.sparse_level = brick_depth;
+        levels.materials[0] = map.voxels;
+        levels.uniform[0].resize(map.voxels.size(), 1);
+        for (int level = 1; level < brick_depth; ++level) {
+            levels.reduce(level);
+        }
+
+        // The brick level and the levels above it only hold the non-empty bricks and their ancestors
+        std::vector<std::pair<uint32_t, unsigned int>> bricks;
+        auto& bc = map.brick_count;
+        for (int x = 0, i = 0; x < int(bc.x); ++x) {
+            for (int y = 0; y < int(bc.y); ++y) {
+                for (int z = 0; z < int(bc.z); ++z, ++i) {
+                    if (map.table[i] != 0) {
+                        bricks.push_back({ morton_encode(x, y, z), map.table[i] - 1 });
                     }
                 }
+            }
+        }
+        std::sort(bricks.begin(), bricks.end());
+
+        auto& materials = levels.materials[brick_depth];
+        auto& uniform = levels.uniform[brick_depth];
+        auto& child_materials = levels.materials[brick_depth - 1];
+        auto& child_uniform = levels.uniform[brick_depth - 1];
+        materials.resize(bricks.size());
+        uniform.resize(bricks.size(), 1);
+        levels.codes[brick_depth].reserve(bricks.size());
+        levels.slots.reserve(bricks.size());
+        for (size_t i = 0; i < bricks.size(); ++i) {
+            auto slot = bricks[i].second;
+            levels.codes[brick_depth].push_back(bricks[i].first);
+            levels.slots.push_back(slot);
+            if (!reduce_block(&child_materials[slot * 8], &child_uniform[slot * 8], materials[i])) {
+                uniform[i] = 0;
+                levels.node_count += 8;
+            }
+        }
 
-                if (count > max_count) {
-                    max_count = count;
-                    mode_mat = octree.voxels[i].material;
+        for (int level = brick_depth + 1; level <= levels.depth; ++level) {
+            levels.reduce_sparse(level);
+        }
+    }
+
+    auto octree = levels.emit();
+    memcpy(octree.palette, map.palette, sizeof(octree.palette));
+    return octree;
+}
+
+size_t mcc::gl::Matrix::get_voxel_count() const {
+    if (this->size.x == 0 || this->size.y == 0 || this->size.z == 0) {
+        return 0;
+    }
+    if (this->layout == Layout::Morton) {
+        // Morton codes grow along every axis, so the last voxel has the largest code
+        return size_t(morton_encode(this->size.x - 1, this->size.y - 1, this->size.z - 1)) + 1;
+    }
+    return size_t(this->size.x) * this->size.y * this->size.z;
+}
+
+Occupancy mcc::gl::matrix_to_occupancy(const Matrix& matrix) {
+    Occupancy occupancy;
+    occupancy.size = glm::ivec3(matrix.size);
+    occupancy.words_per_row = (occupancy.size.z + 63) / 64;
+    occupancy.bits.assign(size_t(occupancy.size.x) * occupancy.size.y * occupancy.words_per_row, 0);
+
+    for (int x = 0; x < occupancy.size.x; ++x) {
+        for (int y = 0; y < occupancy.size.y; ++y) {
+            auto row = &occupancy.bits[(size_t(x) * occupancy.size.y + y) * occupancy.words_per_row];
+            for (int z = 0; z < occupancy.size.z; ++z) {
+                if (matrix.voxels[matrix.get_index(x, y, z)] != 0) {
+                    row[z / 64] |= uint64_t(1) << (z % 64);
                 }
             }
+        }
+    }
+
+    return occupancy;
+}
+
+bool mcc::gl::Occupancy::find(glm::ivec3 min, glm::ivec3 max, glm::ivec3& voxel) const {
+    min = glm::max(min, glm::ivec3(0));
+    max = glm::min(max, this->size);
+    if (min.x >= max.x || min.y >= max.y || min.z >= max.z) {
+        return false;
+    }
+
+    int first_word = min.z / 64, last_word = (max.z - 1) / 64;
+    for (int x = min.x; x < max.x; ++x) {
+        for (int y = min.y; y < max.y; ++y) {
+            auto row = &this->bits[(size_t(x) * this->size.y + y) * this->words_per_row];
+            for (int w = first_word; w <= last_word; ++w) {
+                // Mask out the bits outside of [min.z, max.z) on the first and last words
+                uint64_t word = row[w];
+                if (w == first_word) {
+                    word &= ~uint64_t(0) << (min.z % 64);
+                }
+                if (w == last_word && max.z % 64 != 0) {
+                    word &= ~(~uint64_t(0) << (max.z % 64));
+                }
 
-            octree.voxels[index].material = mode_mat;
-            octree.voxels[index].child = vi;
+                if (word != 0) {
+                    int z = w * 64;
+                    while ((word & 1) == 0) {
+                        word >>= 1;
+                        z += 1;
+                    }
+                    voxel = { x, y, z };
+                    return true;
+                }
+            }
         }
-        else {
-            if (mat == -2) {
-                mat = 0;
+    }
+
+    return false;
+}
+
+void mcc::gl::Matrix::set_layout(Layout layout) {
+    if (layout == this->layout) {
+        return;
+    }
+
+    auto& sz = this->size;
+    auto old_voxels = std::move(this->voxels);
+    auto old_light = std::move(this->light);
+    this->layout = layout;
+    this->voxels.assign(this->get_voxel_count(), 0);
+    this->light.assign(old_light.empty() ? 0 : this->voxels.size(), 0);
+    for (int x = 0, i = 0; x < sz.x; ++x) {
+        for (int y = 0; y < sz.y; ++y) {
+            for (int z = 0; z < sz.z; ++z, ++i) {
+                auto code = morton_encode(x, y, z);
+                auto to = layout == Layout::Morton ? code : i;
+                auto from = layout == Layout::Morton ? i : code;
+                this->voxels[to] = old_voxels[from];
+                if (!old_light.empty()) {
+                    this->light[to] = old_light[from];
+                }
             }
+        }
+    }
+}
 
-            octree.voxels[index].material = mat;
-            octree.voxels[index].child = 0;
+void mcc::gl::BrickMap::resize(glm::uvec3 size) {
+    this->size = size;
+    this->brick_count = (size + glm::uvec3(brick_size - 1)) / glm::uvec3(brick_size);
+    this->table.assign(size_t(this->brick_count.x) * this->brick_count.y * this->brick_count.z, 0);
+    this->voxels.clear();
+}
+
+unsigned char mcc::gl::BrickMap::get(int x, int y, int z) const {
+    if (x < 0 || y < 0 || z < 0 || x >= int(this->size.x) || y >= int(this->size.y) || z >= int(this->size.z)) {
+        return 0;
+    }
+
+    auto& bc = this->brick_count;
+    auto slot = this->table[(size_t(x / brick_size) * bc.y + y / brick_size) * bc.z + z / brick_size];
+    if (slot == 0) {
+        return 0;
+    }
+    return this->voxels[size_t(slot - 1) * brick_voxels + morton_encode(x % brick_size, y % brick_size, z % brick_size)];
+}
+
+void mcc::gl::BrickMap::set(int x, int y, int z, unsigned char material) {
+    if (x < 0 || y < 0 || z < 0 || x >= int(this->size.x) || y >= int(this->size.y) || z >= int(this->size.z)) {
+        return;
+    }
+
+    auto& bc = this->brick_count;
+    auto& slot = this->table[(size_t(x / brick_size) * bc.y + y / brick_size) * bc.z + z / brick_size];
+    if (slot == 0) {
+        if (material == 0) {
+            return;
         }
-    };
+        this->voxels.resize(this->voxels.size() + brick_voxels, 0);
+        slot = (unsigned int)(this->voxels.size() / brick_voxels);
+    }
+    this->voxels[size_t(slot - 1) * brick_voxels + morton_encode(x % brick_size, y % brick_size, z % brick_size)] = material;
+}
+
+void mcc::gl::BrickMap::extract(glm::ivec3 origin, glm::u8vec3 size, Matrix& matrix) const {
+    memcpy(matrix.palette, this->palette, sizeof(matrix.palette));
+    matrix.size = size;
+    matrix.voxels.assign(matrix.get_voxel_count(), 0);
+    for (int x = 0; x < size.x; ++x) {
+        for (int y = 0; y < size.y; ++y) {
+            for (int z = 0; z < size.z; ++z) {
+                matrix.voxels[matrix.get_index(x, y, z)] = this->get(origin.x + x, origin.y + y, origin.z + z);
+            }
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
 
-    octree.voxels.resize(1);
-    build(0, 0, 0, 0, radius);
+        for (int side = 0; side <= 1; ++side) {
+            auto& border = matrix.borders[axis * 2 + side];
+            glm::ivec3 p = origin;
+            p[axis] += side == 0 ? -1 : int(size[axis]);
+            if (p[axis] < 0 || p[axis] >= int(this->size[axis])) {
+                border.clear(); // Outside of the map, the faces on this border are kept
+                continue;
+            }
 
-    return std::move(octree);
+            border.resize(size_t(size[u]) * size[v]);
+            for (int j = 0; j < size[v]; ++j) {
+                for (int k = 0; k < size[u]; ++k) {
+                    glm::ivec3 q = p;
+                    q[u] += k;
+                    q[v] += j;
+                    border[j * size[u] + k] = this->get(q.x, q.y, q.z);
+                }
+            }
+        }
+    }
 }
@@ -3,9 +3,12 @@
 #include <glm/glm.hpp>
 #include <vector>
 
+#include <mcc/gl/morton.hpp>
+
 namespace mcc::gl {
     struct Material {
         glm::u8vec4 color = { 0, 0, 0, 0 }; // RGBA
+        unsigned char emission = 0;         // Block light level emitted (0 - 15, see gl/light.hpp)
     };
 
     struct Octree {
@@ -19,15 +22,101 @@ namespace mcc::gl {
     };
 
     struct Matrix {
+        // Order of the voxels on the voxel vector.
+        // RowMajor: at index x * size.y * size.z + y * size.z + z, so only walking along z is contiguous.
+        // Morton: at index morton_encode(x, y, z), so that neighbouring voxels on every axis are close in memory.
+        // The vector ends at the code of the last voxel, and the cells on it which are outside of the size must be empty.
+        enum class Layout {
+            RowMajor,
+            Morton,
+        };
+
         Material palette[256];
         std::vector<unsigned char> voxels;
         glm::u8vec3 size;
+        Layout layout = Layout::RowMajor;
+
+        // One voxel thick layers surrounding the matrix, used to cull the faces hidden by neighbouring voxels.
+        // Indexed by axis * 2 + side (0 = negative, 1 = positive). Each layer stores its voxels at index
+        // v * size[u] + u, where u = (axis + 1) % 3 and v = (axis + 2) % 3.
+        // An empty layer means the neighbouring voxels are unknown, and the faces on that border are kept.
+        std::vector<unsigned char> borders[6];
+
+        // Light level of each voxel, on the same indices as the voxels, packed by gl::pack_light(). Empty when unlit.
+        std::vector<unsigned char> light;
+        // Light of the voxels on the border layers, on the same indices as the borders. An empty layer is dark.
+        std::vector<unsigned char> light_borders[6];
         
         Matrix() = default;
         Matrix(Matrix&& rhs) = default;
         Matrix(const Matrix&) = default;
         Matrix& operator=(Matrix&& rhs) = default;
+
+        inline size_t get_index(int x, int y, int z) const {
+            if (this->layout == Layout::Morton) {
+                return morton_encode(x, y, z);
+            }
+            return (size_t(x) * this->size.y + y) * this->size.z + z;
+        }
+
+        // Number of voxels stored on the vector for the current size and layout.
+        size_t get_voxel_count() const;
+        // Reorders the voxels (and their light, if computed) into another layout.
+        void set_layout(Layout layout);
+    };
+
+    // Sparse voxel storage for models of any size, split into 8x8x8 bricks. Empty bricks aren't stored.
+    struct BrickMap {
+        static constexpr int brick_size = 8;
+        static constexpr int brick_voxels = brick_size * brick_size * brick_size;
+        // Largest size per axis, in voxels, as the bricks are addressed by Morton codes of 10 bits per axis
+        static constexpr unsigned int max_size = 1024 * brick_size;
+
+        Material palette[256];
+        glm::uvec3 size = { 0, 0, 0 };        // In voxels
+        glm::uvec3 brick_count = { 0, 0, 0 }; // In bricks, per axis
+
+        // Maps each brick (at index x * brick_count.y * brick_count.z + y * brick_count.z + z) to its storage slot plus one.
+        // Empty bricks are mapped to 0.
+        std::vector<unsigned int> table;
+        // Voxels of the stored bricks, brick_voxels per slot. The voxels of a brick are laid out in Morton order.
+        std::vector<unsigned char> voxels;
+
+        // Clears the map and sets its size.
+        void resize(glm::uvec3 size);
+        // Positions outside of the map are empty.
+        unsigned char get(int x, int y, int z) const;
+        // Setting a voxel of an empty brick to a non-empty material allocates the brick. Writes outside of the map are ignored.
+        void set(int x, int y, int z, unsigned char material);
+
+        // Copies a region of the map to a matrix, on the matrix's layout, along with the border layers which are inside of the map.
+        void extract(glm::ivec3 origin, glm::u8vec3 size, Matrix& matrix) const;
+    };
+
+    // One bit per voxel, set for the non-empty voxels, used for collision queries.
+    // The bits are packed along z, in 64 bit words: voxel (x, y, z) is on word (x * size.y + y) * words_per_row + z / 64.
+    struct Occupancy {
+        glm::ivec3 size = { 0, 0, 0 };
+        int words_per_row = 0;
+        std::vector<uint64_t> bits;
+
+        // Positions outside of the grid are empty.
+        inline bool get(int x, int y, int z) const {
+            if (x < 0 || y < 0 || z < 0 || x >= this->size.x || y >= this->size.y || z >= this->size.z) {
+                return false;
+            }
+            return (this->bits[(size_t(x) * this->size.y + y) * this->words_per_row + z / 64] >> (z % 64)) & 1;
+        }
+
+        // Finds a non-empty voxel in the box [min, max), clipped to the grid. Returns false if there is none.
+        // Tests 64 voxels at once along z, so thin boxes should be laid along z when possible.
+        bool find(glm::ivec3 min, glm::ivec3 max, glm::ivec3& voxel) const;
     };
 
     Octree matrix_to_octree(const Matrix& matrix);
+    Occupancy matrix_to_occupancy(const Matrix& matrix);
+    // Builds the same octree as matrix_to_octree() would for the whole map, without a dense copy of its voxels. Only the
+    // non-empty bricks and their ancestors are visited, so the memory used doesn't grow with the empty space of the map.
+    // The map must be at most BrickMap::max_size voxels per axis.
+    Octree brick_map_to_octree(const BrickMap& map);
 }
\ No newline at end of file
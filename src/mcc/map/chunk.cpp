@@ -5,34 +5,38 @@
 #include <GL/glew.h>
 #include <glm/gtc/matrix_transform.hpp>
 
-mcc::map::Chunk::Chunk(Generator& generator, Chunk* parent, glm::f64vec3 center, float vox_sz, int chunk_size, int level)
-    : generator(generator), parent(parent), center(center), vox_sz(vox_sz), chunk_size(chunk_size), level(level) {
+#include <algorithm>
+
+mcc::map::Chunk::Chunk(Generator& generator, gl::MeshArena& arena, Chunk* parent, glm::f64vec3 center, float vox_sz, int chunk_size, int level, bool bake_ao, bool bake_light)
+    : generator(generator), arena(arena), parent(parent), center(center), vox_sz(vox_sz), chunk_size(chunk_size), level(level), bake_ao(bake_ao), bake_light(bake_light) {
     this->score = +INFINITY;
     for (int i = 0; i < 8; ++i) {
         this->children[i] = nullptr;
     }
+    this->mesh = gl::MeshArena::Invalid;
     this->generated = false;
-    this->has_fence = false;
+    this->meshed = false;
     this->visible = false;
-    this->delete_flag = false;
+    this->received_mask = 0;
+    this->light_changed = false;
+    this->seam_mask = 0;
     this->generator.load(this);
 }
 
 mcc::map::Chunk::~Chunk() {
     this->collapse();
 
-    if (!this->delete_flag) {
-        this->generator.unload(this);
-        while (this->generator.get_current() == this);
-    }
+    // Also waits for the generator thread to finish with this chunk, if it is generating it
+    this->generator.unload(this);
+
+    // Chunks are only deleted on the main thread, so that their arena slices are reclaimed right away
+    this->arena.free(this->mesh);
 }
 
 void mcc::map::Chunk::collapse() {
     for (int i = 0; i < 8; ++i) {
         if (this->children[i] != nullptr) {
-            this->children[i]->delete_flag = true;
-            this->children[i]->collapse();
-            this->generator.unload(this->children[i]);
+            delete this->children[i];
             this->children[i] = nullptr;
         }
     }
@@ -41,22 +45,82 @@ void mcc::map::Chunk::collapse() {
 void mcc::map::Chunk::generate() {
     this->generator.generate_palette(this->center, this->level, this->matrix.palette);
     this->matrix.size = glm::u8vec3(this->chunk_size, this->chunk_size, this->chunk_size);
-    this->matrix.voxels.resize(this->chunk_size * this->chunk_size * this->chunk_size);
+    this->matrix.voxels.resize(this->matrix.get_voxel_count());
+
+    auto voxel_position = [&](glm::ivec3 pos) {
+        auto offset = (glm::f64vec3(pos) / (double)this->chunk_size) - glm::f64vec3(0.5);
+        offset *= this->chunk_size * this->vox_sz;
+        return offset + this->center;
+    };
+
+    auto generate_voxel = [&](glm::ivec3 pos) {
+        return this->generator.generate_material(voxel_position(pos), this->level);
+    };
 
-    for (int x = 0, i = 0; x < this->chunk_size; ++x) {
+    for (int x = 0; x < this->chunk_size; ++x) {
         for (int y = 0; y < this->chunk_size; ++y) {
-            for (int z = 0; z < this->chunk_size; ++z, ++i) {
-                auto offset = (glm::f64vec3(x, y, z) / (double)this->chunk_size) - glm::f64vec3(0.5);
-                offset *= this->chunk_size * this->vox_sz;
-                this->matrix.voxels[i] = this->generator.generate_material(offset + this->center, this->level);
+            for (int z = 0; z < this->chunk_size; ++z) {
+                this->matrix.voxels[this->matrix.get_index(x, y, z)] = generate_voxel({ x, y, z });
             }
         }
     }
 
-    this->mesh.update(this->matrix, this->vox_sz, true, false);
+    // Generate the layers surrounding the chunk, so that the faces hidden by its neighbours are culled.
+    // These are sampled from the generator on this chunk's level instead of the neighbouring chunks, which may not be
+    // generated yet. They only match the neighbours drawn on the same level, so update_seams() moves them out of the
+    // matrix on the sides where the neighbours are drawn on a different level.
+    for (int d = 0; d < 3; ++d) {
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+
+        for (int side = 0; side <= 1; ++side) {
+            auto& border = this->matrix.borders[d * 2 + side];
+            border.resize(this->chunk_size * this->chunk_size);
+
+            glm::ivec3 x;
+            x[d] = side ? this->chunk_size : -1;
+            for (x[v] = 0; x[v] < this->chunk_size; ++x[v]) {
+                for (x[u] = 0; x[u] < this->chunk_size; ++x[u]) {
+                    border[x[v] * this->chunk_size + x[u]] = generate_voxel(x);
+                }
+            }
+        }
+    }
+
+    this->occupancy = gl::matrix_to_occupancy(this->matrix);
+
+    // Light the chunk on its own, with the sky light reaching the top unless the terrain above hides it, and no light
+    // coming from the other sides. The neighbours on the same level correct this once they share their light, on
+    // update_light(), but light isn't shared across levels, so the top must not assume an open sky.
+    if (this->bake_light) {
+        for (int i = 0; i < 6; ++i) {
+            this->matrix.light_borders[i].assign(this->chunk_size * this->chunk_size, 0);
+        }
+
+        auto root = this;
+        while (root->parent != nullptr) {
+            root = root->parent;
+        }
+        auto map_top = root->center.y + double(root->vox_sz) * double(root->chunk_size) * 0.5;
+
+        auto& top = this->matrix.borders[3];
+        for (int z = 0; z < this->chunk_size; ++z) {
+            for (int x = 0; x < this->chunk_size; ++x) {
+                // Top layers are indexed as v * size + u, with u = z and v = x
+                auto i = x * this->chunk_size + z;
+                auto& material = this->matrix.palette[top[i]];
+                auto pos = voxel_position({ x, this->chunk_size, z });
+                bool sky = material.color.a != 255 &&
+                           !this->generator.generate_sky_occlusion(pos, this->vox_sz, map_top, this->level, this->matrix.palette);
+                this->matrix.light_borders[3][i] = gl::pack_light(sky ? gl::max_light_level : 0, material.emission);
+            }
+        }
+
+        gl::propagate_light(this->matrix);
+    }
 
-    this->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-    this->has_fence = true;
+    gl::mesh_matrix(this->matrix, this->vox_sz, true, this->bake_ao, this->mesh_data);
+    this->meshed = true;
 }
 
 void mcc::map::Chunk::update(const ui::Camera& camera, float lod_distance) {
@@ -70,25 +134,22 @@ void mcc::map::Chunk::update(const ui::Camera& camera, float lod_distance) {
         this->visible = false;
         this->score = (distance * distance - this->level * 100)/* * (intersects_frustum ? 1.0f : 1000.0f)*/;
         
-        if (this->has_fence) {
-            auto state = glClientWaitSync(this->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
-            if (state == GL_WAIT_FAILED) {
-                std::cerr << "mcc::map::Chunk::update() failed:" << std::endl;
-                std::cerr << "glClientWaitSync() returned GL_WAIT_FAILED:" << std::endl;
-                std::cerr << "glGetError() returned " << glGetError() << std::endl;
-                std::abort();
-            }
-            else if (state != GL_TIMEOUT_EXPIRED) {
-                this->generated = true;
-                this->mesh.generate_va();
-            }
-            else {
-                return;
-            }
-        }
-        else {
+        if (!this->meshed) {
             return;
         }
+
+        // Upload the mesh generated on the generator thread
+        auto result = this->arena.allocate(this->mesh_data);
+        if (result.is_error()) {
+            std::cerr << "mcc::map::Chunk::update() failed:" << std::endl;
+            std::cerr << "Couldn't upload chunk mesh:" << std::endl;
+            std::cerr << result.get_error() << std::endl;
+            std::abort();
+        }
+        this->mesh = result.unwrap();
+        this->mesh_data = gl::MeshData();
+        this->generated = true;
+        this->light_changed = this->bake_light;
     }
 
     // Check if this chunk should be further divided
@@ -106,11 +167,14 @@ void mcc::map::Chunk::update(const ui::Camera& camera, float lod_distance) {
             int z = (i % 2) * 2 - 1;
             this->children[i] = new Chunk(
                 generator,
+                arena,
                 this,
                 this->center + glm::f64vec3(x, y, z) * (double)this->vox_sz * (double)this->chunk_size * 0.25,
                 this->vox_sz / 2.0f,
                 this->chunk_size,
-                this->level - 1
+                this->level - 1,
+                this->bake_ao,
+                this->bake_light
             );
         }
     }
@@ -132,34 +196,336 @@ void mcc::map::Chunk::update(const ui::Camera& camera, float lod_distance) {
     }
 }
 
-void mcc::map::Chunk::draw(const ui::Camera& camera, unsigned int model_loc) {
+void mcc::map::Chunk::draw(const ui::Camera& camera, std::vector<gl::MeshArena::Draw>& draws) {
     if (!this->visible) {
         return;
     }
 
-    bool draw_children = this->children[0] != nullptr;
-    if (draw_children) {
+    if (this->draws_children()) {
         for (int i = 0; i < 8; ++i) {
-            if (!this->children[i]->generated) {
-                draw_children = false;
-                break;
+            this->children[i]->draw(camera, draws);
+        }
+    }
+    else {
+        if (this->mesh != gl::MeshArena::Invalid) {
+            draws.push_back({ this->mesh, glm::vec3(this->center) - glm::vec3(this->vox_sz * this->chunk_size) * 0.5f });
+        }
+
+        gl::Debug::draw_box(this->center, glm::vec3(this->vox_sz * this->chunk_size) * 0.5f, glm::vec4(0.0f, 1.0f, 0.0f, 0.2f));
+    }
+}
+
+void mcc::map::Chunk::update_light(ThreadPool& pool, int max_chunks) {
+    if (!this->bake_light) {
+        return;
+    }
+
+    std::vector<Chunk*> chunks;
+    this->gather_generated(chunks);
+
+    // Share the light both ways between the chunks whose light changed and their neighbours
+    std::vector<unsigned char> face;
+    for (auto chunk : chunks) {
+        if (!chunk->light_changed) {
+            continue;
+        }
+
+        for (int side = 0; side < 6; ++side) {
+            auto neighbour = chunk->find_neighbour(side);
+            if (neighbour == nullptr) {
+                continue;
             }
+
+            gl::get_face_light(chunk->matrix, side, face);
+            neighbour->receive_light(side ^ 1, face);
+            gl::get_face_light(neighbour->matrix, side ^ 1, face);
+            chunk->receive_light(side, face);
+        }
+        chunk->light_changed = false;
+    }
+
+    std::vector<Chunk*> relit;
+    for (auto chunk : chunks) {
+        if (chunk->received_mask != 0 && int(relit.size()) < max_chunks) {
+            relit.push_back(chunk);
         }
     }
 
-    if (draw_children) {
+    if (relit.empty()) {
+        return;
+    }
+
+    pool.parallel_for(int(relit.size()), [&](int i) {
+        relit[i]->relight();
+    });
+
+    this->replace_meshes(relit);
+}
+
+void mcc::map::Chunk::update_seams(ThreadPool& pool, int max_chunks) {
+    std::vector<Chunk*> chunks;
+    this->gather_drawn(chunks);
+
+    std::vector<Chunk*> remeshed;
+    for (auto chunk : chunks) {
+        if (int(remeshed.size()) >= max_chunks) {
+            break;
+        }
+
+        int mask = 0;
+        for (int side = 0; side < 6; ++side) {
+            mask |= chunk->is_level_seam(side) ? 1 << side : 0;
+        }
+
+        // Swap the generated layers in or out of the matrix on the sides which changed. Empty borders keep their faces.
+        int changed = mask ^ chunk->seam_mask;
+        if (changed != 0) {
+            for (int side = 0; side < 6; ++side) {
+                if (changed & (1 << side)) {
+                    std::swap(chunk->matrix.borders[side], chunk->seam_borders[side]);
+                }
+            }
+            chunk->seam_mask = mask;
+            remeshed.push_back(chunk);
+        }
+    }
+
+    if (remeshed.empty()) {
+        return;
+    }
+
+    pool.parallel_for(int(remeshed.size()), [&](int i) {
+        auto chunk = remeshed[i];
+        gl::mesh_matrix(chunk->matrix, chunk->vox_sz, true, chunk->bake_ao, chunk->mesh_data);
+    });
+
+    this->replace_meshes(remeshed);
+}
+
+void mcc::map::Chunk::replace_meshes(const std::vector<Chunk*>& chunks) {
+    // Replace the meshes, so that the old ones are drawn until the new ones are uploaded
+    for (auto chunk : chunks) {
+        auto result = this->arena.allocate(chunk->mesh_data);
+        if (result.is_error()) {
+            std::cerr << "mcc::map::Chunk::replace_meshes() failed:" << std::endl;
+            std::cerr << "Couldn't upload chunk mesh:" << std::endl;
+            std::cerr << result.get_error() << std::endl;
+            std::abort();
+        }
+        this->arena.free(chunk->mesh);
+        chunk->mesh = result.unwrap();
+        chunk->mesh_data = gl::MeshData();
+    }
+}
+
+mcc::map::Chunk* mcc::map::Chunk::find_neighbour(int side) {
+    auto root = this;
+    while (root->parent != nullptr) {
+        root = root->parent;
+    }
+
+    auto target = this->center;
+    target[side / 2] += (side % 2 ? 1.0 : -1.0) * double(this->vox_sz) * double(this->chunk_size);
+    auto extent = double(root->vox_sz) * double(root->chunk_size) * 0.5;
+    if (glm::any(glm::greaterThanEqual(glm::abs(target - root->center), glm::f64vec3(extent)))) {
+        return nullptr;
+    }
+
+    // Descend through the children which contain the neighbour's center
+    auto chunk = root;
+    while (chunk->level > this->level) {
+        if (chunk->children[0] == nullptr) {
+            return nullptr;
+        }
+        int i = (target.x > chunk->center.x ? 4 : 0) + (target.y > chunk->center.y ? 2 : 0) + (target.z > chunk->center.z ? 1 : 0);
+        chunk = chunk->children[i];
+    }
+
+    return chunk->generated ? chunk : nullptr;
+}
+
+bool mcc::map::Chunk::is_level_seam(int side) {
+    auto root = this;
+    while (root->parent != nullptr) {
+        root = root->parent;
+    }
+
+    auto target = this->center;
+    target[side / 2] += (side % 2 ? 1.0 : -1.0) * double(this->vox_sz) * double(this->chunk_size);
+    auto extent = double(root->vox_sz) * double(root->chunk_size) * 0.5;
+    if (glm::any(glm::greaterThanEqual(glm::abs(target - root->center), glm::f64vec3(extent)))) {
+        return false; // Outside of the map, the generated layer matches nothing drawn
+    }
+
+    // Descend through the drawn chunks which contain the neighbour's center, as draw() does
+    auto chunk = root;
+    while (chunk->level > this->level) {
+        if (!chunk->draws_children()) {
+            return true; // Drawn on a coarser level
+        }
+        int i = (target.x > chunk->center.x ? 4 : 0) + (target.y > chunk->center.y ? 2 : 0) + (target.z > chunk->center.z ? 1 : 0);
+        chunk = chunk->children[i];
+    }
+
+    return chunk->draws_children(); // Drawn on a finer level
+}
+
+bool mcc::map::Chunk::draws_children() const {
+    if (this->children[0] == nullptr) {
+        return false;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        if (!this->children[i]->generated) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void mcc::map::Chunk::gather_drawn(std::vector<Chunk*>& chunks) {
+    if (this->draws_children()) {
         for (int i = 0; i < 8; ++i) {
-            this->children[i]->draw(camera, model_loc);
+            this->children[i]->gather_drawn(chunks);
         }
+    } else if (this->generated) {
+        chunks.push_back(this);
     }
-    else {
-        auto model = glm::translate(
-            glm::mat4(1.0f),
-            glm::vec3(this->center) - glm::vec3(this->vox_sz * this->chunk_size) * 0.5f
-        );
-        glUniformMatrix4fv(model_loc, 1, GL_FALSE, &model[0][0]);
-        this->mesh.draw_opaque();
+}
 
-        gl::Debug::draw_box(this->center, glm::vec3(this->vox_sz * this->chunk_size) * 0.5f, glm::vec4(0.0f, 1.0f, 0.0f, 0.2f));
+void mcc::map::Chunk::gather_generated(std::vector<Chunk*>& chunks) {
+    if (this->generated) {
+        chunks.push_back(this);
+    }
+
+    if (this->children[0] != nullptr) {
+        for (int i = 0; i < 8; ++i) {
+            this->children[i]->gather_generated(chunks);
+        }
+    }
+}
+
+void mcc::map::Chunk::receive_light(int border, const std::vector<unsigned char>& light) {
+    auto& current = (this->received_mask & (1 << border)) ? this->received_light[border] : this->matrix.light_borders[border];
+    if (current != light) {
+        this->received_light[border] = light;
+        this->received_mask |= 1 << border;
+    }
+}
+
+void mcc::map::Chunk::relight() {
+    for (int i = 0; i < 6; ++i) {
+        if (this->received_mask & (1 << i)) {
+            this->light_changed |= gl::set_light_border(this->matrix, i, this->received_light[i]);
+            this->received_light[i].clear();
+        }
+    }
+    this->received_mask = 0;
+
+    gl::mesh_matrix(this->matrix, this->vox_sz, true, this->bake_ao, this->mesh_data);
+}
+
+bool mcc::map::Chunk::raycast(const gl::Ray& ray, gl::RayHit& hit, const Chunk** hit_chunk) const {
+    hit = gl::RayHit();
+
+    auto extent = this->vox_sz * float(this->chunk_size);
+    auto min = glm::vec3(this->get_voxel_position({ 0, 0, 0 }));
+    float near, far;
+    int axis;
+    if (!gl::clip_ray(ray, min, min + glm::vec3(extent), near, far, axis)) {
+        return false;
+    }
+
+    // Use the children only when they are drawn
+    if (this->draws_children()) {
+        // Visit the children in the order the ray enters them, so that the first hit is the nearest one
+        std::pair<float, int> order[8];
+        int count = 0;
+        for (int i = 0; i < 8; ++i) {
+            auto child_min = glm::vec3(this->children[i]->get_voxel_position({ 0, 0, 0 }));
+            if (gl::clip_ray(ray, child_min, child_min + glm::vec3(extent * 0.5f), near, far, axis)) {
+                order[count++] = { near, i };
+            }
+        }
+        std::sort(order, order + count);
+
+        for (int i = 0; i < count; ++i) {
+            if (this->children[order[i].second]->raycast(ray, hit, hit_chunk)) {
+                return true;
+            }
+        }
+        return false;
     }
+
+    if (!this->generated) {
+        return false;
+    }
+
+    // Cast on the voxel space of the matrix
+    gl::Ray local = { (ray.origin - min) / this->vox_sz, ray.direction, ray.max_distance / this->vox_sz };
+    if (!gl::raycast(this->matrix, local, hit)) {
+        return false;
+    }
+
+    hit.distance *= this->vox_sz;
+    if (hit_chunk != nullptr) {
+        *hit_chunk = this;
+    }
+    return true;
+}
+
+void mcc::map::Chunk::raycast(const std::vector<gl::Ray>& rays, std::vector<gl::RayHit>& hits, ThreadPool* pool) const {
+    gl::raycast_batch(rays, hits, pool, [&](const gl::Ray& ray, gl::RayHit& hit) {
+        this->raycast(ray, hit);
+    });
+}
+
+bool mcc::map::Chunk::sweep(const entity::BoundingBox& box, glm::f32vec3 motion, entity::Contact& contact, const Chunk** hit_chunk) const {
+    contact = entity::Contact();
+
+    // Skip the chunks which the swept box doesn't reach
+    auto extent = this->vox_sz * float(this->chunk_size);
+    auto min = glm::vec3(this->get_voxel_position({ 0, 0, 0 }));
+    auto low = glm::min(box.get_low(), box.get_low() + motion);
+    auto high = glm::max(box.get_high(), box.get_high() + motion);
+    if (!entity::BoundingBox(low, high).intersects(entity::BoundingBox(min, min + glm::vec3(extent)))) {
+        return false;
+    }
+
+    // Use the children only when they are drawn
+    if (this->draws_children()) {
+        // The box may cross several children, so keep the earliest hit
+        bool hit = false;
+        for (int i = 0; i < 8; ++i) {
+            entity::Contact child_contact;
+            const Chunk* child_hit = nullptr;
+            if (this->children[i]->sweep(box, motion, child_contact, &child_hit) && child_contact.time < contact.time) {
+                contact = child_contact;
+                hit = true;
+                if (hit_chunk != nullptr) {
+                    *hit_chunk = child_hit;
+                }
+            }
+        }
+        return hit;
+    }
+
+    if (!this->generated) {
+        return false;
+    }
+
+    // Sweep on the voxel space of the matrix. The time of impact is a fraction of the motion, so it needs no conversion.
+    auto local = entity::BoundingBox((box.get_low() - min) / this->vox_sz, (box.get_high() - min) / this->vox_sz);
+    if (!local.sweep(this->occupancy, motion / this->vox_sz, contact)) {
+        return false;
+    }
+
+    if (hit_chunk != nullptr) {
+        *hit_chunk = this;
+    }
+    return true;
+}
+
+glm::f64vec3 mcc::map::Chunk::get_voxel_position(glm::ivec3 voxel) const {
+    return this->center + (glm::f64vec3(voxel) - glm::f64vec3(this->chunk_size * 0.5)) * double(this->vox_sz);
 }
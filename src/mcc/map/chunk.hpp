@@ -1,36 +1,88 @@
 #pragma once
 
-#include <mcc/gl/mesh.hpp>
+#include <mcc/gl/mesh_arena.hpp>
+#include <mcc/gl/raycast.hpp>
+#include <mcc/gl/light.hpp>
+#include <mcc/entity/bounding_box.hpp>
 #include <mcc/ui/camera.hpp>
 #include <mcc/map/generator.hpp>
 
 #include <glm/glm.hpp>
 #include <GL/glew.h>
 
+#include <atomic>
+
 namespace mcc::map {
     class Chunk final {
     public:
-        Chunk(Generator& generator, Chunk* parent, glm::f64vec3 center, float vox_sz, int chunk_size, int level);
+        Chunk(Generator& generator, gl::MeshArena& arena, Chunk* parent, glm::f64vec3 center, float vox_sz, int chunk_size, int level, bool bake_ao = false, bool bake_light = false);
         ~Chunk();
 
         void generate();
         void update(const ui::Camera& camera, float lod_distance);
-        void draw(const ui::Camera& camera, unsigned int model_loc);
+        // Gathers the meshes of the visible chunks, to be drawn in a single batch with gl::MeshArena::draw_opaque().
+        void draw(const ui::Camera& camera, std::vector<gl::MeshArena::Draw>& draws);
+
+        // Shares the light on the faces of the chunks whose light changed with their neighbours on the same level, and then
+        // relights and remeshes up to max_chunks of the chunks which received new light, in parallel on a thread pool.
+        // Each chunk is lit on its own when generated, so the light crosses the chunk borders over the next calls.
+        // Must be called on the root chunk, from the thread which updates the chunks, after update().
+        void update_light(ThreadPool& pool, int max_chunks);
+        // Keeps the faces on the borders of the drawn chunks whose neighbours are drawn on a different level, which the
+        // layers generated around each chunk don't match, and culls them again once the levels match. Remeshes up to
+        // max_chunks chunks, in parallel on a thread pool. Must be called on the root chunk, from the thread which
+        // updates the chunks, after update().
+        void update_seams(ThreadPool& pool, int max_chunks);
+
+        // Casts a world space ray through the finest generated level of detail of the tree, the same one draw() uses.
+        // The voxel hit is on the matrix of the chunk which was hit, and the distance is in world units.
+        // Must only be called from the thread which updates the chunks, while they aren't being updated.
+        bool raycast(const gl::Ray& ray, gl::RayHit& hit, const Chunk** hit_chunk = nullptr) const;
+        // Casts many rays at once (e.g. AI queries), leaving the misses with material 0.
+        void raycast(const std::vector<gl::Ray>& rays, std::vector<gl::RayHit>& hits, ThreadPool* pool = nullptr) const;
+
+        // Sweeps a world space box along a motion through the finest generated level of detail of the tree, as raycast() does,
+        // testing the occupancy grids of the chunks it crosses. The voxel hit is on the matrix of the chunk which was hit.
+        // Must only be called from the thread which updates the chunks, while they aren't being updated.
+        bool sweep(const entity::BoundingBox& box, glm::f32vec3 motion, entity::Contact& contact, const Chunk** hit_chunk = nullptr) const;
+
+        // World position of the minimum corner of a voxel of this chunk
+        glm::f64vec3 get_voxel_position(glm::ivec3 voxel) const;
 
         inline Chunk* get_parent() const { return this->parent; }
+        inline float get_voxel_size() const { return this->vox_sz; }
 
         inline float get_score() const { return this->score; }
         inline int get_level() const { return this->level; }
-        inline bool should_delete() const { return this->delete_flag; }
         inline bool is_generated() const { return this->generated; }
 
     private:
         void collapse();
 
+        // Finds the generated chunk next to this one on a side (indexed as gl::Matrix::borders), on the same level
+        Chunk* find_neighbour(int side);
+        // Checks if the chunks drawn next to this one on a side (indexed as gl::Matrix::borders) are on a different level
+        bool is_level_seam(int side);
+        // Checks if draw() draws the children instead of this chunk, which is when all of them are generated
+        bool draws_children() const;
+        // Gathers the chunks of the tree which draw() draws, ignoring the frustum
+        void gather_drawn(std::vector<Chunk*>& chunks);
+        // Gathers the generated chunks of the tree
+        void gather_generated(std::vector<Chunk*>& chunks);
+        // Uploads the meshes generated for the chunks and frees their previous ones
+        void replace_meshes(const std::vector<Chunk*>& chunks);
+        // Queues a new light border for the next relight, if it differs from the current one
+        void receive_light(int border, const std::vector<unsigned char>& light);
+        // Applies the queued light borders and remeshes the chunk. Only touches this chunk, so it may run in parallel.
+        void relight();
+
         Generator& generator;
+        gl::MeshArena& arena;
 
-        gl::Mesh mesh;
+        gl::MeshData mesh_data; // Generated on the generator thread, uploaded to the arena on the main thread
+        gl::MeshArena::Handle mesh;
         gl::Matrix matrix;
+        gl::Occupancy occupancy; // Generated along with the matrix, for collision queries
 
         Chunk* parent;
         Chunk* children[8];
@@ -38,13 +90,19 @@ namespace mcc::map {
         glm::f64vec3 center;
         float vox_sz;
         int chunk_size, level;
+        bool bake_ao, bake_light;
+
+        std::vector<unsigned char> received_light[6]; // Light borders queued by receive_light()
+        int received_mask;                            // Bit i is set if received_light[i] is queued
+        bool light_changed;                           // The light on the faces must be shared with the neighbours
+
+        std::vector<unsigned char> seam_borders[6]; // Generated layers moved out of the matrix by update_seams()
+        int seam_mask;                              // Bit i is set if the neighbours on side i are on a different level
 
         bool visible;
         bool generated;
-        bool delete_flag;
         float score;
 
-        GLsync sync;
-        bool has_fence;
+        std::atomic<bool> meshed;
     };
 }
\ No newline at end of file
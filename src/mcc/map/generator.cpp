@@ -38,15 +38,22 @@ void mcc::map::Generator::load(Chunk* chunk) {
 
 void mcc::map::Generator::unload(Chunk* chunk) {
     chunk_count -= 1;
-    this->queue_mutex.lock();
+    std::unique_lock<std::recursive_mutex> lock(this->queue_mutex);
     auto it = this->queue.find(chunk);
     if (it != this->queue.end()) {
         this->queue.erase(it);
-        if (chunk->should_delete()) {
-            delete chunk;
+    }
+    this->current_done.wait(lock, [&] { return this->current != chunk; });
+}
+
+bool mcc::map::Generator::generate_sky_occlusion(glm::f64vec3 pos, double vox_sz, double top, int level, const gl::Material* palette) {
+    for (double distance = vox_sz; pos.y + distance < top; distance *= 2.0) {
+        auto material = this->generate_material(pos + glm::f64vec3(0.0, distance, 0.0), level);
+        if (palette[material].color.a == 255) {
+            return true;
         }
     }
-    this->queue_mutex.unlock();
+    return false;
 }
 
 void mcc::map::Generator::thread_func(void* context) {
@@ -61,26 +68,28 @@ void mcc::map::Generator::thread_func(void* context) {
             continue;
         }
 
-        this->current = *this->queue.begin();
+        auto next = *this->queue.begin();
         for (auto& c : this->queue) {
             if (c->get_parent() == nullptr) {
-                this->current = c;
+                next = c;
                 break;
             }
 
-            if (c->get_parent()->get_score() < this->current->get_parent()->get_score()) {
-                this->current = c;
+            if (c->get_parent()->get_score() < next->get_parent()->get_score()) {
+                next = c;
             }
         }
 
-        this->queue.erase(this->current);
+        this->current = next;
+        this->queue.erase(next);
         this->queue_mutex.unlock();
 
-        this->current->generate();
-        if (this->current->should_delete()) {
-            delete this->current;
-        }
+        next->generate();
+
+        this->queue_mutex.lock();
         this->current = nullptr;
+        this->queue_mutex.unlock();
+        this->current_done.notify_all();
     }
 
     glfwDestroyWindow((GLFWwindow*)context);
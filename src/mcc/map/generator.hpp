@@ -4,6 +4,7 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
 
 #include <glm/glm.hpp>
 
@@ -20,14 +21,17 @@ namespace mcc::map {
         ~Generator();
 
         void load(Chunk* chunk);
+        // Removes a chunk from the queue, waiting for the generator thread to finish with it if it is generating it
         void unload(Chunk* chunk);
 
-        inline Chunk* get_current() const { return this->current; }
-
         // Receives the chunk center coordinates and its level and generates the palette used.
         virtual void generate_palette(glm::f64vec3 pos, int level, gl::Material* palette) = 0;
         // Receives the voxel's coordinates and its level and generates its material
         virtual unsigned char generate_material(glm::f64vec3 pos, int level) = 0;
+        // Receives a voxel's coordinates, size and level, the height of the top of the map and the palette of its chunk,
+        // and checks if the terrain above the voxel hides it from the sky. By default, samples generate_material() up the
+        // column at doubling distances, which catches the thick ceilings of caves with few samples.
+        virtual bool generate_sky_occlusion(glm::f64vec3 pos, double vox_sz, double top, int level, const gl::Material* palette);
 
     private:
         void thread_func(void* context);
@@ -36,8 +40,9 @@ namespace mcc::map {
 
         std::atomic<bool> stop;
         std::set<Chunk*> queue;
-        Chunk* current;
+        Chunk* current; // Guarded by queue_mutex
         std::recursive_mutex queue_mutex;
+        std::condition_variable_any current_done; // Notified when the generator thread finishes a chunk
         bool trigger;
 
         int chunk_count;
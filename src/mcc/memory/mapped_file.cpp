@@ -0,0 +1,135 @@
+#include <mcc/memory/mapped_file.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace mcc;
+using namespace mcc::memory;
+
+MappedFile::MappedFile() {
+    this->data = nullptr;
+    this->size = 0;
+#ifdef _WIN32
+    this->file = INVALID_HANDLE_VALUE;
+    this->mapping = nullptr;
+#else
+    this->fd = -1;
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) {
+    this->data = rhs.data;
+    this->size = rhs.size;
+    rhs.data = nullptr;
+    rhs.size = 0;
+#ifdef _WIN32
+    this->file = rhs.file;
+    this->mapping = rhs.mapping;
+    rhs.file = INVALID_HANDLE_VALUE;
+    rhs.mapping = nullptr;
+#else
+    this->fd = rhs.fd;
+    rhs.fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (this->data != nullptr) {
+        UnmapViewOfFile(this->data);
+    }
+    if (this->mapping != nullptr) {
+        CloseHandle(this->mapping);
+    }
+    if (this->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(this->file);
+    }
+#else
+    if (this->data != nullptr) {
+        munmap((void*)this->data, this->size);
+    }
+    if (this->fd != -1) {
+        close(this->fd);
+    }
+#endif
+}
+
+Result<MappedFile, std::string> MappedFile::open(const std::string& path) {
+    MappedFile file;
+
+#ifdef _WIN32
+    file.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file.file == INVALID_HANDLE_VALUE) {
+        return Result<MappedFile, std::string>::error(
+            "mcc::memory::MappedFile::open() failed:\nCreateFileA() failed on '" + path + "' with error '" +
+            std::to_string(GetLastError()) + "'"
+        );
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file.file, &size)) {
+        return Result<MappedFile, std::string>::error(
+            "mcc::memory::MappedFile::open() failed:\nGetFileSizeEx() failed on '" + path + "' with error '" +
+            std::to_string(GetLastError()) + "'"
+        );
+    }
+    file.size = size_t(size.QuadPart);
+
+    // Empty files can't be mapped, and are viewed as a null pointer with size 0
+    if (file.size > 0) {
+        file.mapping = CreateFileMappingA(file.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (file.mapping == nullptr) {
+            return Result<MappedFile, std::string>::error(
+                "mcc::memory::MappedFile::open() failed:\nCreateFileMappingA() failed on '" + path + "' with error '" +
+                std::to_string(GetLastError()) + "'"
+            );
+        }
+
+        file.data = (const unsigned char*)MapViewOfFile(file.mapping, FILE_MAP_READ, 0, 0, 0);
+        if (file.data == nullptr) {
+            return Result<MappedFile, std::string>::error(
+                "mcc::memory::MappedFile::open() failed:\nMapViewOfFile() failed on '" + path + "' with error '" +
+                std::to_string(GetLastError()) + "'"
+            );
+        }
+    }
+#else
+    file.fd = ::open(path.c_str(), O_RDONLY);
+    if (file.fd == -1) {
+        return Result<MappedFile, std::string>::error(
+            "mcc::memory::MappedFile::open() failed:\nopen() failed on '" + path + "' with errno '" + std::to_string(errno) + "'"
+        );
+    }
+
+    struct stat info;
+    if (fstat(file.fd, &info) == -1) {
+        return Result<MappedFile, std::string>::error(
+            "mcc::memory::MappedFile::open() failed:\nfstat() failed on '" + path + "' with errno '" + std::to_string(errno) + "'"
+        );
+    }
+    file.size = size_t(info.st_size);
+
+    // Empty files can't be mapped, and are viewed as a null pointer with size 0
+    if (file.size > 0) {
+        auto data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+        if (data == MAP_FAILED) {
+            file.size = 0;
+            return Result<MappedFile, std::string>::error(
+                "mcc::memory::MappedFile::open() failed:\nmmap() failed on '" + path + "' with errno '" + std::to_string(errno) + "'"
+            );
+        }
+        file.data = (const unsigned char*)data;
+    }
+#endif
+
+    return Result<MappedFile, std::string>::success(std::move(file));
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <mcc/result.hpp>
+
+#include <string>
+
+namespace mcc::memory {
+    /*
+        Read only view of a whole file mapped into memory. Pages are only read from disk when first touched, and the data
+        is page aligned, so it can be viewed in place as arrays of any type.
+    */
+    class MappedFile final {
+    public:
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile&& rhs);
+        ~MappedFile();
+
+        static Result<MappedFile, std::string> open(const std::string& path);
+
+        inline const unsigned char* get_data() const { return this->data; }
+        inline size_t get_size() const { return this->size; }
+
+    private:
+        MappedFile();
+
+        const unsigned char* data;
+        size_t size;
+#ifdef _WIN32
+        void* file;
+        void* mapping;
+#else
+        int fd;
+#endif
+    };
+}
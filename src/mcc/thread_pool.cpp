@@ -0,0 +1,121 @@
+#include <mcc/thread_pool.hpp>
+
+using namespace mcc;
+
+namespace {
+    // Pool whose tasks the current thread is running, if any
+    thread_local const ThreadPool* running_pool = nullptr;
+}
+
+mcc::ThreadPool::ThreadPool(int thread_count) {
+    if (thread_count < 0) {
+        thread_count = int(std::thread::hardware_concurrency()) - 1;
+        if (thread_count < 0) {
+            thread_count = 0;
+        }
+    }
+
+    this->stop = false;
+    this->generation = 0;
+    this->func = nullptr;
+    this->count = 0;
+    this->next = 0;
+    this->active = 0;
+
+    for (int i = 0; i < thread_count; ++i) {
+        this->threads.emplace_back(&ThreadPool::thread_func, this);
+    }
+}
+
+mcc::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stop = true;
+    }
+    this->wake_cv.notify_all();
+
+    for (auto& thread : this->threads) {
+        thread.join();
+    }
+}
+
+void mcc::ThreadPool::parallel_for(int count, const std::function<void(int)>& func) {
+    if (count <= 0) {
+        return;
+    }
+
+    // Not worth waking the workers up. Calls from inside a task also run inline, as the workers are all busy with the
+    // outer call and waiting for them would deadlock.
+    if (count == 1 || this->threads.empty() || running_pool == this) {
+        for (int i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit_lock(this->submit_mutex);
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->func = &func;
+        this->count = count;
+        this->next = 0;
+        this->active = int(this->threads.size());
+        this->generation += 1;
+    }
+    this->wake_cv.notify_all();
+
+    this->run_tasks();
+
+    // Wait until every worker has left this generation, so that func can be safely destroyed
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->done_cv.wait(lock, [this] { return this->active == 0; });
+    this->func = nullptr;
+}
+
+void mcc::ThreadPool::parallel_for_range(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& func) {
+    int task_count = int((count + grain - 1) / grain);
+    auto task = [&](int i) {
+        size_t begin = size_t(i) * grain;
+        func(begin, begin + grain < count ? begin + grain : count);
+    };
+
+    if (pool == nullptr) {
+        for (int i = 0; i < task_count; ++i) {
+            task(i);
+        }
+    } else {
+        pool->parallel_for(task_count, task);
+    }
+}
+
+void mcc::ThreadPool::thread_func() {
+    unsigned long long seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake_cv.wait(lock, [&] { return this->stop || this->generation != seen; });
+            if (this->stop) {
+                return;
+            }
+            seen = this->generation;
+        }
+
+        this->run_tasks();
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->active -= 1;
+        }
+        this->done_cv.notify_one();
+    }
+}
+
+void mcc::ThreadPool::run_tasks() {
+    running_pool = this;
+    for (int i = this->next++; i < this->count; i = this->next++) {
+        (*this->func)(i);
+    }
+    running_pool = nullptr;
+}
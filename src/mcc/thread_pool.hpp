@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace mcc {
+    /*
+        Fixed set of worker threads used to split CPU heavy work (such as meshing) into independent tasks.
+        The thread calling parallel_for() also runs tasks, so a pool with zero workers runs everything serially.
+    */
+    class ThreadPool final {
+    public:
+        // If thread_count is negative, one worker is created per hardware thread, minus the calling thread.
+        ThreadPool(int thread_count = -1);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+        ~ThreadPool();
+
+        // Calls func(i) for every i in [0, count) and blocks until all calls have returned.
+        // The calls may run concurrently and in any order. Only one parallel_for() runs at a time, so calls made by func
+        // itself (nested calls) don't use the workers and run serially on the calling thread.
+        void parallel_for(int count, const std::function<void(int)>& func);
+
+        // Splits [0, count) into ranges of grain items (the last one may be shorter) and calls func(begin, end) for each
+        // of them, through pool->parallel_for(). If pool is null, the ranges run in order on the calling thread.
+        static void parallel_for_range(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& func);
+
+        // Returns the number of threads which run tasks, including the calling thread.
+        inline int get_thread_count() const { return int(this->threads.size()) + 1; }
+
+    private:
+        void thread_func();
+        void run_tasks();
+
+        std::vector<std::thread> threads;
+
+        std::mutex submit_mutex; // Held during a whole parallel_for() call
+        std::mutex mutex;
+        std::condition_variable wake_cv, done_cv;
+        bool stop;
+        unsigned long long generation; // Incremented on each parallel_for() call, wakes up the workers
+
+        const std::function<void(int)>* func;
+        int count;
+        std::atomic<int> next;
+        int active; // Workers still running tasks from the current generation
+    };
+}